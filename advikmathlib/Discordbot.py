@@ -9,9 +9,11 @@ from collections import defaultdict
 import random
 import asyncio
 import string
+import time
 import copy
 import chess
 import sympy
+from sympy_native import Advikmathlib, native_sympy  # Advikmathlib is None without the native module
 
 # --- ENV SETUP ---
 os.environ['SSL_CERT_FILE'] = certifi.where()
@@ -20,14 +22,47 @@ os.environ['SSL_CERT_FILE'] = certifi.where()
 TOKEN = "Bot_token"
 WOLFRAM_APPID = "6JP9U2AAW4"
 QALCULATE_PATH = "/data/data/com.termux/files/usr/bin/qalc"
+CALC_IDLE_SECONDS = 600  # unfinished .Calc input (and its Stream's worker thread) is dropped after this long
 
 # --- INTENTS / BOT Setup ---
 intents = discord.Intents.all()
 bot = commands.Bot(command_prefix="!", intents=intents)
 tree = bot.tree
 user_inputs = defaultdict(list)
+user_streams = {}  # uid -> Advikmathlib.Stream evaluating the .Calc input as it arrives
+calc_last_seen = {}  # uid -> time.monotonic() of the latest .Calc input
 active_games = {}
 
+def add_calc_input(uid, text):
+    """Record a piece of .Calc input and pass it on to the user's native Stream, which evaluates finished
+    subexpressions in the background. Input that may still turn into a sympy/tower query is held back."""
+    user_inputs[uid].append(text)
+    calc_last_seen[uid] = time.monotonic()
+    if Advikmathlib is None:
+        return
+    if uid not in user_streams:
+        head = "".join(user_inputs[uid]).lower()
+        if any(head.startswith(p) or p.startswith(head) for p in ("sympy", "tower")):
+            return
+        user_streams[uid] = Advikmathlib.Stream(client=f"discord:{uid}")
+        text = "".join(user_inputs[uid])
+    user_streams[uid].append(text)
+
+async def drop_stream(uid):
+    """Forget uid's Stream. Closing it cancels the evaluation its worker may be in the middle of; that runs in
+    a thread, so the event loop never waits for the worker to notice."""
+    stream = user_streams.pop(uid, None)
+    if stream is not None:
+        await asyncio.to_thread(stream.close)
+
+async def expire_idle_calcs():
+    """Forget .Calc input that never got its Evaluate, so abandoned Streams don't keep their threads."""
+    now = time.monotonic()
+    for uid in [u for u, t in calc_last_seen.items() if now - t > CALC_IDLE_SECONDS]:
+        del calc_last_seen[uid]
+        user_inputs.pop(uid, None)
+        await drop_stream(uid)
+
 # --- Chess board render ---
 def render_text_board(board):
     unicode_pieces = {
@@ -393,37 +428,51 @@ async def on_message(message):
 
     uid = message.author.id
     content = message.content.strip()
+    await expire_idle_calcs()
 
     # Step 1: Catch both .Calc and regular multi-line user input
     if content.startswith(".Calc "):
-        user_inputs[uid] = [content[6:]]
+        user_inputs[uid] = []
+        await drop_stream(uid)
+        add_calc_input(uid, content[6:])
         await message.channel.send("📝 Send more or type `Evaluate`")
         return
 
     # Both Multi-Line Mode and Normal Input Mode
     if uid in user_inputs:
         if content.lower() == "evaluate":
-            expr = "".join(user_inputs[uid])
-            del user_inputs[uid]
+            expr = "".join(user_inputs.pop(uid))
+            stream = user_streams.pop(uid, None)
+            calc_last_seen.pop(uid, None)
             # SYMPY/CUSTOM EXECUTION
             if expr.lower().startswith("sympy"):
                 expr_to_eval = expr[len("sympy"):].strip()
                 try:
-                    result = str(sympy.sympify(expr_to_eval))
+                    result = await asyncio.to_thread(
+                        lambda: native_sympy(expr_to_eval, f"discord:{uid}") or str(sympy.sympify(expr_to_eval)))
                 except Exception as e:
                     result = f"SymPy Error: {e}"
             elif expr.lower().startswith("tower"):
                 to_eval = expr[len("tower"):].strip()
-                proc = subprocess.run(["./superqalc_tower"], input=to_eval.encode(), capture_output=True)
+                proc = await asyncio.to_thread(subprocess.run, ["./superqalc_tower"], input=to_eval.encode(), capture_output=True)
                 result = proc.stdout.decode() if proc.returncode == 0 else "Error running superqalc."
+            # The native engine runs in a worker thread so a long evaluation doesn't stall other users. It shares
+            # the bot's process, though: a GMP allocation failure aborts it, where the subprocess fallback below
+            # only loses one answer. The per-client quota's max_request_bytes is what keeps requests under that.
+            elif stream is not None:
+                # most of it was evaluated while the messages came in
+                result = await asyncio.to_thread(stream.evaluate)
+            elif Advikmathlib is not None:
+                # in-process, under this user's CPU and request quota
+                result = await asyncio.to_thread(Advikmathlib.calc, expr, client=f"discord:{uid}")
             else:
-                proc = subprocess.run(["./superqalc_onefile"], input=expr.encode(), capture_output=True)
+                proc = await asyncio.to_thread(subprocess.run, ["./superqalc_onefile"], input=expr.encode(), capture_output=True)
                 result = proc.stdout.decode() if proc.returncode == 0 else "Error running superqalc."
             # Split and send if > 2000 chars
             for chunk_start in range(0, len(result), 2000):
                 await message.channel.send(result[chunk_start:chunk_start + 2000])
         else:
-            user_inputs[uid].append(content)
+            add_calc_input(uid, content)
         return
 
     # Simple quick one-liners
@@ -0,0 +1,474 @@
+// superqalc_batch.cpp
+// Batch evaluation of an expression file (one onefile expression per line), on this machine or sharded
+// across worker hosts. Output has one result line per input line, in input order (see evaluate_batch).
+//
+// Local: the multi-threaded batch evaluator over the whole file.
+// Coordinator (--workers): the file is cut into contiguous shards of --shard-size lines, numbered in file
+// order, so the partition depends only on the input. Each worker connection takes the next pending shard,
+// and results are written as soon as all earlier shards are in. A shard whose worker fails (connection
+// lost, protocol error, no answer within --shard-timeout) goes back to the queue for another worker, up to
+// --retries times; a worker that cannot be reached --retries times in a row is dropped.
+// Worker (--worker): serves shards over TCP, each evaluated with the batch evaluator on --threads threads,
+// using the evaluation flags the coordinator sends. The protocol has no authentication: a bare PORT listens
+// on 127.0.0.1 only, and serving other hosts takes an explicit address such as 0.0.0.0:PORT. Shards above
+// MAX_SHARD_LINES lines and lines above MAX_LINE_BYTES bytes are refused.
+//
+// Protocol (text lines): coordinator "SQBATCH 1 <flags>", worker "OK"; then per shard "SHARD <id> <n>" and
+// n expressions, answered by "DONE <id> <n>" and n results.
+// Build: g++ -O2 -std=c++17 -pthread superqalc_batch.cpp -o superqalc_batch -lmpfr -lgmp
+//
+// Usage: superqalc_batch FILE [--workers=HOST:PORT,...] [--shard-size=N] [--retries=N] [--shard-timeout=S]
+//                             [--out=FILE] [--threads=N] [evaluation flags]
+//        superqalc_batch --worker=[HOST:]PORT [--threads=N]
+// Evaluation flags: --si --max-digits=N --precision=bits --decimal=N --round=MODE --timeout=seconds (per line)
+
+#define SUPERQALC_NO_MAIN
+#include "superqalc_onefile.cpp"
+
+#include <condition_variable>
+#include <csignal>
+#include <fstream>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+// ----------------- Batch evaluation -----------------
+// Many independent expressions on a pool of threads that each take the next unclaimed line, since costs
+// differ by orders of magnitude between lines. Results come back in input order, one line each: the result
+// as the CLI prints it, "≈ approximation" after an overflow, or the error. Empty lines stay empty.
+// timeout_s > 0 bounds every expression separately.
+static string batch_line(const string &expr, const EvalConfig &cfg) {
+    if (trim(expr).empty()) return "";
+    string out;
+    try {
+        auto r = eval_rpn(shunting_yard(tokenize(expr)), cfg);
+        out = r.first ? "≈ " + r.second : r.second;
+    } catch (const exception &e) {
+        out = string("Error: ") + e.what();
+    }
+    replace(out.begin(), out.end(), '\n', ' ');
+    return out;
+}
+
+static vector<string> evaluate_batch(const vector<string> &exprs, const EvalConfig &cfg, unsigned threads = 0, double timeout_s = -1) {
+    vector<string> out(exprs.size());
+    atomic<size_t> next{0};
+    auto work = [&] {
+        EvalConfig c = cfg;
+        for (size_t i; (i = next++) < exprs.size();) {
+            if (timeout_s > 0) c.deadline = chrono::steady_clock::now() + chrono::microseconds((long long)(timeout_s * 1e6));
+            out[i] = batch_line(exprs[i], c);
+        }
+    };
+    unsigned t = (unsigned)min<size_t>(threads ? threads : worker_threads(), exprs.size());
+    if (t <= 1) { work(); return out; }
+    vector<thread> workers;
+    for (unsigned k = 0; k < t; ++k) workers.emplace_back(work);
+    for (auto &w : workers) w.join();
+    return out;
+}
+
+// ----------------- Options -----------------
+static const size_t MAX_SHARD_LINES = 1000000;      // per SHARD header, and the largest --shard-size
+static const size_t MAX_LINE_BYTES = 16 << 20;      // one protocol line (an expression or a result)
+
+struct BatchOptions {
+    EvalConfig cfg;
+    double timeout_s = -1;       // per expression
+    unsigned threads = 0;        // 0: worker_threads()
+    vector<string> eval_flags;   // as given, forwarded to workers
+};
+
+// Evaluation flags shared by all modes; false if a is not one
+static bool parse_eval_flag(const string &a, BatchOptions &o) {
+    if (a.rfind("--max-digits=", 0) == 0) {
+        o.cfg.max_digits = safe_stold(a.substr(13));
+    } else if (a.rfind("--precision=", 0) == 0) {
+        o.cfg.mpfr_prec = stoi(a.substr(12));
+        if (o.cfg.mpfr_prec < MPFR_PREC_MIN || o.cfg.mpfr_prec > MAX_MPFR_PREC)
+            throw runtime_error("--precision must be between " + to_string(MPFR_PREC_MIN) + " and " + to_string(MAX_MPFR_PREC) + " bits");
+    } else if (a.rfind("--decimal=", 0) == 0) {
+        o.cfg.decimal_digits = stoi(a.substr(10));
+        if (o.cfg.decimal_digits < 0) throw runtime_error("--decimal needs a digit count");
+    } else if (a.rfind("--round=", 0) == 0) {
+        static const map<string, DecimalRounding> modes = {
+            {"half-even", DR_HALF_EVEN}, {"half-up", DR_HALF_UP}, {"down", DR_DOWN},
+            {"up", DR_UP}, {"floor", DR_FLOOR}, {"ceiling", DR_CEILING} };
+        auto it = modes.find(a.substr(8));
+        if (it == modes.end()) throw runtime_error("unknown rounding mode " + a.substr(8));
+        o.cfg.decimal_rounding = it->second;
+    } else if (a.rfind("--timeout=", 0) == 0) {
+        o.timeout_s = stod(a.substr(10));
+    } else if (a == "--si") {
+        o.cfg.prefer_si = true;
+    } else {
+        return false;
+    }
+    o.eval_flags.push_back(a);
+    return true;
+}
+
+// ----------------- Line-oriented sockets -----------------
+class Connection {
+public:
+    explicit Connection(int fd = -1) : fd_(fd) {}
+    Connection(const Connection &) = delete;
+    Connection &operator=(const Connection &) = delete;
+    ~Connection() { if (fd_ >= 0) close(fd_); }
+    bool ok() const { return fd_ >= 0; }
+
+    bool write_all(const string &s) {
+        for (size_t off = 0; off < s.size();) {
+            ssize_t n = send(fd_, s.data() + off, s.size() - off, MSG_NOSIGNAL);
+            if (n <= 0) return false;
+            off += (size_t)n;
+        }
+        return true;
+    }
+    // next line without its '\n' (and '\r'); false on EOF, error, receive timeout or a line over MAX_LINE_BYTES
+    bool read_line(string &line) {
+        for (;;) {
+            size_t nl = buf_.find('\n', pos_);
+            if (nl != string::npos) {
+                line.assign(buf_, pos_, nl - pos_);
+                pos_ = nl + 1;
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                return true;
+            }
+            buf_.erase(0, pos_);
+            pos_ = 0;
+            if (buf_.size() > MAX_LINE_BYTES) return false;
+            char chunk[1 << 16];
+            ssize_t n = recv(fd_, chunk, sizeof(chunk), 0);
+            if (n <= 0) return false;
+            buf_.append(chunk, (size_t)n);
+        }
+    }
+
+private:
+    int fd_;
+    string buf_;
+    size_t pos_ = 0;
+};
+
+static bool split_host_port(const string &addr, string &host, string &port) {
+    size_t colon = addr.rfind(':');
+    if (colon == string::npos) { host.clear(); port = addr; }
+    else { host = addr.substr(0, colon); port = addr.substr(colon + 1); }
+    return !port.empty();
+}
+
+static int connect_to(const string &addr, double timeout_s) {
+    string host, port;
+    if (!split_host_port(addr, host, port) || host.empty()) return -1;
+    addrinfo hints{}, *res = nullptr;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0) return -1;
+    int fd = -1;
+    for (addrinfo *p = res; p && fd < 0; p = p->ai_next) {
+        fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, p->ai_addr, p->ai_addrlen) != 0) { close(fd); fd = -1; }
+    }
+    freeaddrinfo(res);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (timeout_s > 0) {
+        timeval tv;
+        tv.tv_sec = (time_t)timeout_s;
+        tv.tv_usec = (suseconds_t)((timeout_s - (double)tv.tv_sec) * 1e6);
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    }
+    return fd;
+}
+
+static int listen_on(const string &addr) {
+    string host, port;
+    if (!split_host_port(addr, host, port)) return -1;
+    addrinfo hints{}, *res = nullptr;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    // no authentication: other hosts only when an address is given
+    if (getaddrinfo(host.empty() ? "127.0.0.1" : host.c_str(), port.c_str(), &hints, &res) != 0) return -1;
+    int fd = -1;
+    for (addrinfo *p = res; p && fd < 0; p = p->ai_next) {
+        fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+        if (fd < 0) continue;
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (::bind(fd, p->ai_addr, p->ai_addrlen) != 0 || listen(fd, 64) != 0) { close(fd); fd = -1; }
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+static bool parse_header(const string &line, const char *word, size_t &id, size_t &n) {
+    istringstream ss(line);
+    string w;
+    return (ss >> w >> id >> n) && w == word;
+}
+
+// ----------------- Worker -----------------
+static void serve_connection(int fd, unsigned threads) {
+    Connection c(fd);
+    string line;
+    if (!c.read_line(line)) return;
+    istringstream hello(line);
+    string magic, version, flag;
+    BatchOptions o;
+    o.threads = threads;
+    hello >> magic >> version;
+    try {
+        if (magic != "SQBATCH" || version != "1") throw runtime_error("expected SQBATCH 1");
+        while (hello >> flag) if (!parse_eval_flag(flag, o)) throw runtime_error("unknown flag " + flag);
+    } catch (const exception &e) {
+        c.write_all(string("ERR ") + e.what() + "\n");
+        return;
+    }
+    if (!c.write_all("OK\n")) return;
+    size_t id, n;
+    while (c.read_line(line)) {
+        if (!parse_header(line, "SHARD", id, n)) { c.write_all("ERR expected SHARD <id> <n>\n"); return; }
+        if (n > MAX_SHARD_LINES) { c.write_all("ERR shard over " + to_string(MAX_SHARD_LINES) + " lines\n"); return; }
+        vector<string> exprs;
+        while (exprs.size() < n && c.read_line(line)) exprs.push_back(line);
+        if (exprs.size() < n) return;
+        vector<string> results = evaluate_batch(exprs, o.cfg, o.threads, o.timeout_s);
+        string reply = "DONE " + to_string(id) + " " + to_string(n) + "\n";
+        for (auto &r : results) reply += r + "\n";
+        if (!c.write_all(reply)) return;
+    }
+}
+
+static int run_worker(const string &addr, unsigned threads) {
+    int lfd = listen_on(addr);
+    if (lfd < 0) { cerr << "Cannot listen on " << addr << "\n"; return 1; }
+    cerr << "superqalc_batch worker listening on " << addr << "\n";
+    for (;;) {
+        int fd = accept(lfd, nullptr, nullptr);
+        if (fd < 0) continue;
+        thread([fd, threads] {
+            try {
+                serve_connection(fd, threads);
+            } catch (const exception &e) {
+                cerr << "Worker connection failed: " << e.what() << "\n"; // the Connection closed fd
+            }
+        }).detach();
+    }
+}
+
+// ----------------- Coordinator -----------------
+struct Shard {
+    size_t begin, end;          // input lines [begin, end)
+    int failures = 0;
+    bool done = false;
+    vector<string> results;
+};
+
+class Coordinator {
+public:
+    Coordinator(const vector<string> &lines, const vector<string> &workers, const BatchOptions &o, size_t shard_size,
+                int retries, double shard_timeout_s)
+        : lines_(lines), workers_(workers), opts_(o), retries_(retries), timeout_s_(shard_timeout_s) {
+        for (size_t b = 0; b < lines.size(); b += shard_size) {
+            shards_.push_back({b, min(lines.size(), b + shard_size)});
+            pending_.push_back(shards_.size() - 1);
+        }
+        remaining_ = shards_.size();
+    }
+
+    // Results in input order to out; false (with a message on stderr) if some shard could not be evaluated
+    bool run(ostream &out) {
+        vector<thread> threads;
+        live_ = workers_.size();
+        for (const string &w : workers_) threads.emplace_back([this, w] { drive(w); });
+        bool ok = true;
+        {
+            unique_lock<mutex> lk(mu_);
+            for (size_t next = 0; next < shards_.size();) {
+                cv_.wait(lk, [&] { return shards_[next].done || failed_ || live_ == 0; });
+                if (!shards_[next].done) { ok = false; break; }
+                for (; next < shards_.size() && shards_[next].done; ++next) {
+                    for (const string &r : shards_[next].results) out << r << "\n";
+                    vector<string>().swap(shards_[next].results);
+                }
+            }
+            if (!ok) {
+                if (!failed_) error_ = "no workers left";
+                failed_ = true;
+                cv_.notify_all();
+            }
+        }
+        out.flush();
+        for (auto &t : threads) t.join();
+        if (!ok) cerr << "Batch failed: " << error_ << "\n";
+        return ok;
+    }
+
+private:
+    const vector<string> &lines_;
+    vector<string> workers_;
+    BatchOptions opts_;
+    int retries_;
+    double timeout_s_;
+    vector<Shard> shards_;
+    deque<size_t> pending_;
+    size_t remaining_ = 0, live_ = 0;
+    bool failed_ = false;
+    string error_;
+    mutex mu_;
+    condition_variable cv_;
+
+    bool finished() {
+        lock_guard<mutex> g(mu_);
+        return remaining_ == 0 || failed_;
+    }
+
+    bool take(size_t &id) {
+        unique_lock<mutex> lk(mu_);
+        cv_.wait(lk, [&] { return !pending_.empty() || remaining_ == 0 || failed_; });
+        if (pending_.empty() || failed_) return false;
+        id = pending_.front();
+        pending_.pop_front();
+        return true;
+    }
+
+    void give_back(size_t id, const string &worker) {
+        lock_guard<mutex> g(mu_);
+        Shard &s = shards_[id];
+        if (++s.failures > retries_) {
+            failed_ = true;
+            error_ = "shard " + to_string(id) + " (lines " + to_string(s.begin + 1) + "-" + to_string(s.end) + ") failed " +
+                     to_string(s.failures) + " times, last on " + worker;
+        } else {
+            pending_.push_front(id);
+        }
+        cv_.notify_all();
+    }
+
+    void complete(size_t id, vector<string> &&results) {
+        lock_guard<mutex> g(mu_);
+        shards_[id].results = move(results);
+        shards_[id].done = true;
+        --remaining_;
+        cv_.notify_all();
+    }
+
+    bool handshake(Connection &c) {
+        string hello = "SQBATCH 1", reply;
+        for (const string &f : opts_.eval_flags) hello += " " + f;
+        return c.write_all(hello + "\n") && c.read_line(reply) && reply == "OK";
+    }
+
+    bool run_shard(Connection &c, size_t id, vector<string> &results) {
+        const Shard &s = shards_[id]; // begin/end never change
+        string msg = "SHARD " + to_string(id) + " " + to_string(s.end - s.begin) + "\n";
+        for (size_t i = s.begin; i < s.end; ++i) msg += lines_[i] + "\n";
+        string line;
+        size_t rid, n;
+        if (!c.write_all(msg) || !c.read_line(line) || !parse_header(line, "DONE", rid, n) || rid != id || n != s.end - s.begin)
+            return false;
+        results.resize(n);
+        for (auto &r : results) if (!c.read_line(r)) return false;
+        return true;
+    }
+
+    // One connection to worker at a time; reconnect after a failure, give up after retries_ in a row
+    void drive(const string &worker) {
+        int failures = 0;
+        for (bool more = true; more && failures <= retries_ && !finished();) {
+            if (failures) this_thread::sleep_for(chrono::milliseconds(200 << min(failures, 5)));
+            Connection c(connect_to(worker, timeout_s_));
+            if (!c.ok() || !handshake(c)) { ++failures; continue; }
+            size_t id;
+            more = false;
+            while (take(id)) {
+                vector<string> results;
+                if (!run_shard(c, id, results)) { give_back(id, worker); ++failures; more = true; break; }
+                complete(id, move(results));
+                failures = 0;
+            }
+        }
+        if (failures > retries_) cerr << "Dropping worker " << worker << "\n";
+        lock_guard<mutex> g(mu_);
+        --live_;
+        cv_.notify_all();
+    }
+};
+
+// ----------------- Main -----------------
+static void print_usage_and_exit(const char *prog) {
+    cerr << "Usage: " << prog << " FILE [--workers=HOST:PORT,...] [--shard-size=N] [--retries=N] [--shard-timeout=seconds]\n"
+         << "                      [--out=FILE] [--threads=N] [--si] [--max-digits=N] [--precision=bits] [--decimal=N]\n"
+         << "                      [--round=MODE] [--timeout=seconds]\n"
+         << "       " << prog << " --worker=[HOST:]PORT [--threads=N]\n";
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    signal(SIGPIPE, SIG_IGN);
+    BatchOptions o;
+    string file, out_file, worker_addr;
+    vector<string> workers;
+    size_t shard_size = 1000;
+    int retries = 3;
+    double shard_timeout_s = 600;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            string a = argv[i];
+            if (parse_eval_flag(a, o)) continue;
+            if (a.rfind("--workers=", 0) == 0) {
+                string list = a.substr(10), w;
+                istringstream ss(list);
+                while (getline(ss, w, ',')) if (!w.empty()) workers.push_back(w);
+            } else if (a.rfind("--worker=", 0) == 0) {
+                worker_addr = a.substr(9);
+            } else if (a.rfind("--shard-size=", 0) == 0) {
+                shard_size = min(MAX_SHARD_LINES, max<size_t>(1, stoul(a.substr(13))));
+            } else if (a.rfind("--retries=", 0) == 0) {
+                retries = stoi(a.substr(10));
+            } else if (a.rfind("--shard-timeout=", 0) == 0) {
+                shard_timeout_s = stod(a.substr(16));
+            } else if (a.rfind("--threads=", 0) == 0) {
+                o.threads = (unsigned)stoul(a.substr(10));
+            } else if (a.rfind("--out=", 0) == 0) {
+                out_file = a.substr(6);
+            } else if (a.rfind("--", 0) == 0 || !file.empty()) {
+                print_usage_and_exit(argv[0]);
+            } else {
+                file = a;
+            }
+        }
+    } catch (const exception &e) {
+        cerr << "Bad flag: " << e.what() << "\n";
+        return 1;
+    }
+    if (!worker_addr.empty()) return run_worker(worker_addr, o.threads);
+    if (file.empty()) print_usage_and_exit(argv[0]);
+
+    ifstream in(file);
+    if (!in) { cerr << "Cannot read " << file << "\n"; return 1; }
+    vector<string> lines;
+    for (string line; getline(in, line);) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        lines.push_back(line);
+    }
+    ofstream fout;
+    if (!out_file.empty()) {
+        fout.open(out_file);
+        if (!fout) { cerr << "Cannot write " << out_file << "\n"; return 1; }
+    }
+    ostream &out = out_file.empty() ? cout : fout;
+
+    if (!workers.empty()) return Coordinator(lines, workers, o, shard_size, retries, shard_timeout_s).run(out) ? 0 : 1;
+    // local: shard by shard so output streams
+    for (size_t b = 0; b < lines.size(); b += shard_size) {
+        vector<string> shard(lines.begin() + b, lines.begin() + min(lines.size(), b + shard_size));
+        for (const string &r : evaluate_batch(shard, o.cfg, o.threads, o.timeout_s)) out << r << "\n";
+    }
+    return 0;
+}
@@ -2,7 +2,7 @@
 // superqalc_onefile.cpp
 // Single-file super calculator with units, GMP/MPFR big-numbers, overflow safe exponentiation,
 // 'to' operator for unit conversion, smart unit printing, and CLI flags.
-// Build: g++ -O2 superqalc_onefile.cpp -o superqalc -lgmp -lmpfr -std=c++17
+// Build: g++ -O2 superqalc_onefile.cpp -o superqalc -lgmp -lmpfr -std=c++17 -pthread
 //
 // Author: assistant demo
 // Date: 2025-08-10
@@ -10,11 +10,30 @@
 #include <iostream>
 #include <string>
 #include <map>
+#include <set>
+#include <algorithm>
+#include <functional>
+#include <numeric>
+#include <unordered_map>
+#include <memory>
+#include <cstring>
+#include <cstdint>
+#include <climits>
 #include <sstream>
 #include <vector>
 #include <cmath>
+#include <cfloat>
+#include <complex>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <chrono>
 #include <gmp.h>
 #include <mpfr.h>
+#include <ctime>
 #include <unistd.h>
 #include <sys/select.h>
 
@@ -23,6 +42,10 @@ using namespace std;
 // ----------------- Configuration -----------------
 static const long double DEFAULT_MAX_DIGITS = 1e6L; // if estimated digits > this -> approximate
 static const int DEFAULT_MPFR_PREC = 256; // bits for mpfr
+static const int MAX_MPFR_PREC = 1 << 24; // largest --precision, and the largest precision a blob may carry
+static const unsigned long DEFAULT_REPEAT_DIGITS = 1000; // fractional digits of a repeating decimal
+static const long double DIGIT_ARG_SCALE = 100; // digitsum() & co. take exact arguments this many times max_digits long
+static const string IMAGINARY_UNIT = "i"; // name of sqrt(-1), also as a literal suffix ("2i")
 static const int CLI_ABORT_POLL_MS = 120; // ms polling while "Processing"
 
 // ----------------- Utilities -----------------
@@ -33,20 +56,146 @@ static string trim(const string &s) {
     return s.substr(a, b - a);
 }
 
-static bool enter_pressed_nonblocking() {
-    fd_set set; FD_ZERO(&set); FD_SET(0, &set);
-    struct timeval tv; tv.tv_sec = 0; tv.tv_usec = 0;
-    int rv = select(1, &set, NULL, NULL, &tv);
-    if (rv > 0) {
-        char buf[2] = {0}; ssize_t n = read(0, buf, 1);
-        if (n > 0 && (buf[0] == '\n' || buf[0] == '\r')) return true;
+// safe string to long double (unused by programs that only include the engine)
+[[maybe_unused]] static long double safe_stold(const string &s) {
+    try { return stold(s); } catch(...) { return 0.0L; }
+}
+
+// ----------------- Big decimal literal parsing -----------------
+// Pasted literals can run to tens of millions of digits. Instead of one single-threaded mpz_set_str, the
+// digit string is split into a balanced tree: leaves of PARSE_LEAF_DIGITS digits are validated and converted
+// directly, inner nodes recombine as hi * 10^(leaf*2^j) + lo using a shared cache of those powers, and the
+// top levels of the tree run on separate threads.
+static const size_t PARSE_LEAF_DIGITS = 8192;
+static const size_t PARALLEL_PARSE_MIN_DIGITS = 100000; // below this plain mpz_set_str is faster
+
+// POW10_CACHE[j] = 10^(PARSE_LEAF_DIGITS * 2^j); deque so references stay valid while it grows
+static deque<__mpz_struct> POW10_CACHE;
+static mutex POW10_MUTEX;
+
+static mpz_srcptr pow10_leaf_level(int j) {
+    lock_guard<mutex> lk(POW10_MUTEX);
+    while ((int)POW10_CACHE.size() <= j) {
+        POW10_CACHE.emplace_back();
+        mpz_ptr p = &POW10_CACHE.back();
+        mpz_init(p);
+        if (POW10_CACHE.size() == 1) mpz_ui_pow_ui(p, 10, PARSE_LEAF_DIGITS);
+        else mpz_mul(p, &POW10_CACHE[POW10_CACHE.size() - 2], &POW10_CACHE[POW10_CACHE.size() - 2]);
     }
-    return false;
+    return &POW10_CACHE[j];
 }
 
-// safe string to long double
-static long double safe_stold(const string &s) {
-    try { return stold(s); } catch(...) { return 0.0L; }
+// validate + convert one leaf in a single pass over its digits
+static bool parse_digit_leaf(mpz_t out, const char *s, size_t len) {
+    string buf(s, len);
+    for (char c : buf) if (c < '0' || c > '9') return false;
+    return mpz_set_str(out, buf.c_str(), 10) == 0;
+}
+
+// s[0..len) with len <= PARSE_LEAF_DIGITS * 2^level; 'threads' bounds the fan-out below this node
+static bool parse_digits_rec(mpz_t out, const char *s, size_t len, int level, unsigned threads) {
+    if (level == 0) return parse_digit_leaf(out, s, len);
+    size_t lo_len = PARSE_LEAF_DIGITS << (level - 1);
+    if (len <= lo_len) return parse_digits_rec(out, s, len, level - 1, threads);
+    size_t hi_len = len - lo_len;
+    mpz_srcptr scale = pow10_leaf_level(level - 1);
+    mpz_t lo; mpz_init(lo);
+    bool ok_hi = true, ok_lo = true;
+    if (threads > 1) {
+        unsigned th = threads / 2;
+        thread worker([&]() { ok_hi = parse_digits_rec(out, s, hi_len, level - 1, th); });
+        ok_lo = parse_digits_rec(lo, s + hi_len, lo_len, level - 1, threads - th);
+        worker.join();
+    } else {
+        ok_hi = parse_digits_rec(out, s, hi_len, level - 1, 1);
+        ok_lo = ok_hi && parse_digits_rec(lo, s + hi_len, lo_len, level - 1, 1);
+    }
+    if (ok_hi && ok_lo) {
+        mpz_mul(out, out, scale);
+        mpz_add(out, out, lo);
+    }
+    mpz_clear(lo);
+    return ok_hi && ok_lo;
+}
+
+// Parse an unsigned decimal integer; returns false (out unspecified) if any character is not a digit.
+static bool parse_decimal_integer(mpz_t out, const string &digits) {
+    if (digits.empty()) return false;
+    if (digits.size() < PARALLEL_PARSE_MIN_DIGITS) return parse_digit_leaf(out, digits.data(), digits.size());
+    int level = 0;
+    while ((PARSE_LEAF_DIGITS << level) < digits.size()) ++level;
+    unsigned threads = max(1u, thread::hardware_concurrency());
+    return parse_digits_rec(out, digits.data(), digits.size(), level, threads);
+}
+
+// Parse a decimal literal "123.4500e-2" exactly as out / 10^scale. Returns false if s is not of the form
+// digits[.digits][(e|E)[+-]digits].
+static bool parse_exact_decimal(const string &s, mpz_t out, unsigned long &scale) {
+    size_t epos = s.find_first_of("eE");
+    string mant = s.substr(0, epos);
+    long exp10 = 0;
+    if (epos != string::npos) {
+        string e = s.substr(epos + 1);
+        size_t k = (!e.empty() && (e[0] == '+' || e[0] == '-')) ? 1 : 0;
+        if (k == e.size() || e.size() - k > 9) return false;
+        for (size_t j = k; j < e.size(); ++j) if (!isdigit((unsigned char)e[j])) return false;
+        exp10 = stol(e);
+    }
+    size_t dot = mant.find('.');
+    long frac = 0;
+    if (dot != string::npos) {
+        frac = (long)(mant.size() - dot - 1);
+        mant.erase(dot, 1);
+    }
+    if (!parse_decimal_integer(out, mant)) return false;
+    long sc = frac - exp10;
+    if (sc < 0) {
+        mpz_t p; mpz_init(p);
+        mpz_ui_pow_ui(p, 10, (unsigned long)-sc);
+        mpz_mul(out, out, p);
+        mpz_clear(p);
+        sc = 0;
+    }
+    scale = (unsigned long)sc;
+    return true;
+}
+
+// Exact decimal text of v / 10^scale
+static string decimal_string(mpz_srcptr v, unsigned long scale) {
+    char *s = mpz_get_str(NULL, 10, v);
+    string digits(s); free(s);
+    bool neg = !digits.empty() && digits[0] == '-';
+    if (neg) digits.erase(0, 1);
+    if (scale > 0) {
+        if (digits.size() <= scale) digits.insert(0, scale + 1 - digits.size(), '0');
+        digits.insert(digits.size() - scale, ".");
+    }
+    return neg ? "-" + digits : digits;
+}
+
+// q = v / 10^scale
+static void decimal_to_q(mpq_t q, mpz_srcptr v, unsigned long scale) {
+    mpz_set(mpq_numref(q), v);
+    mpz_ui_pow_ui(mpq_denref(q), 10, scale);
+    mpq_canonicalize(q);
+}
+
+// Exact decimal text of q when its denominator is 2^a 5^b (the expansion terminates); false otherwise
+static bool terminating_decimal(mpq_srcptr q, string &out) {
+    mpz_t d, p; mpz_init_set(d, mpq_denref(q)); mpz_init_set_ui(p, 2);
+    unsigned long twos = mpz_remove(d, d, p);
+    mpz_set_ui(p, 5);
+    unsigned long fives = mpz_remove(d, d, p);
+    bool ok = mpz_cmp_ui(d, 1) == 0;
+    if (ok) {
+        unsigned long scale = max(twos, fives);
+        mpz_ui_pow_ui(p, 10, scale);
+        mpz_divexact(p, p, mpq_denref(q));
+        mpz_mul(p, p, mpq_numref(q));
+        out = decimal_string(p, scale);
+    }
+    mpz_clear(d); mpz_clear(p);
+    return ok;
 }
 
 // ----------------- Dimension & Unit System -----------------
@@ -72,8 +221,32 @@ struct Unit {
     string name;
     mpfr_t factor; // multiplicative factor to convert a numeric value in this unit to SI base numeric (value * factor -> SI numeric)
     Dimension dim;
-    Unit(const string &n) : name(n) { mpfr_init2(factor, DEFAULT_MPFR_PREC); mpfr_set_d(factor, 1.0, MPFR_RNDN); }
-    ~Unit() { mpfr_clear(factor); }
+    bool exact = true;          // factor is exactly dec_i / 10^dec_scale (used by --decimal mode)
+    mpz_t dec_i;
+    unsigned long dec_scale = 0;
+    unsigned long pi_divisor = 0; // inexact units defined as pi / pi_divisor (rad-based angles, pi itself)
+    Unit(const string &n) : name(n) {
+        mpfr_init2(factor, DEFAULT_MPFR_PREC); mpfr_set_d(factor, 1.0, MPFR_RNDN);
+        mpz_init_set_ui(dec_i, 1);
+    }
+    ~Unit() { mpfr_clear(factor); mpz_clear(dec_i); }
+
+    // exact factor; only for exact units
+    void factor_q(mpq_t out) const { decimal_to_q(out, dec_i, dec_scale); }
+    // factor correctly rounded to out's precision (not just the registry's DEFAULT_MPFR_PREC bits)
+    void load_factor(mpfr_t out) const {
+        if (exact) {
+            mpq_t q; mpq_init(q);
+            factor_q(q);
+            mpfr_set_q(out, q, MPFR_RNDN);
+            mpq_clear(q);
+        } else if (pi_divisor) {
+            mpfr_const_pi(out, MPFR_RNDN);
+            mpfr_div_ui(out, out, pi_divisor, MPFR_RNDN);
+        } else {
+            mpfr_set(out, factor, MPFR_RNDN);
+        }
+    }
 };
 
 using UnitPtr = shared_ptr<Unit>;
@@ -83,9 +256,11 @@ struct UnitRegistry {
     vector<pair<string, Dimension>> baseNames; // mapping index -> name for pretty printing (L M T I Theta N J)
     UnitRegistry() { init_units(); }
 
-    void add_unit(const string &name, long double factor, const Dimension &dim) {
+    // factor is a decimal literal, kept exactly for --decimal mode and rounded once to MPFR precision
+    void add_unit(const string &name, const string &factor, const Dimension &dim) {
         UnitPtr u = make_shared<Unit>(name);
-        mpfr_set_d(u->factor, factor, MPFR_RNDN);
+        mpfr_set_str(u->factor, factor.c_str(), 10, MPFR_RNDN);
+        u->exact = parse_exact_decimal(factor, u->dec_i, u->dec_scale);
         u->dim = dim;
         table[name] = u;
     }
@@ -94,6 +269,16 @@ struct UnitRegistry {
         if (it == table.end()) return nullptr;
         return it->second;
     }
+    // lookup with prefix fallback: e.g. 'Mm' -> longest suffix that matches a unit ('m')
+    UnitPtr resolve(const string &name) const {
+        UnitPtr u = lookup(name);
+        if (u) return u;
+        for (size_t pos = 1; pos < name.size(); ++pos) {
+            UnitPtr u2 = lookup(name.substr(pos));
+            if (u2) return u2;
+        }
+        return nullptr;
+    }
     vector<UnitPtr> units_with_dim(const Dimension &d) const {
         vector<UnitPtr> out;
         for (auto &kv : table) if (kv.second->dim == d) out.push_back(kv.second);
@@ -113,67 +298,77 @@ struct UnitRegistry {
         baseNames[6].second.p[6] = 1;
 
         // Base SI
-        Dimension dL; dL.p[0] = 1; add_unit("m", 1.0L, dL);
-        Dimension dM; dM.p[1] = 1; add_unit("kg", 1.0L, dM);
-        Dimension dT; dT.p[2] = 1; add_unit("s", 1.0L, dT);
-        Dimension dI; dI.p[3] = 1; add_unit("A", 1.0L, dI);
-        Dimension dTh; dTh.p[4] = 1; add_unit("K", 1.0L, dTh);
-        Dimension dN; dN.p[5] = 1; add_unit("mol", 1.0L, dN);
-        Dimension dJ; dJ.p[6] = 1; add_unit("cd", 1.0L, dJ);
+        Dimension dL; dL.p[0] = 1; add_unit("m", "1", dL);
+        Dimension dM; dM.p[1] = 1; add_unit("kg", "1", dM);
+        Dimension dT; dT.p[2] = 1; add_unit("s", "1", dT);
+        Dimension dI; dI.p[3] = 1; add_unit("A", "1", dI);
+        Dimension dTh; dTh.p[4] = 1; add_unit("K", "1", dTh);
+        Dimension dN; dN.p[5] = 1; add_unit("mol", "1", dN);
+        Dimension dJ; dJ.p[6] = 1; add_unit("cd", "1", dJ);
 
         // dimensionless
-        Dimension d0; add_unit("", 1.0L, d0);
+        Dimension d0; add_unit("", "1", d0);
+        add_unit("%", "0.01", d0);
 
         // common prefixes for units (we add explicit prefixed names for convenience)
-        add_unit("cm", 0.01L, dL);
-        add_unit("mm", 0.001L, dL);
-        add_unit("km", 1000.0L, dL);
-        add_unit("um", 1e-6L, dL); // micrometer
-        add_unit("nm", 1e-9L, dL);
+        add_unit("cm", "0.01", dL);
+        add_unit("mm", "0.001", dL);
+        add_unit("km", "1000", dL);
+        add_unit("um", "1e-6", dL); // micrometer
+        add_unit("nm", "1e-9", dL);
 
         // time
-        add_unit("min", 60.0L, dT);
-        add_unit("h", 3600.0L, dT);
-        add_unit("day", 86400.0L, dT);
+        add_unit("min", "60", dT);
+        add_unit("h", "3600", dT);
+        add_unit("day", "86400", dT);
 
         // derived units with correct dimensions (Newton: kg*m/s^2)
         Dimension dNdim = dM + dL + dT.pow_int(-2);
-        add_unit("N", 1.0L, dNdim);
+        add_unit("N", "1", dNdim);
         Dimension Jdim = dNdim + dL; // N*m
-        add_unit("J", 1.0L, Jdim);
+        add_unit("J", "1", Jdim);
         Dimension Padim = dNdim + dL.pow_int(-2); // N/m^2
-        add_unit("Pa", 1.0L, Padim);
+        add_unit("Pa", "1", Padim);
         Dimension Wdim = Jdim + dT.pow_int(-1);
-        add_unit("W", 1.0L, Wdim);
+        add_unit("W", "1", Wdim);
         Dimension Hzdim = dT.pow_int(-1);
-        add_unit("Hz", 1.0L, Hzdim);
+        add_unit("Hz", "1", Hzdim);
 
         // energy units (common)
-        add_unit("eV", 1.602176634e-19L, Jdim);
+        add_unit("eV", "1.602176634e-19", Jdim);
 
         // pressure
-        add_unit("bar", 1e5L, Padim);
-        add_unit("atm", 101325.0L, Padim);
+        add_unit("bar", "1e5", Padim);
+        add_unit("atm", "101325", Padim);
 
         // length imperial
-        add_unit("in", 0.0254L, dL);
-        add_unit("ft", 0.3048L, dL);
-        add_unit("yd", 0.9144L, dL);
-        add_unit("mi", 1609.344L, dL);
+        add_unit("in", "0.0254", dL);
+        add_unit("ft", "0.3048", dL);
+        add_unit("yd", "0.9144", dL);
+        add_unit("mi", "1609.344", dL);
 
         // mass imperial
-        add_unit("lb", 0.45359237L, dM);
-        add_unit("oz", 0.028349523125L, dM);
+        add_unit("lb", "0.45359237", dM);
+        add_unit("oz", "0.028349523125", dM);
 
         // temperature: note Celsius conversion isn't multiplicative; using K-based only
-        add_unit("degC", 1.0L, dTh); // placeholder (interpretation requires offset handling; for now token only)
+        add_unit("degC", "1", dTh); // placeholder (interpretation requires offset handling; for now token only)
 
         // angle
-        Dimension ang; add_unit("rad", 1.0L, ang);
-        add_unit("deg", M_PI/180.0L, ang);
+        Dimension ang; add_unit("rad", "1", ang);
+        add_unit("deg", "1", ang);
+        UnitPtr deg = lookup("deg"); // pi/180 has no exact decimal form
+        deg->exact = false;
+        deg->pi_divisor = 180;
+        deg->load_factor(deg->factor);
+        add_unit("pi", "1", d0); // dimensionless constant: "2pi", "pi/4"
+        UnitPtr pi = lookup("pi");
+        pi->exact = false;
+        pi->pi_divisor = 1;
+        pi->load_factor(pi->factor);
 
         // others (convenience)
-        add_unit("L", 0.001L, dL.pow_int(3)); // liter = 1e-3 m^3
+        add_unit("L", "0.001", dL.pow_int(3)); // liter = 1e-3 m^3
     }
 
 } UNIT_REG;
@@ -182,18 +377,45 @@ struct UnitRegistry {
 struct BigValue {
     bool is_int;
     mpz_t i;   // valid if is_int
-    mpfr_t f;  // valid if !is_int
+    unsigned long z10 = 0; // is_int: value is i * 10^z10 (trailing decimal zeros kept symbolic, printed by zero-fill)
+    bool is_dec = false;   // --decimal mode: value is exactly i / 10^dec_scale
+    unsigned long dec_scale = 0;
+    mpfr_t f;  // valid if !is_int && !is_dec && !is_list
+    bool is_rat = false;   // exact quotient q (canonical; denominator > 1 unless the value has a dimension, such as
+    mpq_t q;               // the literal 100cm); f holds q rounded, so code that only knows the MPFR kind reads f unchanged
+    bool is_cplx = false;  // f + im i, both MPFR with the same dimension; im is allocated only for complex values
+    unique_ptr<__mpfr_struct> im;
     Dimension dim; // dimension expressed via the numeric value (SI scaled)
+    bool is_list = false;  // function results such as primes(a, b): the value is 'items' (shared elements)
+    vector<shared_ptr<const BigValue>> items;
     // Note: unit label (like "m" or "km") not stored here; we keep canonical numeric in SI and dimension.
 
     BigValue() {
         is_int = true;
         mpz_init(i); mpz_set_ui(i, 0);
         mpfr_init2(f, DEFAULT_MPFR_PREC); mpfr_set_d(f, 0.0, MPFR_RNDN);
+        mpq_init(q);
+    }
+    // deep copy; values are normally shared through ValuePtr instead
+    BigValue(const BigValue &o) : is_int(o.is_int), z10(o.z10), is_dec(o.is_dec), dec_scale(o.dec_scale), is_rat(o.is_rat), dim(o.dim), is_list(o.is_list), items(o.items) {
+        mpz_init_set(i, o.i);
+        mpfr_init2(f, mpfr_get_prec(o.f)); mpfr_set(f, o.f, MPFR_RNDN);
+        mpq_init(q); mpq_set(q, o.q);
+        if (o.is_cplx) { make_complex(mpfr_get_prec(o.im.get())); mpfr_set(im.get(), o.im.get(), MPFR_RNDN); }
     }
+    BigValue &operator=(const BigValue &) = delete;
     ~BigValue() {
         mpz_clear(i);
         mpfr_clear(f);
+        mpq_clear(q);
+        if (im) mpfr_clear(im.get());
+    }
+
+    // Switch to a complex value; the real part stays in f, the imaginary part is set to NaN at prec
+    void make_complex(mpfr_prec_t prec) {
+        if (im) mpfr_set_prec(im.get(), prec);
+        else { im.reset(new __mpfr_struct); mpfr_init2(im.get(), prec); }
+        is_int = false; z10 = 0; is_dec = false; is_rat = false; is_cplx = true;
     }
 
     void set_from_string_and_unit(const string &numstr, const string &unitname) {
@@ -203,8 +425,7 @@ struct BigValue {
         bool looks_float = (ns.find_first_of(".eE") != string::npos);
         if (!hasUnit && !looks_float) {
             is_int = true;
-            int rc = mpz_set_str(i, ns.c_str(), 10);
-            if (rc != 0) {
+            if (!parse_decimal_integer(i, ns)) {
                 // fallback to float if mpz parsing fails
                 is_int = false;
                 mpfr_set_str(f, ns.c_str(), 10, MPFR_RNDN);
@@ -215,41 +436,68 @@ struct BigValue {
         }
         // apply unit factor (if any) to convert numeric to SI
         if (hasUnit) {
-            UnitPtr u = UNIT_REG.lookup(unitname);
-            if (!u) {
-                // Try splitting prefixes: e.g., 'km' -> 'k' 'm' or metric prefixes map - but for now check simple prefixes
-                // We'll attempt a basic split: find longest suffix that matches a unit
-                UnitPtr found = nullptr;
-                for (size_t pos = 1; pos < unitname.size(); ++pos) {
-                    string suffix = unitname.substr(pos);
-                    auto u2 = UNIT_REG.lookup(suffix);
-                    if (u2) {
-                        found = u2;
-                        break;
-                    }
-                }
-                if (!found) {
-                    throw runtime_error("Unknown unit: " + unitname);
-                } else {
-                    u = found;
-                }
-            }
-            // Multiply value by u->factor
-            if (is_int) {
-                // convert i to f then multiply factor
-                mpfr_set_z(f, i, MPFR_RNDN);
-                mpfr_mul(f, f, u->factor, MPFR_RNDN);
-                is_int = false;
+            UnitPtr u = UNIT_REG.resolve(unitname);
+            if (!u) throw runtime_error("Unknown unit: " + unitname);
+            // Multiply value by the unit factor: an exact literal times an exact factor is kept as a rational (and
+            // rounded once into f), anything else multiplies in MPFR at the value's precision
+            mpz_t lit; mpz_init(lit);
+            unsigned long sc = 0;
+            if (u->exact && parse_exact_decimal(ns, lit, sc)) {
+                mpq_t q, fq; mpq_init(q); mpq_init(fq);
+                decimal_to_q(q, lit, sc);
+                u->factor_q(fq);
+                mpq_mul(q, q, fq);
+                mpfr_set_q(f, q, MPFR_RNDN);
+                mpq_swap(this->q, q);
+                is_rat = true;
+                mpq_clear(q); mpq_clear(fq);
             } else {
-                mpfr_mul(f, f, u->factor, MPFR_RNDN);
+                mpfr_t fac; mpfr_init2(fac, mpfr_get_prec(f));
+                u->load_factor(fac);
+                mpfr_mul(f, f, fac, MPFR_RNDN);
+                mpfr_clear(fac);
             }
+            mpz_clear(lit);
+            is_int = false;
             dim = u->dim;
+            if (is_rat && dim == Dimension() && mpz_cmp_ui(mpq_denref(q), 1) == 0) { // "100%": a plain integer
+                mpz_set(i, mpq_numref(q));
+                is_int = true; is_rat = false;
+            }
         } else {
             // no unit: dimensionless (dim already zero)
         }
     }
 
+    // --decimal mode: literal (and exact unit factor) kept as an exact scaled integer; anything that has no
+    // exact decimal form (e.g. deg) falls back to set_from_string_and_unit
+    void set_decimal_from_string_and_unit(const string &numstr, const string &unitname) {
+        UnitPtr u = nullptr;
+        if (!unitname.empty()) {
+            u = UNIT_REG.resolve(unitname);
+            if (!u) throw runtime_error("Unknown unit: " + unitname);
+        }
+        unsigned long sc = 0;
+        if ((u && !u->exact) || !parse_exact_decimal(trim(numstr), i, sc)) {
+            set_from_string_and_unit(numstr, unitname);
+            return;
+        }
+        if (u) {
+            mpz_mul(i, i, u->dec_i);
+            sc += u->dec_scale;
+            dim = u->dim;
+        }
+        is_int = false; z10 = 0;
+        is_dec = true; dec_scale = sc;
+    }
+
     string to_human(bool prefer_si=false) const {
+        if (is_list) {
+            string out = "[";
+            for (size_t k = 0; k < items.size(); ++k) out += (k ? ", " : "") + items[k]->to_human(prefer_si);
+            return out + "]";
+        }
+        if (is_cplx) return complex_to_human(prefer_si);
         // Prefer named unit whose factor gives a "nice" scaled numeric (0.1..1000) unless prefer_si is true
         long double approx = estimate_long_double();
         if (dim == Dimension()) {
@@ -257,7 +505,10 @@ struct BigValue {
             if (is_int) {
                 char *s = mpz_get_str(NULL, 10, i);
                 string out(s); free(s);
+                if (z10 && mpz_sgn(i) != 0) out.append(z10, '0');
                 return out;
+            } else if (is_dec) {
+                return decimal_string(i, dec_scale);
             } else {
                 char *s = nullptr;
                 mpfr_asprintf(&s, "%.12Rg", f);
@@ -267,31 +518,34 @@ struct BigValue {
         }
         // find candidates
         vector<UnitPtr> candidates = UNIT_REG.units_with_dim(dim);
-        // prefer exact match name (like 'm' for dimension length)
-        if (!prefer_si) {
+        // prefer exact match name (like 'm' for dimension length); exact decimals are handled by format_value
+        if (!prefer_si && !is_dec) {
             for (auto &u : candidates) {
                 long double fac = mpfr_get_d(u->factor, MPFR_RNDN);
                 if (fac == 0) continue;
                 long double scaled = approx / fac;
                 if (scaled >= 0.1L && scaled < 1000.0L) {
-                    // format scaled nicely
-                    ostringstream ss;
-                    // choose integer if near integer
-                    long double rounded = llround(scaled);
-                    if (fabsl(scaled - rounded) < 1e-12L) ss << (long long)rounded << " " << u->name;
-                    else {
-                        // show with up to 12 significant digits
-                        int sig = 12;
-                        ss << setprecision(sig) << scaled << " " << u->name;
-                    }
-                    return ss.str();
+                    // the range test only picks the unit; the digits come from an MPFR division by the factor
+                    // rounded to this value's precision. Up to 12 significant digits
+                    mpfr_t x, uf; mpfr_init2(x, mpfr_get_prec(f)); mpfr_init2(uf, mpfr_get_prec(f));
+                    if (is_int) mpfr_set_z(x, i, MPFR_RNDN); else mpfr_set(x, f, MPFR_RNDN);
+                    u->load_factor(uf);
+                    mpfr_div(x, x, uf, MPFR_RNDN);
+                    char *s = nullptr;
+                    mpfr_asprintf(&s, "%.12Rg", x);
+                    string out = string(s) + " " + u->name;
+                    mpfr_free_str(s);
+                    mpfr_clear(x); mpfr_clear(uf);
+                    return out;
                 }
             }
         }
         // fallback: print SI value with compound unit
         // Get SI numeric
         ostringstream ss;
-        if (is_int) {
+        if (is_dec) {
+            ss << decimal_string(i, dec_scale);
+        } else if (is_int) {
             // but numeric stored in mpz is integer only if dimensionless. If not, we printed above; here convert to double approx
             long double v = estimate_long_double();
             ss << setprecision(12) << v;
@@ -308,18 +562,12 @@ struct BigValue {
     }
 
     long double estimate_long_double() const {
-        if (is_int) {
+        if (is_int || is_dec) {
             if (mpz_sgn(i) == 0) return 0.0L;
-            // Use mpz_get_d gives double; may overflow to inf. To be robust, we extract first digits
-            char *s = mpz_get_str(NULL, 10, i);
-            string str(s); free(s);
-            size_t take = min<size_t>(18, str.size());
-            string lead = str.substr(0, take);
-            long double lead_val = safe_stold(lead);
-            long double frac = log10l(lead_val) - (long double)(take - 1);
-            long double approx = powl(10.0L, (long double)(str.size() - 1) + frac);
+            // mpz_get_d may overflow to inf; take mantissa and binary exponent separately (no decimal conversion)
+            long e2; double m = mpz_get_d_2exp(&e2, i);
             // this is an approximate magnitude; better than overflow
-            return approx;
+            return ldexpl((long double)m, e2) * powl(10.0L, is_int ? (long double)z10 : -(long double)dec_scale);
         } else {
             double d = mpfr_get_d(f, MPFR_RNDN);
             return (long double)d;
@@ -327,27 +575,79 @@ struct BigValue {
     }
 
     long double estimate_log10() const {
-        if (is_int) {
+        if (is_cplx) {
+            mpfr_t tmp; mpfr_init2(tmp, DEFAULT_MPFR_PREC);
+            mpfr_hypot(tmp, f, im.get(), MPFR_RNDN);
+            mpfr_log10(tmp, tmp, MPFR_RNDN);
+            double d = mpfr_get_d(tmp, MPFR_RNDN);
+            mpfr_clear(tmp);
+            return (long double)d;
+        }
+        if (is_int || is_dec) {
             if (mpz_sgn(i) == 0) return -INFINITY;
-            // number of digits approx
-            unsigned long digits = mpz_sizeinbase(i, 10);
-            char *s = mpz_get_str(NULL, 10, i);
-            string str(s); free(s);
-            size_t take = min<size_t>(18, str.size());
-            string lead = str.substr(0, take);
-            long double lead_val = safe_stold(lead);
-            long double frac = log10l(lead_val) - (long double)(take - 1);
-            return (long double)(digits - 1) + frac;
+            long e2; double m = mpz_get_d_2exp(&e2, i);
+            return log10l(fabsl((long double)m)) + (long double)e2 * log10l(2.0L) + (is_int ? (long double)z10 : -(long double)dec_scale);
         } else {
             if (mpfr_zero_p(f)) return -INFINITY;
             mpfr_t tmp; mpfr_init2(tmp, DEFAULT_MPFR_PREC);
-            mpfr_log10(tmp, f, MPFR_RNDN);
+            mpfr_abs(tmp, f, MPFR_RNDN);
+            mpfr_log10(tmp, tmp, MPFR_RNDN);
             double d = mpfr_get_d(tmp, MPFR_RNDN);
             mpfr_clear(tmp);
             return (long double)d;
         }
     }
 
+    // is_int: number of decimal digits (may exceed the true count by one, like mpz_sizeinbase)
+    unsigned long int_digits() const { return mpz_sizeinbase(i, 10) + (mpz_sgn(i) ? z10 : 0); }
+    // is_int: value as unsigned long; only meaningful when int_digits() <= 18
+    unsigned long int_get_ui() const {
+        unsigned long v = mpz_get_ui(i);
+        for (unsigned long k = 0; k < z10; ++k) v *= 10;
+        return v;
+    }
+
+    // "re + im i" with up to 12 significant digits per part; "im i" when the real part is zero, "i" for 1
+    static string complex_string(mpfr_srcptr re, mpfr_srcptr im) {
+        char *s = nullptr;
+        string out;
+        if (!mpfr_zero_p(re)) {
+            mpfr_asprintf(&s, "%.12Rg", re);
+            out = string(s) + (mpfr_sgn(im) < 0 ? " - " : " + ");
+            mpfr_free_str(s);
+        } else if (mpfr_sgn(im) < 0) out = "-";
+        if (mpfr_cmp_si(im, 1) != 0 && mpfr_cmp_si(im, -1) != 0) {
+            mpfr_asprintf(&s, "%.12Rg", im);
+            out += s[0] == '-' ? s + 1 : s;
+            mpfr_free_str(s);
+        }
+        return out + IMAGINARY_UNIT;
+    }
+
+    // Complex values with a dimension are shown in the first unit that puts |z| in the 0.1 .. 1000 window
+    // real values use, else in SI: "(3 + 4i) m"
+    string complex_to_human(bool prefer_si) const {
+        if (dim == Dimension()) return complex_string(f, im.get());
+        mpfr_t re, imv, uf;
+        mpfr_init2(re, mpfr_get_prec(f)); mpfr_init2(imv, mpfr_get_prec(f)); mpfr_init2(uf, mpfr_get_prec(f));
+        mpfr_set(re, f, MPFR_RNDN); mpfr_set(imv, im.get(), MPFR_RNDN);
+        string unit = compound_unit_string(dim);
+        if (!prefer_si) {
+            long double mag = hypotl(mpfr_get_ld(f, MPFR_RNDN), mpfr_get_ld(im.get(), MPFR_RNDN));
+            for (auto &u : UNIT_REG.units_with_dim(dim)) {
+                long double fac = mpfr_get_d(u->factor, MPFR_RNDN);
+                if (fac == 0 || mag / fac < 0.1L || mag / fac >= 1000.0L) continue;
+                u->load_factor(uf);
+                mpfr_div(re, re, uf, MPFR_RNDN); mpfr_div(imv, imv, uf, MPFR_RNDN);
+                unit = u->name;
+                break;
+            }
+        }
+        string out = "(" + complex_string(re, imv) + ") " + unit;
+        mpfr_clear(re); mpfr_clear(imv); mpfr_clear(uf);
+        return out;
+    }
+
     static string compound_unit_string(const Dimension &dim) {
         // Build string like m^2*kg/s^2
         // We'll use UNIT_REG.baseNames mapping (index to base unit)
@@ -386,20 +686,29 @@ struct BigValue {
     }
 };
 
+// ----------------- Shared value handles -----------------
+// Evaluation results are immutable and reference counted (shared_ptr counts atomically), so a value held
+// by the evaluator stack, a cache, a session or several coalesced callers lives in memory exactly once.
+// Only the evaluator writes, through writable_result() (copy-on-write).
+using ValuePtr = shared_ptr<const BigValue>;
+
 // ----------------- Tokenizer & Shunting-yard -----------------
-enum TokenType { T_NUM, T_IDENT, T_OP, T_LP, T_RP, T_TO };
+enum TokenType { T_NUM, T_IDENT, T_OP, T_LP, T_RP, T_TO, T_VAL, T_FUNC, T_COMMA };
 struct Token {
     TokenType type;
     string text; // for numbers: maybe "123#unit" where we encode inline unit using '#'
+    ValuePtr val; // T_VAL: an already evaluated value spliced into the RPN (shared, not copied)
+    int nargs = 0; // T_FUNC: number of arguments (set by shunting_yard)
 };
 
 static bool is_ident_char(char c) {
-    return isalpha((unsigned char)c) || c == '_' || c == '/' || c == '%' || c == '.'; // allow deg symbol words (partial)
+    return isalpha((unsigned char)c) || c == '_' || c == '%' || c == '.'; // allow deg symbol words (partial)
 }
 
-vector<Token> tokenize(const string &s) {
-    vector<Token> out;
-    size_t i = 0;
+// Appends the tokens of s[i..] to out, whose last token (from earlier text) decides whether a sign is unary.
+// With more_input, s may still grow: tokenizing stops before a number, unit or name that runs into the end of
+// s (it could continue, or be followed by '(') and the return value is where it starts; otherwise s.size().
+static size_t tokenize_more(const string &s, size_t i, vector<Token> &out, bool more_input) {
     while (i < s.size()) {
         char c = s[i];
         if (isspace((unsigned char)c)) { ++i; continue; }
@@ -407,11 +716,12 @@ vector<Token> tokenize(const string &s) {
             size_t j = i;
             bool seenE = false;
             while (j < s.size() && (isdigit(s[j]) || s[j] == '.' || s[j] == 'e' || s[j] == 'E' || ((s[j] == '+' || s[j] == '-') && j > i && (s[j - 1] == 'e' || s[j - 1] == 'E')))) j++;
-            string num = s.substr(i, j - i);
-            i = j;
             // optional inline unit immediately following digits/decimal (letters)
-            size_t k = i;
+            size_t k = j;
             while (k < s.size() && is_ident_char(s[k])) k++;
+            if (more_input && k == s.size()) return i;
+            string num = s.substr(i, j - i);
+            i = j;
             if (k > i) {
                 string unit = s.substr(i, k - i);
                 i = k;
@@ -425,42 +735,191 @@ vector<Token> tokenize(const string &s) {
             // read identifier (unit, or 'to', or function name)
             size_t j = i;
             while (j < s.size() && is_ident_char(s[j])) ++j;
+            // trailing digits belong to a function name (stirling1(...)), not to a following number
+            size_t d = j;
+            while (d < s.size() && isdigit((unsigned char)s[d])) ++d;
+            size_t after = d;
+            while (after < s.size() && isspace((unsigned char)s[after])) ++after;
+            if (d > j && after < s.size() && s[after] == '(') j = d;
+            size_t k = j;
+            while (k < s.size() && isspace((unsigned char)s[k])) ++k;
+            if (more_input && (after == s.size() || k == s.size())) return i;
             string id = s.substr(i, j - i);
             i = j;
             if (id == "to") out.push_back({T_TO, id});
+            else if (k < s.size() && s[k] == '(') out.push_back({T_FUNC, id}); // name( is a function call
             else out.push_back({T_IDENT, id});
             continue;
         }
-        // operators and parens
+        // operators and parens; a sign where an operand is expected is unary
+        bool operand_expected = out.empty() || out.back().type == T_OP || out.back().type == T_LP || out.back().type == T_COMMA;
+        if ((c == '+' || c == '-') && operand_expected) { if (c == '-') out.push_back({T_OP, "neg"}); ++i; continue; }
         if (c == '+' || c == '-' || c == '*' || c == '/' || c == '^') { out.push_back({T_OP, string(1, c)}); ++i; continue; }
         if (c == '(') { out.push_back({T_LP, "("}); ++i; continue; }
         if (c == ')') { out.push_back({T_RP, ")"}); ++i; continue; }
+        // [a, b, ...] is the list() call
+        if (c == '[') { out.push_back({T_FUNC, "list"}); out.push_back({T_LP, "["}); ++i; continue; }
+        if (c == ']') { out.push_back({T_RP, "]"}); ++i; continue; }
+        if (c == ',') { out.push_back({T_COMMA, ","}); ++i; continue; }
         // unknown single char: treat as operator
         out.push_back({T_OP, string(1, c)});
         ++i;
     }
+    return i;
+}
+
+vector<Token> tokenize(const string &s) {
+    vector<Token> out;
+    tokenize_more(s, 0, out, false);
     return out;
 }
 
+// ----- Python/SymPy numeric syntax (--python) -----
+// Front end for SymPy-style queries that are really just numbers: ** and ^ are powers, Integer(x), Float(x),
+// N(x) and S(x) are plain groupings, Rational(p, q) is (p)/(q), pi, E and I are constants, 2j is 2i, sqrt/exp/zeta,
+// partition, re/im/arg/Abs/conjugate map to the built-ins, and juxtaposition multiplies ("2pi", "3(4+5)",
+// "(1+2)(3+4)") except between two numbers ("2 3" is a syntax error in SymPy too). Numbers never carry units.
+// Anything else (free symbols, other functions, //, %) makes the expression non-numeric:
+// the caller should hand it to SymPy, and the returned tokens are incomplete.
+struct PythonParse {
+    vector<Token> tokens;
+    bool numeric = true;
+    string reason; // why the expression is not numeric
+};
+
+static const set<string> PYTHON_GROUPINGS = { "Integer", "Float", "N", "S", "sympify" };
+static const map<string, string> PYTHON_FUNCTIONS = { { "sqrt", "sqrt" }, { "exp", "exp" }, { "zeta", "zeta" }, { "partition", "partitions" },
+    { "re", "re" }, { "im", "im" }, { "arg", "arg" }, { "Abs", "abs" }, { "abs", "abs" }, { "conjugate", "conj" } };
+
+[[maybe_unused]] static PythonParse tokenize_python(const string &s) {
+    PythonParse r;
+    vector<Token> &out = r.tokens;
+    auto fail = [&](const string &why) { r.numeric = false; r.reason = why; return r; };
+    // per open '(': 'r' for Rational(p, q) with its comma still to come, 'R' after it, 'g' otherwise
+    vector<char> parens;
+    auto operand_end = [&] {
+        return !out.empty() && (out.back().type == T_NUM || out.back().type == T_IDENT || out.back().type == T_RP);
+    };
+    auto implicit_mul = [&] { if (operand_end()) out.push_back({T_OP, "*"}); };
+    size_t i = 0;
+    while (i < s.size()) {
+        char c = s[i];
+        if (isspace((unsigned char)c)) { ++i; continue; }
+        if (isdigit((unsigned char)c) || (c == '.' && i + 1 < s.size() && isdigit((unsigned char)s[i + 1]))) {
+            if (!out.empty() && out.back().type == T_NUM) return fail("number after number");
+            implicit_mul();
+            size_t j = i;
+            string num;
+            if (c == '0' && i + 1 < s.size() && strchr("xXoObB", s[i + 1])) {
+                // 0x.., 0o.., 0b.. integer literals become decimal
+                int base = tolower(s[i + 1]) == 'x' ? 16 : tolower(s[i + 1]) == 'o' ? 8 : 2;
+                for (j = i + 2; j < s.size() && (isalnum((unsigned char)s[j]) || s[j] == '_'); ++j)
+                    if (s[j] != '_') num += s[j];
+                mpz_t z; mpz_init(z);
+                bool ok = !num.empty() && mpz_set_str(z, num.c_str(), base) == 0;
+                char *d = ok ? mpz_get_str(nullptr, 10, z) : nullptr;
+                mpz_clear(z);
+                if (!ok) return fail("invalid literal " + s.substr(i, j - i));
+                num = d; free(d);
+            } else {
+                while (j < s.size() && (isdigit((unsigned char)s[j]) || s[j] == '_' || s[j] == '.'))
+                    if (s[j++] != '_') num += s[j - 1];
+                // exponent only when digits follow, so "2E" is 2*E
+                size_t e = j + 1 + (j + 1 < s.size() && (s[j + 1] == '+' || s[j + 1] == '-'));
+                if (j < s.size() && (s[j] == 'e' || s[j] == 'E') && e < s.size() && isdigit((unsigned char)s[e])) {
+                    num += s.substr(j, e - j);
+                    for (j = e; j < s.size() && (isdigit((unsigned char)s[j]) || s[j] == '_'); ++j)
+                        if (s[j] != '_') num += s[j];
+                }
+                if (j < s.size() && (s[j] == 'j' || s[j] == 'J')) { num += "#i"; ++j; } // imaginary literal
+            }
+            out.push_back({T_NUM, num});
+            i = j;
+            continue;
+        }
+        if (isalpha((unsigned char)c) || c == '_') {
+            size_t j = i;
+            while (j < s.size() && (isalnum((unsigned char)s[j]) || s[j] == '_')) ++j;
+            string id = s.substr(i, j - i);
+            size_t k = j;
+            while (k < s.size() && isspace((unsigned char)s[k])) ++k;
+            bool call = k < s.size() && s[k] == '(';
+            i = call ? k + 1 : j;
+            implicit_mul();
+            if (!call && id == "pi") { out.push_back({T_IDENT, "pi"}); continue; }
+            if (!call && id == "I") { out.push_back({T_IDENT, IMAGINARY_UNIT}); continue; }
+            if (!call && id == "E") { // exp(1)
+                out.push_back({T_FUNC, "exp"}); out.push_back({T_LP, "("}); out.push_back({T_NUM, "1"}); out.push_back({T_RP, ")"});
+                continue;
+            }
+            if (!call) return fail("symbol " + id);
+            if (id == "Rational") {
+                out.push_back({T_LP, "("}); out.push_back({T_LP, "("});
+                parens.push_back('r');
+                continue;
+            }
+            auto f = PYTHON_FUNCTIONS.find(id);
+            if (f != PYTHON_FUNCTIONS.end()) out.push_back({T_FUNC, f->second});
+            else if (!PYTHON_GROUPINGS.count(id)) return fail("function " + id);
+            out.push_back({T_LP, "("});
+            parens.push_back('g');
+            continue;
+        }
+        if (c == '(') { implicit_mul(); out.push_back({T_LP, "("}); parens.push_back('g'); ++i; continue; }
+        if (c == ')') {
+            if (parens.empty()) return fail("unbalanced ')'");
+            if (parens.back() == 'r') return fail("Rational() takes 2 arguments");
+            if (parens.back() == 'R') out.push_back({T_RP, ")"});
+            out.push_back({T_RP, ")"});
+            parens.pop_back();
+            ++i;
+            continue;
+        }
+        if (c == ',') {
+            if (parens.empty() || parens.back() != 'r') return fail("',' outside Rational()");
+            out.push_back({T_RP, ")"}); out.push_back({T_OP, "/"}); out.push_back({T_LP, "("});
+            parens.back() = 'R';
+            ++i;
+            continue;
+        }
+        if (c == '*' && i + 1 < s.size() && s[i + 1] == '*') { out.push_back({T_OP, "^"}); i += 2; continue; }
+        if (c == '/' && i + 1 < s.size() && s[i + 1] == '/') return fail("operator //");
+        bool operand_expected = out.empty() || out.back().type == T_OP || out.back().type == T_LP;
+        if ((c == '+' || c == '-') && operand_expected) { if (c == '-') out.push_back({T_OP, "neg"}); ++i; continue; }
+        if (c == '+' || c == '-' || c == '*' || c == '/' || c == '^') { out.push_back({T_OP, string(1, c)}); ++i; continue; }
+        return fail(string("operator ") + c);
+    }
+    if (!parens.empty()) return fail("unbalanced '('");
+    return r;
+}
+
 int prec(const string &op) {
     if (op == "to") return 1;
     if (op == "=") return 1;
     if (op == "+" || op == "-") return 2;
     if (op == "*" || op == "/") return 3;
+    if (op == "neg") return 4; // -2^2 = -(2^2), -2*3 = (-2)*3
     if (op == "^") return 5;
     return 0;
 }
 bool right_assoc(const string &op) { return op == "^"; }
 
-vector<Token> shunting_yard(const vector<Token> &tokens) {
+// Incremental shunting-yard: push() takes the tokens in input order and only ever appends to output, so
+// every RPN token already written is final; finish() flushes the operator stack at the end of the input.
+struct ShuntingYard {
     vector<Token> output;
     vector<Token> ops;
-    for (size_t idx = 0; idx < tokens.size(); ++idx) {
-        Token tk = tokens[idx];
-        if (tk.type == T_NUM || tk.type == T_IDENT) {
+    vector<int> paren_args; // per open '(': argument count of a function call, -1 for grouping
+    bool started = false;
+    TokenType last = T_COMMA; // type of the previous token
+
+    void push(const Token &tk) {
+        if (tk.type == T_NUM || tk.type == T_IDENT || tk.type == T_VAL) {
             output.push_back(tk);
+        } else if (tk.type == T_OP && tk.text == "neg") {
+            ops.push_back(tk); // prefix: nothing to its left to reduce
         } else if (tk.type == T_OP || tk.type == T_TO) {
-            string op = tk.text;
+            const string &op = tk.text;
             while (!ops.empty() && (ops.back().type == T_OP || ops.back().type == T_TO)) {
                 string top = ops.back().text;
                 if ((!right_assoc(op) && prec(op) <= prec(top)) || (right_assoc(op) && prec(op) < prec(top))) {
@@ -469,35 +928,325 @@ vector<Token> shunting_yard(const vector<Token> &tokens) {
                 } else break;
             }
             ops.push_back(tk);
+        } else if (tk.type == T_FUNC) {
+            ops.push_back(tk); // the tokenizer guarantees '(' follows
         } else if (tk.type == T_LP) {
+            paren_args.push_back(started && last == T_FUNC ? 1 : -1);
             ops.push_back(tk);
+        } else if (tk.type == T_COMMA) {
+            if (paren_args.empty() || paren_args.back() < 0) throw runtime_error("',' outside a function call");
+            while (ops.back().type != T_LP) { output.push_back(ops.back()); ops.pop_back(); }
+            ++paren_args.back();
         } else if (tk.type == T_RP) {
             bool found = false;
             while (!ops.empty()) {
                 Token t = ops.back(); ops.pop_back();
-                if (t.type == T_LP) { found = true; break; }
+                if (t.type == T_LP) {
+                    if ((t.text == "[") != (tk.text == "]")) throw runtime_error("Mismatched brackets");
+                    found = true;
+                    break;
+                }
                 output.push_back(t);
             }
             if (!found) throw runtime_error("Mismatched parentheses");
+            int nargs = paren_args.back(); paren_args.pop_back();
+            if (nargs > 0 && last == T_LP) nargs = 0; // name()
+            if (nargs >= 0) {
+                ops.back().nargs = nargs;
+                output.push_back(ops.back());
+                ops.pop_back();
+            }
         } else {
             // ignore
         }
+        started = true;
+        last = tk.type;
+    }
+
+    void finish() {
+        while (!ops.empty()) {
+            Token t = ops.back(); ops.pop_back();
+            if (t.type == T_LP || t.type == T_RP) throw runtime_error("Mismatched parentheses");
+            output.push_back(t);
+        }
+    }
+};
+
+vector<Token> shunting_yard(const vector<Token> &tokens) {
+    ShuntingYard y;
+    for (const Token &tk : tokens) y.push(tk);
+    y.finish();
+    return move(y.output);
+}
+
+// ----------------- Function table -----------------
+// Built-in functions called as name(args). Results are dimensionless and may be lists; arguments are
+// dimensionless unless the function says otherwise. The table itself is defined with the built-ins, after
+// the evaluator helpers.
+struct EvalConfig;
+struct FuncDef {
+    int min_args, max_args;
+    ValuePtr (*call)(const vector<ValuePtr> &args, const EvalConfig &cfg);
+    bool dimensionless_args = true;
+    bool complex_args = false; // takes complex numbers (also inside lists); others are refused before the call
+    bool long_args = false;    // results stay small: arguments may have DIGIT_ARG_SCALE times max_digits digits
+};
+static const FuncDef *find_function(const string &name);
+
+// ----------------- Static dimensional analysis -----------------
+// One cheap pass over the RPN before any big-number work: infers the Dimension of every node so that
+// unit mismatches, dimensioned exponents and unknown units are reported in microseconds instead of after
+// e.g. a million-digit power has been computed. eval_rpn reuses the inferred dimensions.
+struct DimInfo {
+    Dimension dim;
+    bool known = true;     // false if the dimension depends on an exponent only known at runtime
+    bool is_const = false; // node is a small exact integer known before evaluation (tracked for '^')
+    long long cval = 0;
+};
+
+// 'x to frac' names an output format, not a unit
+static bool is_frac_target(const vector<Token> &rpn, size_t k) {
+    return rpn[k].type == T_IDENT && rpn[k].text == "frac" && k + 1 < rpn.size() && rpn[k + 1].type == T_TO;
+}
+
+static bool small_int_literal(const string &txt, long long &out) {
+    if (txt.empty() || txt.size() > 18) return false;
+    for (char c : txt) if (!isdigit((unsigned char)c)) return false;
+    out = stoll(txt);
+    return true;
+}
+
+static bool checked_pow_ll(long long b, long long e, long long &out) {
+    if (e < 0) return false;
+    long long r = 1;
+    for (long long k = 0; k < e; ++k) {
+        if (__builtin_mul_overflow(r, b, &r)) return false;
+        if (r == 0 || r == 1) break;
+    }
+    out = r;
+    return true;
+}
+
+// Returns false and sets err (without the "Error: " prefix) on the first dimensional error.
+// info[k] describes the value produced by rpn[k].
+static bool infer_dimensions(const vector<Token> &rpn, vector<DimInfo> &info, string &err) {
+    info.assign(rpn.size(), DimInfo());
+    vector<size_t> st; // indices into info
+    for (size_t k = 0; k < rpn.size(); ++k) {
+        const Token &tk = rpn[k];
+        DimInfo &n = info[k];
+        if (tk.type == T_NUM) {
+            size_t pos = tk.text.find('#');
+            if (pos != string::npos) {
+                string unit = tk.text.substr(pos + 1);
+                UnitPtr u = unit == IMAGINARY_UNIT ? nullptr : UNIT_REG.resolve(unit);
+                if (!u && unit != IMAGINARY_UNIT) { err = "Unknown unit: " + unit; return false; }
+                if (u) n.dim = u->dim;
+            } else {
+                n.is_const = small_int_literal(trim(tk.text), n.cval);
+            }
+            st.push_back(k);
+        } else if (tk.type == T_VAL) {
+            n.dim = tk.val->dim;
+            if (tk.val->is_int && tk.val->z10 == 0 && mpz_fits_slong_p(tk.val->i)) { n.is_const = true; n.cval = mpz_get_si(tk.val->i); }
+            st.push_back(k);
+        } else if (tk.type == T_IDENT && is_frac_target(rpn, k)) {
+            n.known = false;
+            st.push_back(k);
+        } else if (tk.type == T_IDENT && tk.text == IMAGINARY_UNIT) {
+            st.push_back(k);
+        } else if (tk.type == T_IDENT) {
+            UnitPtr u = UNIT_REG.resolve(tk.text);
+            if (!u) { err = "Unknown unit: " + tk.text; return false; }
+            n.dim = u->dim;
+            st.push_back(k);
+        } else if (tk.type == T_FUNC) {
+            const FuncDef *f = find_function(tk.text);
+            if (!f) { err = "Unknown function: " + tk.text; return false; }
+            if (tk.nargs < f->min_args || tk.nargs > f->max_args) {
+                err = tk.text + "() takes " + to_string(f->min_args) + (f->max_args > f->min_args ? "-" + to_string(f->max_args) : "") + " argument(s)";
+                return false;
+            }
+            if (st.size() < (size_t)tk.nargs) { err = "stack underflow " + tk.text; return false; }
+            for (int a = 0; a < tk.nargs; ++a) {
+                if (f->dimensionless_args && info[st.back()].known && !(info[st.back()].dim == Dimension())) {
+                    err = tk.text + "() takes dimensionless arguments";
+                    return false;
+                }
+                st.pop_back();
+            }
+            st.push_back(k);
+        } else if (tk.type == T_TO) {
+            if (st.size() < 2) { err = "'to' requires left value and right unit identifier"; return false; }
+            const DimInfo &target = info[st.back()]; st.pop_back();
+            const DimInfo &val = info[st.back()]; st.pop_back();
+            if (target.known && val.known && !(target.dim == val.dim)) { err = "Unit mismatch for 'to'"; return false; }
+            // eval_rpn stops at 'to'; nothing after it is evaluated
+            return true;
+        } else if (tk.type == T_OP && tk.text == "neg") {
+            if (st.empty()) { err = "stack underflow -"; return false; }
+            const DimInfo &a = info[st.back()]; st.pop_back();
+            n.dim = a.dim;
+            n.known = a.known;
+            n.is_const = a.is_const && a.cval != LLONG_MIN;
+            n.cval = -a.cval;
+            st.push_back(k);
+        } else if (tk.type == T_OP) {
+            const string &op = tk.text;
+            if (op != "+" && op != "-" && op != "*" && op != "/" && op != "^") { err = "unknown operator '" + op + "'"; return false; }
+            if (st.size() < 2) { err = "stack underflow " + op; return false; }
+            const DimInfo &b = info[st.back()]; st.pop_back();
+            const DimInfo &a = info[st.back()]; st.pop_back();
+            n.known = a.known && b.known;
+            if (op == "+" || op == "-") {
+                if (n.known && !(a.dim == b.dim)) { err = "Unit mismatch for " + op; return false; }
+                n.dim = a.dim;
+                if (a.is_const && b.is_const) {
+                    n.is_const = !(op == "+" ? __builtin_add_overflow(a.cval, b.cval, &n.cval)
+                                             : __builtin_sub_overflow(a.cval, b.cval, &n.cval));
+                }
+            } else if (op == "*") {
+                n.dim = a.dim + b.dim;
+                if (a.is_const && b.is_const) n.is_const = !__builtin_mul_overflow(a.cval, b.cval, &n.cval);
+            } else if (op == "/") {
+                n.dim = a.dim - b.dim;
+            } else {
+                if (b.known && !(b.dim == Dimension())) { err = "exponent must be unitless"; return false; }
+                if (a.known && a.dim == Dimension()) {
+                    n.known = true;
+                } else if (a.known && b.is_const && b.cval >= INT32_MIN && b.cval <= INT32_MAX) {
+                    n.dim = a.dim.pow_int((int)b.cval);
+                    n.known = true;
+                } else {
+                    n.known = false; // dimensioned base with a runtime exponent: decided by eval_rpn
+                }
+                if (a.is_const && b.is_const) n.is_const = checked_pow_ll(a.cval, b.cval, n.cval);
+            }
+            st.push_back(k);
+        } else {
+            err = "unexpected token in RPN";
+            return false;
+        }
     }
-    while (!ops.empty()) {
-        Token t = ops.back(); ops.pop_back();
-        if (t.type == T_LP || t.type == T_RP) throw runtime_error("Mismatched parentheses");
-        output.push_back(t);
+    return true;
+}
+
+// out[k] is set if rpn[k] belongs to an argument of a long_args function (digitsum(2^10000000))
+static vector<char> long_arg_tokens(const vector<Token> &rpn) {
+    vector<char> out(rpn.size());
+    vector<size_t> starts; // where the subtree of each operand on the stack begins
+    for (size_t k = 0; k < rpn.size(); ++k) {
+        const Token &tk = rpn[k];
+        size_t arity = tk.type == T_FUNC ? (size_t)tk.nargs : tk.type == T_TO ? 2 : tk.type != T_OP ? 0 : tk.text == "neg" ? 1 : 2;
+        if (starts.size() < arity) break; // malformed: evaluation reports it
+        size_t s = arity ? starts[starts.size() - arity] : k;
+        starts.resize(starts.size() - arity);
+        starts.push_back(s);
+        if (tk.type != T_FUNC) continue;
+        const FuncDef *f = find_function(tk.text);
+        if (f && f->long_args) fill(out.begin() + s, out.begin() + k, 1);
     }
-    return output;
+    return out;
+}
+
+// ----------------- Resource accounting -----------------
+// Per-thread counters behind client quotas: bytes GMP (and MPFR, which allocates through GMP) holds, once
+// install_gmp_accounting has run, and CPU time including the parallel_range workers a thread started.
+// Workers start from their caller's counters and hand back their CPU time and bytes when they join, so a
+// quota check in a worker sees the caller's usage plus the worker's own. Limbs freed by another thread than the one
+// that allocated them still make gmp_live_bytes drift; quotas only use the peak above the value at the
+// start of an evaluation.
+static thread_local long long gmp_live_bytes = 0;
+static thread_local long long gmp_peak_bytes = 0;
+static thread_local long long worker_cpu_ns = 0;
+
+static void gmp_count(long long delta) {
+    gmp_live_bytes += delta;
+    if (gmp_live_bytes > gmp_peak_bytes) gmp_peak_bytes = gmp_live_bytes;
+}
+// Fails the evaluation instead of the process. GMP is not exception safe, so the limbs of the operation in
+// progress leak, but every caller of the engine already turns an exception into an error result.
+struct GmpOutOfMemory : bad_alloc {
+    const char *what() const noexcept override { return "out of memory"; }
+};
+static void gmp_out_of_memory() { throw GmpOutOfMemory(); }
+static void *counting_alloc(size_t n) {
+    void *p = malloc(n);
+    if (!p) gmp_out_of_memory();
+    gmp_count((long long)n);
+    return p;
+}
+static void *counting_realloc(void *p, size_t old_n, size_t new_n) {
+    void *q = realloc(p, new_n);
+    if (!q) gmp_out_of_memory();
+    gmp_count((long long)new_n - (long long)old_n);
+    return q;
 }
+static void counting_free(void *p, size_t n) {
+    free(p);
+    gmp_count(-(long long)n);
+}
+// The counting functions use malloc/realloc/free like GMP's defaults, so limbs allocated before
+// installation are freed correctly afterwards
+static void install_gmp_accounting() {
+    static once_flag once;
+    call_once(once, [] { mp_set_memory_functions(counting_alloc, counting_realloc, counting_free); });
+}
+
+static long long own_thread_cpu_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+static long long thread_cpu_ns() { return own_thread_cpu_ns() + worker_cpu_ns; }
 
 // ----------------- Evaluator with units and overflow-safe exponent -----------------
+enum DecimalRounding { DR_HALF_EVEN, DR_HALF_UP, DR_DOWN, DR_UP, DR_FLOOR, DR_CEILING };
+
 struct EvalConfig {
     long double max_digits = DEFAULT_MAX_DIGITS;
     int mpfr_prec = DEFAULT_MPFR_PREC;
     bool prefer_si = false;
+    // --decimal=N: exact fixed-point mode. Literals and exact unit factors become scaled integers, + - * stay
+    // exact, '/' and 'to' round to N fractional digits with decimal_rounding.
+    int decimal_digits = -1;
+    DecimalRounding decimal_rounding = DR_HALF_EVEN;
+    // --repeat-digits: fractional digits an exact rational prints before its expansion is cut off
+    unsigned long repeat_digits = DEFAULT_REPEAT_DIGITS;
+    // --timeout: checked between operations and inside long-running built-ins
+    chrono::steady_clock::time_point deadline = chrono::steady_clock::time_point::max();
+    // client quotas: CPU (thread_cpu_ns) and GMP bytes above the values at the start, checked at the same points
+    long long cpu_limit_ns = -1, cpu_start_ns = 0;
+    long long max_gmp_bytes = -1, gmp_start_bytes = 0;
+    // set from another thread to stop the evaluation at the next deadline check (a stream being dropped)
+    const atomic<bool> *cancel = nullptr;
 };
 
+// The deadline has passed or the evaluation was cancelled (quotas aside)
+static bool deadline_passed(const EvalConfig &cfg) {
+    return chrono::steady_clock::now() > cfg.deadline || (cfg.cancel && cfg.cancel->load(memory_order_relaxed));
+}
+
+// Why the evaluation has to stop, or nullptr. Workers that poll this stop early and leave the caller to
+// throw the same reason with check_deadline once they have joined.
+static const char *limit_exceeded(const EvalConfig &cfg) {
+    if (cfg.cancel && cfg.cancel->load(memory_order_relaxed)) return "evaluation cancelled";
+    if (chrono::steady_clock::now() > cfg.deadline) return "evaluation timed out";
+    if (cfg.cpu_limit_ns >= 0 && thread_cpu_ns() - cfg.cpu_start_ns > cfg.cpu_limit_ns) return "CPU quota exceeded";
+    if (cfg.max_gmp_bytes >= 0 && gmp_peak_bytes - cfg.gmp_start_bytes > cfg.max_gmp_bytes) return "memory quota exceeded";
+    return nullptr;
+}
+
+static void check_deadline(const EvalConfig &cfg) {
+    if (const char *why = limit_exceeded(cfg)) throw runtime_error(why);
+}
+
+// After workers stopped on limit_exceeded: the reason they saw, thrown from the calling thread
+[[noreturn]] static void throw_limit_exceeded(const EvalConfig &cfg) {
+    check_deadline(cfg);
+    throw runtime_error("evaluation timed out");
+}
+
 static string approx_from_log10(long double log10v) {
     if (!isfinite(log10v)) return string("0");
     long double ip; long double frac = modfl(log10v, &ip);
@@ -506,249 +1255,3530 @@ static string approx_from_log10(long double log10v) {
     return ss.str();
 }
 
-// helper: pop stack; manage memory
-static void free_stack(vector<BigValue*> &st) {
-    for (auto p : st) delete p;
-    st.clear();
-}
-
 // Convert Token.NUM text to BigValue: either "num" or "num#unit"
-static BigValue* token_to_bigvalue(const Token &tk) {
+static ValuePtr token_to_bigvalue(const Token &tk, const EvalConfig &cfg) {
     if (tk.type != T_NUM) throw runtime_error("Expected number token");
     string txt = tk.text;
     size_t pos = txt.find('#');
     string num = txt, unit = "";
     if (pos != string::npos) { num = txt.substr(0, pos); unit = txt.substr(pos + 1); }
-    BigValue *v = new BigValue();
-    v->set_from_string_and_unit(num, unit);
+    auto v = make_shared<BigValue>();
+    mpfr_set_prec(v->f, cfg.mpfr_prec);
+    if (unit == IMAGINARY_UNIT) {
+        // imaginary literal "2i": the number is the imaginary part
+        v->make_complex(cfg.mpfr_prec);
+        mpfr_set_str(v->im.get(), trim(num).c_str(), 10, MPFR_RNDN);
+        mpfr_set_zero(v->f, 1);
+        return v;
+    }
+    bool plain_int = unit.empty() && num.find_first_of(".eE") == string::npos;
+    if (cfg.decimal_digits >= 0 && !plain_int) v->set_decimal_from_string_and_unit(num, unit);
+    else v->set_from_string_and_unit(num, unit);
     return v;
 }
 
-// Evaluate RPN with unit handling and overflow detection
-pair<bool, string> eval_rpn(const vector<Token> &rpn, const EvalConfig &cfg) {
-    vector<BigValue*> st;
-    try {
-        for (size_t i = 0; i < rpn.size(); ++i) {
-            Token tk = rpn[i];
-            if (tk.type == T_NUM) {
-                BigValue *v = token_to_bigvalue(tk);
-                st.push_back(v);
-            } else if (tk.type == T_IDENT) {
-                // interpret identifier as a standalone unit (1 unit)
-                string id = tk.text;
-                BigValue *v = new BigValue();
-                v->set_from_string_and_unit("1", id);
-                st.push_back(v);
-            } else if (tk.type == T_TO) {
-                // binary operator: a to unit
-                if (st.size() < 2) { free_stack(st); return {false, string("Error: 'to' requires left value and right unit identifier")}; }
-                BigValue *unitv = st.back(); st.pop_back();
-                BigValue *val = st.back(); st.pop_back();
-                // unitv must be a unit identity: originally created from an identifier token => numeric 1 * unit factor
-                // We need to find requested unit label: but tokenization pushed unit identifier as BigValue with numeric factor applied
-                // To support robust 'to', we instead will accept pattern where the RIGHT operand is T_IDENT token in RPN.
-                // So here fallback: if unitv.dim != dimensionless and unitv->estimate_long_double == factor of unit, we should map back to unit name.
-                // Simpler: we won't attempt to recover the original token's name here; instead, when generating RPN, ensure that 'to' is encoded differently:
-                // To keep single-file compatibility: we require syntax: '100 km to m' tokenizes to [100#km][m][to] where T_IDENT 'm' was pushed as token (not numeric).
-                // So this code path may not be used. Instead, handle 'to' at RPN stage by reading previous tokens more carefully.
-                // For safety, if unitv->dim != val->dim -> error. We'll attempt to find a unit in registry with the same dimension and whose factor equals unitv's numeric factor.
-                // Compute numeric value of unitv (approx)
-                // Find a unit name that matches same dimension and approximates factor; if none, error.
-                // Convert val to requested unit: requiredFactor = unitFactor; current numeric is val (SI). result = numeric_in_SI / requiredFactor
-                long double unit_factor_ld = unitv->estimate_long_double();
-                Dimension ud = unitv->dim;
-                // find candidate
-                UnitPtr found = nullptr;
-                for (auto &kv : UNIT_REG.table) {
-                    UnitPtr u = kv.second;
-                    if (!(u->dim == ud)) continue;
-                    long double f = mpfr_get_d(u->factor, MPFR_RNDN);
-                    if (fabsl(f - unit_factor_ld) / max((long double)1.0, fabsl(unit_factor_ld)) < 1e-12L) { found = u; break; }
-                }
-                if (!found) { free_stack(st); delete unitv; delete val; return {false, string("Error: unknown target unit for 'to'")}; }
-                // compute val numeric in SI
-                long double val_si = val->estimate_long_double();
-                long double targetFactor = mpfr_get_d(found->factor, MPFR_RNDN);
-                long double resultNumeric = val_si / targetFactor;
-                // produce string
-                ostringstream os; os<< std::fixed << std::setprecision(12); os << resultNumeric << " " << found->name;
-                free_stack(st);
-                delete unitv; delete val;
-                return {false, os.str()};
-            } else if (tk.type == T_OP) {
-                string op = tk.text;
-                if (op == "+") {
-                    if (st.size() < 2) { free_stack(st); return {false, "Error: stack underflow +"}; }
-                    BigValue *b = st.back(); st.pop_back();
-                    BigValue *a = st.back(); st.pop_back();
-                    if (!(a->dim == b->dim)) { free_stack(st); delete a; delete b; return {false, string("Error: Unit mismatch for +")} ; }
-                    BigValue *r = new BigValue();
-                    r->is_int = false;
-                    mpfr_init2(r->f, cfg.mpfr_prec);
-                    mpfr_t ta, tb; mpfr_init2(ta, cfg.mpfr_prec); mpfr_init2(tb, cfg.mpfr_prec);
-                    if (a->is_int) mpfr_set_z(ta, a->i, MPFR_RNDN); else mpfr_set(ta, a->f, MPFR_RNDN);
-                    if (b->is_int) mpfr_set_z(tb, b->i, MPFR_RNDN); else mpfr_set(tb, b->f, MPFR_RNDN);
-                    mpfr_add(r->f, ta, tb, MPFR_RNDN);
-                    mpfr_clear(ta); mpfr_clear(tb);
-                    r->dim = a->dim;
-                    st.push_back(r);
-                    delete a; delete b;
-                } else if (op == "-") {
-                    if (st.size() < 2) { free_stack(st); return {false, "Error: stack underflow -"}; }
-                    BigValue *b = st.back(); st.pop_back();
-                    BigValue *a = st.back(); st.pop_back();
-                    if (!(a->dim == b->dim)) { free_stack(st); delete a; delete b; return {false, string("Error: Unit mismatch for -")} ; }
-                    BigValue *r = new BigValue();
-                    r->is_int = false;
-                    mpfr_init2(r->f, cfg.mpfr_prec);
-                    mpfr_t ta, tb; mpfr_init2(ta, cfg.mpfr_prec); mpfr_init2(tb, cfg.mpfr_prec);
-                    if (a->is_int) mpfr_set_z(ta, a->i, MPFR_RNDN); else mpfr_set(ta, a->f, MPFR_RNDN);
-                    if (b->is_int) mpfr_set_z(tb, b->i, MPFR_RNDN); else mpfr_set(tb, b->f, MPFR_RNDN);
-                    mpfr_sub(r->f, ta, tb, MPFR_RNDN);
-                    mpfr_clear(ta); mpfr_clear(tb);
-                    r->dim = a->dim;
-                    st.push_back(r);
-                    delete a; delete b;
-                } else if (op == "*") {
-                    if (st.size() < 2) { free_stack(st); return {false, "Error: stack underflow *"}; }
-                    BigValue *b = st.back(); st.pop_back();
-                    BigValue *a = st.back(); st.pop_back();
-                    BigValue *r = new BigValue();
-                    r->dim = a->dim + b->dim;
-                    if (a->is_int && b->is_int && r->dim == Dimension()) {
-                        // keep integer if dimensionless
-                        mpz_init(r->i);
-                        mpz_mul(r->i, a->i, b->i);
-                        r->is_int = true;
-                    } else {
-                        r->is_int = false;
-                        mpfr_init2(r->f, cfg.mpfr_prec);
-                        mpfr_t ta, tb; mpfr_init2(ta, cfg.mpfr_prec); mpfr_init2(tb, cfg.mpfr_prec);
-                        if (a->is_int) mpfr_set_z(ta, a->i, MPFR_RNDN); else mpfr_set(ta, a->f, MPFR_RNDN);
-                        if (b->is_int) mpfr_set_z(tb, b->i, MPFR_RNDN); else mpfr_set(tb, b->f, MPFR_RNDN);
-                        mpfr_mul(r->f, ta, tb, MPFR_RNDN);
-                        mpfr_clear(ta); mpfr_clear(tb);
-                    }
-                    st.push_back(r);
-                    delete a; delete b;
-                } else if (op == "/") {
-                    if (st.size() < 2) { free_stack(st); return {false, "Error: stack underflow /"}; }
-                    BigValue *b = st.back(); st.pop_back();
-                    BigValue *a = st.back(); st.pop_back();
-                    BigValue *r = new BigValue();
-                    r->dim = a->dim - b->dim;
-                    r->is_int = false;
-                    mpfr_init2(r->f, cfg.mpfr_prec);
-                    mpfr_t ta, tb; mpfr_init2(ta, cfg.mpfr_prec); mpfr_init2(tb, cfg.mpfr_prec);
-                    if (a->is_int) mpfr_set_z(ta, a->i, MPFR_RNDN); else mpfr_set(ta, a->f, MPFR_RNDN);
-                    if (b->is_int) mpfr_set_z(tb, b->i, MPFR_RNDN); else mpfr_set(tb, b->f, MPFR_RNDN);
-                    if (mpfr_zero_p(tb)) { free_stack(st); delete a; delete b; delete r; return {false, "Error: division by zero"}; }
-                    mpfr_div(r->f, ta, tb, MPFR_RNDN);
-                    mpfr_clear(ta); mpfr_clear(tb);
-                    st.push_back(r);
-                    delete a; delete b;
-                } else if (op == "^") {
-                    if (st.size() < 2) { free_stack(st); return {false, "Error: stack underflow ^"}; }
-                    BigValue *expv = st.back(); st.pop_back();
-                    BigValue *basev = st.back(); st.pop_back();
-                    // exponent must be unitless (Dimension==0)
-                    if (!(expv->dim == Dimension())) { free_stack(st); delete expv; delete basev; return {false, "Error: exponent must be unitless"}; }
-                    // estimate log10(base) and magnitude of exponent
-                    long double log10base = basev->estimate_log10();
-                    long double exp_val_approx;
-                    bool exp_is_int = expv->is_int;
-                    unsigned long exp_ul = 0;
-                    if (exp_is_int) {
-                        // if exponent too big (lots of digits), produce approximation
-                        unsigned long digits = mpz_sizeinbase(expv->i, 10);
-                        if (digits > 18) {
-                            // produce nested approx: base^(1E<digits-1>) as a readable fallback
-                            string approx = basev->to_human(cfg.prefer_si) + string("^(1E") + to_string(digits - 1) + string(")");
-                            free_stack(st); delete basev; delete expv;
-                            return {true, approx};
-                        }
-                        exp_ul = mpz_get_ui(expv->i);
-                        exp_val_approx = (long double)exp_ul;
-                    } else {
-                        // floating exponent: get approximate double
-                        double dv = mpfr_get_d(expv->f, MPFR_RNDN);
-                        exp_val_approx = (long double)dv;
-                    }
-                    // estimate log10(result) = exp * log10(base)
-                    long double est_log10 = exp_val_approx * log10base;
-                    if (!isfinite(est_log10) || est_log10 > cfg.max_digits) {
-                        // overflow / huge result -> return approximate
-                        string approx = approx_from_log10(est_log10);
-                        free_stack(st); delete basev; delete expv;
-                        return {true, approx};
-                    }
-                    // Try compute exactly if small
-                    BigValue *res = new BigValue();
-                    if (basev->is_int && exp_is_int && exp_ul <= 1000000UL) {
-                        // integer power (capped)
-                        mpz_pow_ui(res->i, basev->i, exp_ul);
-                        res->is_int = true;
-                        res->dim = basev->dim.pow_int((int)exp_ul);
-                        st.push_back(res);
-                        delete basev; delete expv;
-                        continue;
-                    } else {
-                        // use mpfr pow via exp/log
-                        res->is_int = false;
-                        mpfr_init2(res->f, cfg.mpfr_prec);
-                        mpfr_t tbase, texp, lbase;
-                        mpfr_init2(tbase, cfg.mpfr_prec); mpfr_init2(texp, cfg.mpfr_prec); mpfr_init2(lbase, cfg.mpfr_prec);
-                        if (basev->is_int) mpfr_set_z(tbase, basev->i, MPFR_RNDN); else mpfr_set(tbase, basev->f, MPFR_RNDN);
-                        if (expv->is_int) mpfr_set_ui(texp, exp_ul, MPFR_RNDN); else mpfr_set(texp, expv->f, MPFR_RNDN);
-                        mpfr_log(lbase, tbase, MPFR_RNDN);
-                        mpfr_mul(lbase, lbase, texp, MPFR_RNDN);
-                        mpfr_exp(res->f, lbase, MPFR_RNDN);
-                        mpfr_clear(tbase); mpfr_clear(texp); mpfr_clear(lbase);
-                        // dimension: if exponent was integer, raise dimension; if fractional it's approximate (not fully supported)
-                        if (exp_is_int) res->dim = basev->dim.pow_int((int)exp_ul);
-                        else res->dim = basev->dim; // approximate
-                        st.push_back(res);
-                        delete basev; delete expv;
-                        continue;
-                    }
-                } else {
-                    free_stack(st); return {false, string("Error: unknown operator '") + op + "'"};
-                }
-            } else {
-                free_stack(st); return {false, string("Internal error: unexpected token in RPN")};
-            }
-        }
-        if (st.size() != 1) { free_stack(st); return {false, string("Error: invalid expression (stack size ") + to_string(st.size()) + ")"}; }
-        string out = st.back()->to_human(cfg.prefer_si);
-        free_stack(st);
-        return {false, out};
-    } catch (const exception &e) {
-        free_stack(st);
-        return {false, string("Error: ") + e.what()};
+// Copy-on-write for operator results: reuse the operand's storage (limbs included) when the evaluator
+// holds the only reference to it, otherwise start a fresh value. Callers must read the operand into
+// temporaries before writing the result, since both may be the same object.
+static shared_ptr<BigValue> writable_result(ValuePtr &operand) {
+    if (operand.use_count() == 1) {
+        shared_ptr<BigValue> w = const_pointer_cast<BigValue>(operand);
+        operand.reset();
+        return w;
     }
+    return make_shared<BigValue>();
 }
 
-// ----------------- CLI and main -----------------
-static void print_usage_and_exit(const char *prog) {
-    cerr << "Usage: " << prog << " '<expression>' [--si] [--max-digits=N] [--precision=bits]\nExamples:\n  " << prog << " \"5 m + 12 cm\"\n  " << prog << " \"100 km to m\"\n";
-    exit(1);
+// load any value into an mpfr temporary (already initialised by the caller)
+static void load_mpfr(mpfr_t dst, const BigValue &v) {
+    if (v.is_rat) { mpfr_set_q(dst, v.q, MPFR_RNDN); return; } // correctly rounded at dst's precision
+    if (!v.is_int && !v.is_dec) { mpfr_set(dst, v.f, MPFR_RNDN); return; }
+    mpfr_set_z(dst, v.i, MPFR_RNDN);
+    unsigned long e = v.is_int ? v.z10 : v.dec_scale;
+    if (e) {
+        mpfr_t p; mpfr_init2(p, mpfr_get_prec(dst));
+        mpfr_ui_pow_ui(p, 10, e, MPFR_RNDN);
+        if (v.is_int) mpfr_mul(dst, dst, p, MPFR_RNDN); else mpfr_div(dst, dst, p, MPFR_RNDN);
+        mpfr_clear(p);
+    }
 }
 
-int main(int argc, char **argv) {
-    ios::sync_with_stdio(false);
-    cin.tie(nullptr);
+// ----- exact decimal helpers (--decimal mode) -----
+static bool is_exact(const BigValue &v) { return v.is_int || v.is_dec; }
+static unsigned long exact_scale(const BigValue &v) { return v.is_dec ? v.dec_scale : 0; }
 
-    if (argc < 2) print_usage_and_exit(argv[0]);
-    string expr = argv[1];
-    EvalConfig cfg;
-    for (int i = 2; i < argc; ++i) {
-        string a = argv[i];
-        if (a.rfind("--max-digits=", 0) == 0) {
-            cfg.max_digits = safe_stold(a.substr(12));
-        } else if (a.rfind("--precision=", 0) == 0) {
+// out = v * 10^scale exactly; requires scale >= exact_scale(v)
+static void load_scaled(mpz_t out, const BigValue &v, unsigned long scale) {
+    unsigned long shift = scale - exact_scale(v) + (v.is_int ? v.z10 : 0);
+    if (shift == 0) { mpz_set(out, v.i); return; }
+    mpz_t p; mpz_init(p);
+    mpz_ui_pow_ui(p, 10, shift);
+    mpz_mul(out, v.i, p);
+    mpz_clear(p);
+}
+
+static void set_exact_kind(BigValue &r, bool as_int, unsigned long scale) {
+    r.is_int = as_int; r.z10 = 0; r.is_rat = false; r.is_cplx = false;
+    r.is_dec = !as_int; r.dec_scale = as_int ? 0 : scale;
+}
+
+// ----- exact rationals (outside --decimal mode) -----
+// '/' of dimensionless integers keeps the exact quotient, and + - * ^ stay exact while every operand is
+// an integer or such a quotient.
+static bool is_rational(const BigValue &v) { return (v.is_int || v.is_rat) && !v.is_list && v.dim == Dimension(); }
+
+static void load_q(mpq_t out, const BigValue &v) {
+    if (v.is_rat) { mpq_set(out, v.q); return; }
+    load_scaled(mpq_numref(out), v, 0);
+    mpz_set_ui(mpq_denref(out), 1);
+}
+
+// r = x (canonical); an integer when the denominator is 1 and r is dimensionless
+static void set_rational(BigValue &r, const mpq_t x, int prec) {
+    if (mpz_cmp_ui(mpq_denref(x), 1) == 0 && r.dim == Dimension()) {
+        mpz_set(r.i, mpq_numref(x));
+        set_exact_kind(r, true, 0);
+        return;
+    }
+    mpq_set(r.q, x);
+    r.is_int = false; r.z10 = 0; r.is_dec = false; r.is_rat = true; r.is_cplx = false;
+    mpfr_set_prec(r.f, prec);
+    mpfr_set_q(r.f, x, MPFR_RNDN);
+}
+
+// Whether base^e stays an exact rational: an integer exponent e of at most RATIONAL_POW_MAX that is negative
+// or raises a non-integer, with numerator and denominator within max_digits
+static const unsigned long RATIONAL_POW_MAX = 1000000;
+static bool exact_rational_power(const BigValue &base, const BigValue &ev, long &e, const EvalConfig &cfg) {
+    if (!ev.is_int || ev.int_digits() > 7) return false;
+    mpz_t z; mpz_init(z);
+    load_scaled(z, ev, 0);
+    e = mpz_get_si(z);
+    mpz_clear(z);
+    unsigned long k = e < 0 ? 0UL - (unsigned long)e : (unsigned long)e;
+    if ((!base.is_rat && e >= 0) || k > RATIONAL_POW_MAX) return false;
+    long double digits = base.is_rat ? (long double)mpz_sizeinbase(mpq_numref(base.q), 10) + mpz_sizeinbase(mpq_denref(base.q), 10)
+                                     : (long double)base.int_digits();
+    return digits * k <= cfg.max_digits;
+}
+
+// q = n / d rounded to an integer with the given mode (d != 0); returns true if no rounding was needed
+static bool div_round(mpz_t q, const mpz_t n, const mpz_t d, DecimalRounding mode) {
+    mpz_t r; mpz_init(r);
+    mpz_tdiv_qr(q, r, n, d);
+    bool exact = mpz_sgn(r) == 0;
+    if (!exact) {
+        int sign = mpz_sgn(n) * mpz_sgn(d);
+        bool away = false;
+        if (mode == DR_UP) away = true;
+        else if (mode == DR_FLOOR) away = sign < 0;
+        else if (mode == DR_CEILING) away = sign > 0;
+        else if (mode == DR_HALF_UP || mode == DR_HALF_EVEN) {
+            mpz_abs(r, r); mpz_mul_2exp(r, r, 1);
+            int c = mpz_cmpabs(r, d);
+            away = c > 0 || (c == 0 && (mode == DR_HALF_UP || mpz_odd_p(q)));
+        }
+        if (away) { if (sign > 0) mpz_add_ui(q, q, 1); else mpz_sub_ui(q, q, 1); }
+    }
+    mpz_clear(r);
+    return exact;
+}
+
+// q = round(a / b * 10^digits) for exact a, b (b != 0)
+static bool exact_div_scaled(mpz_t q, const BigValue &a, const BigValue &b, unsigned long digits, DecimalRounding mode) {
+    mpz_t n, d; mpz_init(n); mpz_init(d);
+    load_scaled(n, a, exact_scale(a));
+    load_scaled(d, b, exact_scale(b));
+    mpz_t p; mpz_init(p);
+    mpz_ui_pow_ui(p, 10, exact_scale(b) + digits); mpz_mul(n, n, p);
+    mpz_ui_pow_ui(p, 10, exact_scale(a)); mpz_mul(d, d, p);
+    bool exact = div_round(q, n, d, mode);
+    mpz_clear(n); mpz_clear(d); mpz_clear(p);
+    return exact;
+}
+
+// exact value of v expressed in unit u, rounded to 'digits' fractional digits (u must be exact);
+// trailing zeros beyond min_digits are dropped
+static string exact_in_unit(const BigValue &v, const Unit &u, int digits, DecimalRounding mode, bool *exact = nullptr, int min_digits = -1) {
+    BigValue fac;
+    mpz_set(fac.i, u.dec_i);
+    set_exact_kind(fac, false, u.dec_scale);
+    mpz_t q; mpz_init(q);
+    bool ex = exact_div_scaled(q, v, fac, (unsigned long)digits, mode);
+    if (exact) *exact = ex;
+    while (min_digits >= 0 && digits > min_digits && mpz_divisible_ui_p(q, 10)) { mpz_divexact_ui(q, q, 10); --digits; }
+    string out = decimal_string(q, (unsigned long)digits) + " " + u.name;
+    mpz_clear(q);
+    return out;
+}
+
+static string repeating_decimal(const BigValue &v, const EvalConfig &cfg);
+
+// Display a result. Exact decimals with a dimension pick their display unit like to_human, but only one
+// the value converts to without rounding; otherwise they are printed exactly in SI units.
+static string format_value(const BigValue &v, const EvalConfig &cfg) {
+    if (v.is_list) {
+        string out = "[";
+        for (size_t k = 0; k < v.items.size(); ++k) out += (k ? ", " : "") + format_value(*v.items[k], cfg);
+        return out + "]";
+    }
+    if (v.is_rat && v.dim == Dimension()) return repeating_decimal(v, cfg);
+    if (v.is_dec && !(v.dim == Dimension()) && !cfg.prefer_si) {
+        long double approx = v.estimate_long_double();
+        int digits = max(cfg.decimal_digits, (int)v.dec_scale);
+        for (auto &u : UNIT_REG.units_with_dim(v.dim)) {
+            if (!u->exact) continue;
+            long double scaled = approx / mpfr_get_d(u->factor, MPFR_RNDN);
+            if (scaled < 0.1L || scaled >= 1000.0L) continue;
+            bool exact = false;
+            string out = exact_in_unit(v, *u, digits, cfg.decimal_rounding, &exact, max(cfg.decimal_digits, 0));
+            if (exact) return out;
+        }
+    }
+    return v.to_human(cfg.prefer_si);
+}
+
+// Unit of v's dimension whose factor equals v's value (to within rounding)
+static UnitPtr unit_with_factor(const BigValue &v) {
+    mpfr_t x, fac; mpfr_init2(x, DEFAULT_MPFR_PREC); mpfr_init2(fac, DEFAULT_MPFR_PREC);
+    load_mpfr(x, v);
+    UnitPtr found = nullptr;
+    for (auto &kv : UNIT_REG.table) {
+        if (!(kv.second->dim == v.dim)) continue;
+        kv.second->load_factor(fac);
+        mpfr_sub(fac, fac, x, MPFR_RNDN);
+        if (mpfr_zero_p(fac) || mpfr_get_exp(fac) < mpfr_get_exp(x) - (DEFAULT_MPFR_PREC - 16)) { found = kv.second; break; }
+    }
+    mpfr_clear(x); mpfr_clear(fac);
+    return found;
+}
+
+// 'a to unit': exact value (unit literals with exact factors included) over an exact factor is a rational,
+// printed exactly when its decimal expansion terminates; everything else divides in MPFR at the configured
+// precision (the factor itself correctly rounded to that precision). Inexact results show as many significant
+// digits as --precision carries.
+static string convert_to_unit(const BigValue &v, const Unit &u, const EvalConfig &cfg) {
+    mpfr_t r; mpfr_init2(r, cfg.mpfr_prec);
+    if (v.is_cplx) {
+        mpfr_t im, fac; mpfr_init2(im, cfg.mpfr_prec); mpfr_init2(fac, cfg.mpfr_prec);
+        u.load_factor(fac);
+        mpfr_div(r, v.f, fac, MPFR_RNDN); mpfr_div(im, v.im.get(), fac, MPFR_RNDN);
+        string out = "(" + BigValue::complex_string(r, im) + ") " + u.name;
+        mpfr_clear(r); mpfr_clear(im); mpfr_clear(fac);
+        return out;
+    }
+    if ((is_exact(v) || v.is_rat) && u.exact) {
+        mpq_t q, fq; mpq_init(q); mpq_init(fq);
+        if (v.is_dec) decimal_to_q(q, v.i, v.dec_scale);
+        else load_q(q, v);
+        u.factor_q(fq);
+        mpq_div(q, q, fq);
+        string exact;
+        bool done = terminating_decimal(q, exact);
+        if (!done) mpfr_set_q(r, q, MPFR_RNDN);
+        mpq_clear(q); mpq_clear(fq);
+        if (done) { mpfr_clear(r); return exact + " " + u.name; }
+    } else {
+        mpfr_t fac; mpfr_init2(fac, cfg.mpfr_prec);
+        load_mpfr(r, v);
+        u.load_factor(fac);
+        mpfr_div(r, r, fac, MPFR_RNDN);
+        mpfr_clear(fac);
+    }
+    int digits = (int)max(1.0, floor((cfg.mpfr_prec - 1) * log10(2.0)));
+    char *s = nullptr;
+    mpfr_asprintf(&s, "%.*Rg", digits, r);
+    string out = string(s) + " " + u.name;
+    mpfr_free_str(s);
+    mpfr_clear(r);
+    return out;
+}
+
+// Strength-reduced integer power. With base = 2^a * 5^b * m * 10^z and gcd(m, 10) = 1,
+// base^n = 10^((z + t) * n) * 2^((a - t) * n) * 5^((b - t) * n) * m^n where t = min(a, b):
+// the 10-power stays symbolic in z10, the 2-power is a shift and only m^n is a generic power,
+// so 2^n, 10^n, 1000^n and 12^n cost next to nothing. r may alias base.
+static void int_pow_reduced(BigValue &r, const BigValue &base, unsigned long n) {
+    if (mpz_sgn(base.i) == 0) {
+        mpz_set_ui(r.i, n == 0 ? 1 : 0);
+        r.z10 = 0; r.is_int = true; r.is_dec = false;
+        return;
+    }
+    unsigned long z = base.z10;
+    mpz_t m, five; mpz_init(m); mpz_init_set_ui(five, 5);
+    unsigned long a = mpz_scan1(base.i, 0);
+    mpz_tdiv_q_2exp(m, base.i, a);
+    unsigned long b = mpz_remove(m, m, five);
+    unsigned long t = min(a, b);
+    mpz_pow_ui(m, m, n);
+    if (b > t) {
+        mpz_ui_pow_ui(five, 5, (b - t) * n);
+        mpz_mul(m, m, five);
+    }
+    mpz_mul_2exp(r.i, m, (a - t) * n);
+    r.z10 = (z + t) * n;
+    r.is_int = true; r.is_dec = false;
+    mpz_clear(m); mpz_clear(five);
+}
+
+// ----------------- Prime sieve and prime counting -----------------
+// Segmented sieve of Eratosthenes over the odd numbers, one byte per odd number and one L1-sized segment
+// at a time. Each segment starts as a copy of a wheel pattern that already has the multiples of 3, 5, 7,
+// 11 and 13 removed, so only primes from 17 up are crossed off. A range is split into one contiguous
+// chunk per thread, and each thread carries its next-multiple offsets from segment to segment.
+// primepi() above PRIMEPI_SIEVE_MAX does not enumerate primes; it uses the combinatorial Legendre-sum count.
+static const size_t SIEVE_SEGMENT_BYTES = 32 * 1024;       // odd numbers per segment
+static const uint64_t SIEVE_MAX = 1ULL << 50;             // sieving primes stay below 2^25
+static const uint64_t PRIMEPI_SIEVE_MAX = 10000000;       // the Legendre-sum count wins above this
+static const uint64_t PRIMEPI_MAX = 100000000000000ULL;    // 1e14: tables of ~2 * 10^7 entries
+static const uint64_t NTHPRIME_MAX = 3000000000000ULL;     // p_k stays below PRIMEPI_MAX
+static const size_t MAX_LIST_PRIMES = 100000;             // primes(a, b) result size
+static const uint64_t PARALLEL_MIN_ITEMS = 1 << 16;       // per thread, below this threads do not pay
+static const unsigned WHEEL_PRIMES[] = { 3, 5, 7, 11, 13 };
+static const size_t WHEEL_PERIOD = 3 * 5 * 7 * 11 * 13;   // in odd numbers
+
+static unsigned worker_threads() { return max(1u, thread::hardware_concurrency()); }
+
+// fn(i) for i in [begin, end), split across threads when each would get at least min_items items. The first
+// exception a worker throws stops the other workers' remaining items and is rethrown after the join.
+template <class F>
+static void parallel_range(uint64_t begin, uint64_t end, F &&fn, uint64_t min_items = PARALLEL_MIN_ITEMS) {
+    uint64_t n = end > begin ? end - begin : 0;
+    unsigned t = (unsigned)min<uint64_t>(worker_threads(), n / max<uint64_t>(1, min_items));
+    if (t <= 1) { for (uint64_t i = begin; i < end; ++i) fn(i); return; }
+    vector<thread> workers;
+    // workers start from the caller's CPU time and live bytes (the baselines of the quota checks) and add
+    // what they used on top of them to the calling thread: CPU time and live bytes summed, and the sum of
+    // their peaks on top of the caller's live bytes, as they may all peak at once
+    long long cpu0 = thread_cpu_ns(), live0 = gmp_live_bytes;
+    atomic<long long> cpu{0}, live{0}, peak{0};
+    exception_ptr error;
+    mutex error_mu;
+    atomic<bool> failed{false};
+    for (unsigned c = 0; c < t; ++c) {
+        workers.emplace_back([&, c] {
+            worker_cpu_ns = cpu0;
+            gmp_live_bytes = gmp_peak_bytes = live0;
+            try {
+                for (uint64_t i = begin + n * c / t, e = begin + n * (c + 1) / t; i < e && !failed; ++i) fn(i);
+            } catch (...) {
+                lock_guard<mutex> lock(error_mu);
+                if (!error) error = current_exception();
+                failed = true;
+            }
+            cpu += thread_cpu_ns() - cpu0;
+            live += gmp_live_bytes - live0;
+            peak += gmp_peak_bytes - live0;
+        });
+    }
+    for (auto &w : workers) w.join();
+    worker_cpu_ns += cpu;
+    gmp_peak_bytes = max(gmp_peak_bytes, gmp_live_bytes + peak);
+    gmp_live_bytes += live;
+    if (error) rethrow_exception(error);
+}
+
+static uint64_t isqrt_u64(uint64_t n) {
+    uint64_t r = (uint64_t)sqrtl((long double)n);
+    while (r * r > n) --r;
+    while ((r + 1) * (r + 1) <= n) ++r;
+    return r;
+}
+
+// wheel[k] != 0 iff 2k + 1 has no factor among WHEEL_PRIMES
+static const vector<uint8_t> &wheel_pattern() {
+    static const vector<uint8_t> pattern = [] {
+        vector<uint8_t> w(WHEEL_PERIOD, 1);
+        for (unsigned p : WHEEL_PRIMES)
+            for (size_t k = p / 2; k < WHEEL_PERIOD; k += p) w[k] = 0;
+        return w;
+    }();
+    return pattern;
+}
+
+static shared_ptr<const vector<uint32_t>> primes_upto(uint64_t limit, const EvalConfig &cfg);
+
+// Sieves the odd numbers in [lo, hi] (both odd, lo >= 3, hi <= SIEVE_MAX). visit(chunk, first, flags, n) sees
+// the segments of each chunk in increasing order; flags[k] != 0 iff first + 2k is prime. Chunks run on their
+// own threads, so visit must only touch per-chunk state; returning false stops that chunk.
+template <class Visit>
+static void sieve_odd_range(uint64_t lo, uint64_t hi, unsigned chunks, const EvalConfig &cfg, Visit &&visit) {
+    auto base = primes_upto(isqrt_u64(hi), cfg);
+    size_t first_sieving = upper_bound(base->begin(), base->end(), 13u) - base->begin();
+    const vector<uint8_t> &wheel = wheel_pattern();
+    uint64_t odds = (hi - lo) / 2 + 1;
+    uint64_t per_chunk = (odds + chunks - 1) / chunks;
+    atomic<bool> timed_out{false};
+    auto work = [&](unsigned c) {
+        uint64_t k0 = (uint64_t)c * per_chunk, k1 = min(odds, k0 + per_chunk);
+        if (k0 >= k1) return;
+        vector<uint8_t> seg(SIEVE_SEGMENT_BYTES);
+        vector<uint64_t> next; // per sieving prime: odd index (from lo) of the next multiple to cross off
+        uint64_t chunk_first = lo + 2 * k0;
+        for (size_t j = first_sieving; j < base->size(); ++j) {
+            uint64_t p = (*base)[j];
+            uint64_t m = max(p * p, (chunk_first + p - 1) / p * p);
+            if (m % 2 == 0) m += p;
+            next.push_back((m - lo) / 2);
+        }
+        for (uint64_t s0 = k0; s0 < k1; s0 += SIEVE_SEGMENT_BYTES) {
+            if (timed_out || limit_exceeded(cfg)) { timed_out = true; return; }
+            size_t n = (size_t)min<uint64_t>(SIEVE_SEGMENT_BYTES, k1 - s0);
+            uint64_t first = lo + 2 * s0, last = first + 2 * (n - 1);
+            // odd number 2q + 1 is wheel[q % WHEEL_PERIOD]
+            for (size_t done = 0, q = (size_t)((first / 2) % WHEEL_PERIOD); done < n; q = 0) {
+                size_t take = min(n - done, WHEEL_PERIOD - q);
+                memcpy(seg.data() + done, wheel.data() + q, take);
+                done += take;
+            }
+            for (unsigned p : WHEEL_PRIMES) if (p >= first && p <= last) seg[(p - first) / 2] = 1;
+            for (size_t j = 0; j < next.size(); ++j) {
+                uint64_t p = (*base)[first_sieving + j];
+                if (p * p > last) break;
+                uint64_t k = next[j];
+                for (uint64_t end = s0 + n; k < end; k += p) seg[k - s0] = 0;
+                next[j] = k;
+            }
+            if (!visit(c, first, (const uint8_t *)seg.data(), n)) return;
+        }
+    };
+    parallel_range(0, chunks, [&](uint64_t c) { work((unsigned)c); }, 1);
+    if (timed_out) throw_limit_exceeded(cfg);
+}
+
+static unsigned sieve_chunks(uint64_t lo, uint64_t hi) {
+    uint64_t segments = (hi - lo) / 2 / SIEVE_SEGMENT_BYTES + 1;
+    return (unsigned)min<uint64_t>(worker_threads(), max<uint64_t>(1, segments / 4));
+}
+
+// primes in [lo, hi], at most max_count of them (throws beyond that)
+static vector<uint64_t> list_primes(uint64_t lo, uint64_t hi, size_t max_count, const EvalConfig &cfg) {
+    vector<uint64_t> out;
+    if (lo <= 2 && hi >= 2) out.push_back(2);
+    uint64_t a = max<uint64_t>(lo, 3) | 1, b = hi % 2 ? hi : hi - 1;
+    if (hi < 3 || a > b) return out;
+    unsigned chunks = sieve_chunks(a, b);
+    vector<vector<uint64_t>> found(chunks);
+    sieve_odd_range(a, b, chunks, cfg, [&](unsigned c, uint64_t first, const uint8_t *flags, size_t n) {
+        for (size_t k = 0; k < n; ++k) if (flags[k]) found[c].push_back(first + 2 * k);
+        return found[c].size() <= max_count;
+    });
+    for (auto &f : found) {
+        if (out.size() + f.size() > max_count) throw runtime_error("more than " + to_string(max_count) + " primes in range");
+        out.insert(out.end(), f.begin(), f.end());
+    }
+    return out;
+}
+
+static uint64_t count_primes(uint64_t lo, uint64_t hi, const EvalConfig &cfg) {
+    uint64_t total = lo <= 2 && hi >= 2;
+    uint64_t a = max<uint64_t>(lo, 3) | 1, b = hi % 2 ? hi : hi - 1;
+    if (hi < 3 || a > b) return total;
+    unsigned chunks = sieve_chunks(a, b);
+    vector<uint64_t> counts(chunks);
+    sieve_odd_range(a, b, chunks, cfg, [&](unsigned c, uint64_t, const uint8_t *flags, size_t n) {
+        uint64_t k = 0;
+        for (size_t j = 0; j < n; ++j) k += flags[j];
+        counts[c] += k;
+        return true;
+    });
+    for (uint64_t k : counts) total += k;
+    return total;
+}
+
+// All primes up to limit (< 2^32), shared and cached: they are the sieving primes of every later range.
+static mutex BASE_PRIMES_MUTEX;
+static shared_ptr<const vector<uint32_t>> BASE_PRIMES = make_shared<const vector<uint32_t>>();
+static uint64_t BASE_PRIMES_LIMIT = 0;
+
+static shared_ptr<const vector<uint32_t>> primes_upto(uint64_t limit, const EvalConfig &cfg) {
+    {
+        lock_guard<mutex> lock(BASE_PRIMES_MUTEX);
+        if (BASE_PRIMES_LIMIT >= limit) return BASE_PRIMES;
+    }
+    limit = max<uint64_t>(limit, 1 << 16);
+    auto ps = make_shared<vector<uint32_t>>();
+    if (limit < (1 << 22)) {
+        // plain odd-only sieve; also the base case of the segmented one
+        vector<uint8_t> odd(limit / 2 + 1, 1); // odd[k]: 2k + 1
+        for (uint64_t k = 1; (2 * k + 1) * (2 * k + 1) <= limit; ++k)
+            if (odd[k]) for (uint64_t m = (2 * k + 1) * (2 * k + 1) / 2; m < odd.size(); m += 2 * k + 1) odd[m] = 0;
+        ps->push_back(2);
+        for (uint64_t k = 1; 2 * k + 1 <= limit; ++k) if (odd[k]) ps->push_back((uint32_t)(2 * k + 1));
+    } else {
+        for (uint64_t p : list_primes(2, limit, SIZE_MAX, cfg)) ps->push_back((uint32_t)p);
+    }
+    lock_guard<mutex> lock(BASE_PRIMES_MUTEX);
+    if (BASE_PRIMES_LIMIT < limit) { BASE_PRIMES = ps; BASE_PRIMES_LIMIT = limit; }
+    return BASE_PRIMES;
+}
+
+// pi(n) by Lucy's Legendre-sum recurrence over the O(sqrt n) distinct values v = n / i. S(v) counts
+// 2..v after sieving by the primes below p, and crossing off a prime p updates every v >= p^2 by
+// S(v) -= S(v / p) - S(p - 1). Total work is O(n^(3/4)). Within one round, an update only reads entries
+// that are further along in that round's order, so blocks whose reads fall outside themselves run in parallel.
+static uint64_t prime_pi_legendre(uint64_t n, const EvalConfig &cfg) {
+    uint64_t r = isqrt_u64(n);
+    vector<uint64_t> large(r + 1); // large[i] = S(n / i)
+    vector<uint32_t> small(r + 1); // small[k] = S(k)
+    for (uint64_t i = 1; i <= r; ++i) large[i] = n / i - 1;
+    for (uint64_t k = 1; k <= r; ++k) small[k] = (uint32_t)(k - 1);
+    for (uint64_t p = 2; p <= r; ++p) {
+        if (small[p] == small[p - 1]) continue; // p is composite
+        check_deadline(cfg);
+        uint64_t below = small[p - 1], p2 = p * p;
+        // large values, i ascending: large[i] reads large[i * p] or small[.], never an index in [i, i * p)
+        uint64_t imax = min(r, n / p2);
+        for (uint64_t b = 1; b <= imax; b *= p) {
+            uint64_t e = min(imax + 1, b * p);
+            parallel_range(b, e, [&](uint64_t i) {
+                uint64_t d = i * p;
+                large[i] -= (d <= r ? large[d] : small[n / d]) - below;
+            });
+        }
+        // small values, k descending: small[k] reads small[k / p], below the block
+        for (uint64_t e = r; e >= p2; ) {
+            uint64_t b = max(p2, e / p + 1);
+            parallel_range(b, e + 1, [&](uint64_t k) { small[k] -= small[k / p] - (uint32_t)below; });
+            e = b - 1;
+        }
+    }
+    return large[1];
+}
+
+static uint64_t prime_pi(uint64_t n, const EvalConfig &cfg) {
+    if (n > PRIMEPI_MAX) throw runtime_error("primepi() argument is too large (max " + to_string(PRIMEPI_MAX) + ")");
+    return n <= PRIMEPI_SIEVE_MAX ? count_primes(2, n, cfg) : prime_pi_legendre(n, cfg);
+}
+
+// k-th prime (k >= 1): Cipolla's estimate, one correction step with pi(x), then a sieve walk over the gap
+static uint64_t nth_prime(uint64_t k, const EvalConfig &cfg) {
+    static const uint64_t first[] = { 2, 3, 5, 7, 11, 13 };
+    if (k <= 6) return first[k - 1];
+    long double lk = logl((long double)k), llk = logl(lk);
+    long double est = max((long double)k, k * (lk + llk - 1 + (llk - 2) / lk - (llk * llk - 6 * llk + 11) / (2 * lk * lk)));
+    uint64_t x = (uint64_t)est;
+    long double c0 = (long double)prime_pi(x, cfg);
+    x = (uint64_t)max(2.0L, est + ((long double)k - c0) * logl(est));
+    uint64_t c = prime_pi(x, cfg); // primes <= x
+    const uint64_t window = 1 << 22;
+    if (c < k) {
+        for (uint64_t lo = x + 1;; lo += window) {
+            uint64_t m = count_primes(lo, lo + window - 1, cfg);
+            if (c + m >= k) return list_primes(lo, lo + window - 1, SIZE_MAX, cfg)[k - c - 1];
+            c += m;
+        }
+    }
+    for (uint64_t hi = x;; ) {
+        uint64_t lo = hi > window ? hi - window + 1 : 2;
+        uint64_t m = count_primes(lo, hi, cfg);
+        if (c - m < k) return list_primes(lo, hi, SIZE_MAX, cfg)[k - (c - m) - 1];
+        c -= m;
+        hi = lo - 1;
+    }
+}
+
+// ----------------- Built-in functions -----------------
+static ValuePtr int_result(uint64_t x) {
+    auto v = make_shared<BigValue>();
+    mpz_set_ui(v->i, x);
+    return v;
+}
+
+static ValuePtr list_result(vector<ValuePtr> items) {
+    auto v = make_shared<BigValue>();
+    v->is_int = false;
+    v->is_list = true;
+    v->items = move(items);
+    return v;
+}
+
+// Exact integer value of a number; integral MPFR and decimal values count (1e9 is a float literal).
+// False for lists and non-integers. Callers bound the size first.
+static bool integer_value(const BigValue &v, mpz_t out) {
+    if (v.is_list || v.is_rat || v.is_cplx) return false;
+    if (v.is_int) {
+        load_scaled(out, v, 0);
+        return true;
+    }
+    if (v.is_dec) {
+        mpz_t p; mpz_init(p);
+        mpz_ui_pow_ui(p, 10, v.dec_scale);
+        bool integral = mpz_divisible_p(v.i, p);
+        if (integral) mpz_divexact(out, v.i, p);
+        mpz_clear(p);
+        return integral;
+    }
+    if (!mpfr_integer_p(v.f)) return false;
+    mpfr_get_z(out, v.f, MPFR_RNDN);
+    return true;
+}
+
+// Sign of a real value (0 for lists and complex values)
+static int real_sign(const BigValue &v) {
+    if (v.is_list || v.is_cplx) return 0;
+    if (v.is_int || v.is_dec) return mpz_sgn(v.i);
+    if (v.is_rat) return mpq_sgn(v.q);
+    return mpfr_sgn(v.f);
+}
+
+static bool is_real_integer(const BigValue &v) {
+    if (v.is_list || v.is_cplx || v.is_rat) return false;
+    if (v.is_int) return true;
+    if (!v.is_dec) return mpfr_integer_p(v.f);
+    mpz_t z; mpz_init(z);
+    bool integral = integer_value(v, z);
+    mpz_clear(z);
+    return integral;
+}
+
+// A real integer that fits an int, into k
+static bool small_integer(const BigValue &v, long &k) {
+    if (v.is_list || v.is_cplx || v.estimate_log10() > 10) return false;
+    mpz_t z; mpz_init(z);
+    bool ok = integer_value(v, z) && mpz_fits_sint_p(z);
+    if (ok) k = mpz_get_si(z);
+    mpz_clear(z);
+    return ok;
+}
+
+static bool has_complex(const BigValue &v) {
+    if (v.is_cplx) return true;
+    for (const auto &item : v.items) if (has_complex(*item)) return true;
+    return false;
+}
+
+// Exact non-negative integer argument of a built-in, at most max_value
+static uint64_t u64_arg(const BigValue &v, const string &fname, uint64_t max_value) {
+    if (v.is_list) throw runtime_error(fname + "() expects a number, not a list");
+    if (v.estimate_log10() >= 20) throw runtime_error(fname + "() argument is too large (max " + to_string(max_value) + ")");
+    mpz_t z; mpz_init(z);
+    bool ok = integer_value(v, z) && mpz_sgn(z) >= 0, fits = mpz_cmp_ui(z, max_value) <= 0;
+    uint64_t out = ok && fits ? mpz_get_ui(z) : 0;
+    mpz_clear(z);
+    if (!ok) throw runtime_error(fname + "() expects a non-negative integer");
+    if (!fits) throw runtime_error(fname + "() argument is too large (max " + to_string(max_value) + ")");
+    return out;
+}
+
+// Exact integer argument of any sign and size up to cfg.max_digits digits
+static void mpz_arg(mpz_t out, const BigValue &v, const string &fname, const EvalConfig &cfg) {
+    if (v.is_list) throw runtime_error(fname + "() expects a number, not a list");
+    if (v.estimate_log10() > cfg.max_digits) throw runtime_error(fname + "() argument is too large");
+    if (!integer_value(v, out)) throw runtime_error(fname + "() expects integer arguments");
+}
+
+// List of dimensionless numbers
+static const vector<ValuePtr> &list_arg(const BigValue &v, const string &fname) {
+    if (!v.is_list) throw runtime_error(fname + "() expects a list [a, b, ...]");
+    for (auto &x : v.items)
+        if (x->is_list || !(x->dim == Dimension())) throw runtime_error(fname + "() expects a list of dimensionless numbers");
+    return v.items;
+}
+
+static ValuePtr mpz_result(mpz_srcptr z) {
+    auto v = make_shared<BigValue>();
+    mpz_set(v->i, z);
+    return v;
+}
+
+// p/q (q != 0) as an exact fraction, reduced; an integer when q divides p
+static ValuePtr rational_result(mpz_srcptr p, mpz_srcptr q, const EvalConfig &cfg) {
+    auto v = make_shared<BigValue>();
+    mpq_t x; mpq_init(x);
+    mpz_set(mpq_numref(x), p); mpz_set(mpq_denref(x), q);
+    mpq_canonicalize(x);
+    set_rational(*v, x, cfg.mpfr_prec);
+    mpq_clear(x);
+    return v;
+}
+
+// Owning vector of GMP integers
+struct MpzVector {
+    vector<__mpz_struct> z;
+    MpzVector() {}
+    explicit MpzVector(size_t n) : z(n) { for (auto &x : z) mpz_init(&x); }
+    MpzVector(MpzVector &&o) noexcept : z(move(o.z)) {}
+    MpzVector &operator=(MpzVector &&o) noexcept { swap(z, o.z); return *this; }
+    ~MpzVector() { for (auto &x : z) mpz_clear(&x); }
+    mpz_ptr operator[](size_t k) { return &z[k]; }
+    mpz_srcptr operator[](size_t k) const { return &z[k]; }
+    size_t size() const { return z.size(); }
+    void push_back(mpz_srcptr x) { z.emplace_back(); mpz_init_set(&z.back(), x); }
+    void pop_back() { mpz_clear(&z.back()); z.pop_back(); }
+};
+
+static ValuePtr fn_primepi(const vector<ValuePtr> &args, const EvalConfig &cfg) {
+    return int_result(prime_pi(u64_arg(*args[0], "primepi", PRIMEPI_MAX), cfg));
+}
+
+static ValuePtr fn_nthprime(const vector<ValuePtr> &args, const EvalConfig &cfg) {
+    uint64_t k = u64_arg(*args[0], "nthprime", NTHPRIME_MAX);
+    if (k == 0) throw runtime_error("nthprime() counts from 1");
+    return int_result(nth_prime(k, cfg));
+}
+
+static ValuePtr fn_primes(const vector<ValuePtr> &args, const EvalConfig &cfg) {
+    uint64_t lo = u64_arg(*args[0], "primes", SIEVE_MAX), hi = u64_arg(*args[1], "primes", SIEVE_MAX);
+    vector<ValuePtr> items;
+    if (lo <= hi) for (uint64_t p : list_primes(lo, hi, MAX_LIST_PRIMES, cfg)) items.push_back(int_result(p));
+    return list_result(move(items));
+}
+
+static shared_ptr<BigValue> mpfr_result(const EvalConfig &cfg) {
+    auto v = make_shared<BigValue>();
+    v->is_int = false;
+    mpfr_set_prec(v->f, cfg.mpfr_prec);
+    return v;
+}
+
+static ValuePtr complex_sqrt(const BigValue &x, const EvalConfig &cfg);
+static ValuePtr complex_exp(const BigValue &x, const EvalConfig &cfg);
+
+// exact for perfect squares; complex for negative and complex arguments
+static ValuePtr fn_sqrt(const vector<ValuePtr> &args, const EvalConfig &cfg) {
+    const BigValue &x = *args[0];
+    if (x.is_list) throw runtime_error("sqrt() expects a number, not a list");
+    if (x.is_cplx || real_sign(x) < 0) return complex_sqrt(x, cfg);
+    if (x.is_int && mpz_sgn(x.i) >= 0 && x.z10 % 2 == 0 && mpz_perfect_square_p(x.i)) {
+        auto v = make_shared<BigValue>();
+        mpz_sqrt(v->i, x.i);
+        v->z10 = x.z10 / 2;
+        return v;
+    }
+    auto v = mpfr_result(cfg);
+    load_mpfr(v->f, x);
+    mpfr_sqrt(v->f, v->f, MPFR_RNDN);
+    return v;
+}
+
+static ValuePtr fn_exp(const vector<ValuePtr> &args, const EvalConfig &cfg) {
+    if (args[0]->is_list) throw runtime_error("exp() expects a number, not a list");
+    if (args[0]->is_cplx) return complex_exp(*args[0], cfg);
+    auto v = mpfr_result(cfg);
+    load_mpfr(v->f, *args[0]);
+    mpfr_exp(v->f, v->f, MPFR_RNDN);
+    if (mpfr_inf_p(v->f)) throw runtime_error("exp() overflows");
+    return v;
+}
+
+static ValuePtr fn_list(const vector<ValuePtr> &args, const EvalConfig &) {
+    return list_result(args);
+}
+
+// ----- linear recurrences: rec([c1..ck], [a0..a(k-1)], n [, m]) -----
+// a_n = c1 a_(n-1) + ... + ck a_(n-k) by Fiduccia's method: r(x) = x^n mod P(x) with
+// P(x) = x^k - c1 x^(k-1) - ... - ck by square-and-multiply, then a_n = sum r_j a_j. That is O(k^2 log n)
+// exact GMP work, or O(k^2 log n) small products with the optional modulus m. Every output coefficient of a
+// product and of its reduction is independent, so for large k they are split across threads. Reduction
+// uses the precomputed rows high[t] = x^(k+t) mod P.
+static const size_t MAX_REC_ORDER = 2000; // the reduction table holds k^2 integers
+
+static void rec_mod(mpz_ptr z, mpz_srcptr m) { if (m) mpz_mod(z, z, m); }
+
+// r = r * x mod P
+static void rec_shift(MpzVector &r, const MpzVector &xk, mpz_srcptr m) {
+    size_t k = r.size();
+    mpz_t top; mpz_init_set(top, r[k - 1]);
+    for (size_t j = k - 1; j > 0; --j) mpz_swap(r[j], r[j - 1]);
+    mpz_set_ui(r[0], 0);
+    for (size_t j = 0; j < k; ++j) { mpz_addmul(r[j], top, xk[j]); rec_mod(r[j], m); }
+    mpz_clear(top);
+}
+
+// r * r mod P
+static MpzVector rec_square(const MpzVector &r, const vector<MpzVector> &high, mpz_srcptr m) {
+    size_t k = r.size();
+    uint64_t grain = max<uint64_t>(1, PARALLEL_MIN_ITEMS / k);
+    MpzVector prod(2 * k - 1);
+    parallel_range(0, 2 * k - 1, [&](uint64_t j) {
+        for (size_t i = j >= k ? j - k + 1 : 0; i < j - i; ++i) mpz_addmul(prod[j], r[i], r[j - i]);
+        mpz_mul_2exp(prod[j], prod[j], 1);
+        if (j % 2 == 0) mpz_addmul(prod[j], r[j / 2], r[j / 2]);
+        rec_mod(prod[j], m);
+    }, grain);
+    MpzVector out(k);
+    parallel_range(0, k, [&](uint64_t j) {
+        mpz_set(out[j], prod[j]);
+        for (size_t t = 0; t + 1 < k; ++t) mpz_addmul(out[j], prod[k + t], high[t][j]);
+        rec_mod(out[j], m);
+    }, grain);
+    return out;
+}
+
+static void linear_recurrence(mpz_t out, const MpzVector &c, const MpzVector &a, uint64_t n, mpz_srcptr m, const EvalConfig &cfg) {
+    size_t k = c.size();
+    if (n < k) { mpz_set(out, a[n]); rec_mod(out, m); return; }
+    vector<MpzVector> high;
+    high.emplace_back(k);
+    for (size_t j = 0; j < k; ++j) { mpz_set(high[0][j], c[k - 1 - j]); rec_mod(high[0][j], m); }
+    for (size_t t = 1; t + 1 < k; ++t) {
+        high.emplace_back(k);
+        for (size_t j = 0; j < k; ++j) mpz_set(high[t][j], high[t - 1][j]);
+        rec_shift(high[t], high[0], m);
+    }
+    MpzVector r(k);
+    mpz_set_ui(r[0], 1);
+    for (int bit = 63 - __builtin_clzll(n); bit >= 0; --bit) {
+        check_deadline(cfg);
+        r = rec_square(r, high, m);
+        if ((n >> bit) & 1) rec_shift(r, high[0], m);
+    }
+    mpz_set_ui(out, 0);
+    for (size_t j = 0; j < k; ++j) mpz_addmul(out, r[j], a[j]);
+    rec_mod(out, m);
+}
+
+static ValuePtr fn_rec(const vector<ValuePtr> &args, const EvalConfig &cfg) {
+    const vector<ValuePtr> &cs = list_arg(*args[0], "rec"), &as = list_arg(*args[1], "rec");
+    size_t k = cs.size();
+    if (k == 0 || as.size() != k) throw runtime_error("rec() needs k coefficients and k initial terms, k >= 1");
+    if (k > MAX_REC_ORDER) throw runtime_error("rec() order is too large (max " + to_string(MAX_REC_ORDER) + ")");
+    uint64_t n = u64_arg(*args[2], "rec", UINT64_MAX);
+    MpzVector c(k), a(k), m(1);
+    for (size_t j = 0; j < k; ++j) { mpz_arg(c[j], *cs[j], "rec", cfg); mpz_arg(a[j], *as[j], "rec", cfg); }
+    bool has_mod = args.size() == 4;
+    if (has_mod) {
+        mpz_arg(m[0], *args[3], "rec", cfg);
+        if (mpz_sgn(m[0]) <= 0) throw runtime_error("rec() modulus must be positive");
+    } else {
+        // |a_n| <= max|a| * max(1, sum|c|)^n * n^k: refuse results far beyond max_digits instead of running out of memory
+        long double csum = 0, amax = 0;
+        for (size_t j = 0; j < k; ++j) {
+            long e; double d = mpz_get_d_2exp(&e, c[j]);
+            csum += fabsl(ldexpl(d, e));
+            d = mpz_get_d_2exp(&e, a[j]);
+            amax = max(amax, log10l(fabsl(d) + 1) + e * log10l(2.0L));
+        }
+        long double digits = n * log10l(max(1.0L, csum)) + amax + k * log10l((long double)n + 1);
+        if (digits > cfg.max_digits)
+            throw runtime_error("rec() result could have about " + to_string((unsigned long long)min(digits, 1e18L)) +
+                                " digits (max " + to_string((long long)cfg.max_digits) + "); pass a modulus as the 4th argument");
+    }
+    mpz_t out; mpz_init(out);
+    linear_recurrence(out, c, a, n, has_mod ? m[0] : nullptr, cfg);
+    ValuePtr v = mpz_result(out);
+    mpz_clear(out);
+    return v;
+}
+
+// ----- roots(p): all complex roots of a dense polynomial, coefficients highest degree first -----
+// Simultaneous Aberth-Ehrlich iteration moves every estimate z_i by
+//   w_i = N_i / (1 - N_i * sum_(j != i) 1 / (z_i - z_j)),  N_i = p(z_i) / p'(z_i),
+// converging cubically to simple roots from a circle of starting points. A long double pass finds all roots
+// cheaply; an MPFR pass then polishes them, each root at its own precision: target + guard bits plus log2 of
+// its condition number sum|a_k||z|^k / (|z| |p'(z)|), re-estimated after every round, so only clustered and
+// multiple roots pay for extra bits. One iteration only reads the previous estimates, so it splits across
+// threads by root.
+static const size_t MAX_ROOTS_DEGREE = 2000;
+static const int ROOTS_GUARD_BITS = 32;
+static const int ROOTS_MAX_ITERATIONS = 500;
+static const int ROOTS_MPFR_ITERATIONS = 100;
+static const int ROOTS_PREC_ROUNDS = 8;
+static const int ROOTS_MAX_PREC_FACTOR = 8; // a cluster of m roots needs about m times the target precision
+
+typedef complex<long double> cld;
+
+// p(z) / p'(z) for p = a[0] z^n + ... + a[n]; outside the unit disc through the reversed polynomial q(y) = y^n p(1/y)
+// so that z^n cannot overflow: p(z) = z^n q(y), p'(z) = z^(n-1) (n q(y) - y q'(y)) with y = 1/z
+static cld newton_ratio(const vector<long double> &a, cld z) {
+    size_t n = a.size() - 1;
+    if (abs(z) <= 1) {
+        cld p = a[0], d = 0;
+        for (size_t k = 1; k <= n; ++k) { d = d * z + p; p = p * z + a[k]; }
+        return p / d;
+    }
+    cld y = 1.0L / z, q = a[n], dq = 0;
+    for (size_t k = n; k-- > 0;) { dq = dq * y + q; q = q * y + a[k]; }
+    return z * q / ((long double)n * q - y * dq);
+}
+
+static vector<cld> aberth_long_double(const vector<long double> &a, const EvalConfig &cfg) {
+    size_t n = a.size() - 1;
+    // start on a circle around the centroid of the roots with the Fujiwara radius, rotated off the real axis
+    cld centre = -a[1] / ((long double)n * a[0]);
+    long double radius = 0;
+    for (size_t k = 1; k <= n; ++k) radius = max(radius, powl(fabsl(a[k] / a[0]), 1.0L / k));
+    radius = max(radius, LDBL_MIN);
+    vector<cld> z(n), next(n);
+    for (size_t i = 0; i < n; ++i) z[i] = centre + polar(radius, 2 * (long double)M_PI * i / n + 0.4L);
+    vector<char> done(n, 0);
+    uint64_t grain = max<uint64_t>(1, PARALLEL_MIN_ITEMS / n);
+    for (int it = 0; it < ROOTS_MAX_ITERATIONS; ++it) {
+        check_deadline(cfg);
+        atomic<size_t> moving{0};
+        parallel_range(0, n, [&](uint64_t i) {
+            next[i] = z[i];
+            if (done[i]) return;
+            cld ratio = newton_ratio(a, z[i]), s = 0;
+            for (size_t j = 0; j < n; ++j)
+                if (j != i) s += 1.0L / (z[i] - z[j]);
+            cld w = ratio / (1.0L - ratio * s);
+            if (!isfinite(w.real()) || !isfinite(w.imag())) w = z[i] * 1e-9L + cld(0, 1e-9L); // on a critical point or a collision
+            next[i] = z[i] - w;
+            if (abs(w) <= 4 * LDBL_EPSILON * abs(z[i])) done[i] = 1;
+            else moving++;
+        }, grain);
+        swap(z, next);
+        if (!moving) break;
+    }
+    return z;
+}
+
+// Complex number as a pair of MPFR reals, with the few operations the polishing pass needs. Results are
+// rounded to the destination's precision; destinations may alias operands.
+struct MpfrComplex {
+    mpfr_t re, im;
+    explicit MpfrComplex(mpfr_prec_t prec) {
+        mpfr_init2(re, prec); mpfr_init2(im, prec);
+        mpfr_set_zero(re, 1); mpfr_set_zero(im, 1);
+    }
+    MpfrComplex(const MpfrComplex &) = delete;
+    MpfrComplex &operator=(const MpfrComplex &) = delete;
+    ~MpfrComplex() { mpfr_clear(re); mpfr_clear(im); }
+    mpfr_prec_t prec() const { return mpfr_get_prec(re); }
+    void set_prec(mpfr_prec_t p) { mpfr_prec_round(re, p, MPFR_RNDN); mpfr_prec_round(im, p, MPFR_RNDN); }
+    void set(const MpfrComplex &o) { mpfr_set(re, o.re, MPFR_RNDN); mpfr_set(im, o.im, MPFR_RNDN); }
+    void add(const MpfrComplex &x, const MpfrComplex &y) { mpfr_add(re, x.re, y.re, MPFR_RNDN); mpfr_add(im, x.im, y.im, MPFR_RNDN); }
+    void sub(const MpfrComplex &x, const MpfrComplex &y) { mpfr_sub(re, x.re, y.re, MPFR_RNDN); mpfr_sub(im, x.im, y.im, MPFR_RNDN); }
+    void mul(const MpfrComplex &x, const MpfrComplex &y) {
+        mpfr_t r, i, t; mpfr_init2(r, prec()); mpfr_init2(i, prec()); mpfr_init2(t, prec());
+        mpfr_mul(t, x.im, y.im, MPFR_RNDN); mpfr_fms(r, x.re, y.re, t, MPFR_RNDN);
+        mpfr_mul(t, x.im, y.re, MPFR_RNDN); mpfr_fma(i, x.re, y.im, t, MPFR_RNDN);
+        mpfr_swap(re, r); mpfr_swap(im, i);
+        mpfr_clear(r); mpfr_clear(i); mpfr_clear(t);
+    }
+    void div(const MpfrComplex &x, const MpfrComplex &y) {
+        mpfr_t d, r, t; mpfr_init2(d, prec()); mpfr_init2(r, prec()); mpfr_init2(t, prec());
+        mpfr_mul(d, y.re, y.re, MPFR_RNDN); mpfr_fma(d, y.im, y.im, d, MPFR_RNDN);
+        mpfr_mul(r, x.re, y.re, MPFR_RNDN); mpfr_fma(r, x.im, y.im, r, MPFR_RNDN);
+        mpfr_mul(t, x.im, y.re, MPFR_RNDN); mpfr_fms(t, x.re, y.im, t, MPFR_RNDN); // x.re y.im - x.im y.re
+        mpfr_div(re, r, d, MPFR_RNDN);
+        mpfr_div(im, t, d, MPFR_RNDN); mpfr_neg(im, im, MPFR_RNDN);
+        mpfr_clear(d); mpfr_clear(r); mpfr_clear(t);
+    }
+    void abs(mpfr_t out) const { mpfr_hypot(out, re, im, MPFR_RNDN); }
+};
+
+// One MPFR Aberth update of root i at its own precision; true once the correction is below that precision
+static bool aberth_mpfr_step(const vector<MpfrComplex *> &z, size_t i, MpfrComplex &out, const vector<mpfr_ptr> &a) {
+    mpfr_prec_t prec = z[i]->prec();
+    size_t n = z.size();
+    MpfrComplex p(prec), d(prec), s(prec), t(prec), one(prec);
+    mpfr_set(p.re, a[0], MPFR_RNDN);
+    for (size_t k = 1; k <= n; ++k) {
+        d.mul(d, *z[i]); mpfr_add(d.re, d.re, p.re, MPFR_RNDN); mpfr_add(d.im, d.im, p.im, MPFR_RNDN);
+        p.mul(p, *z[i]); mpfr_add(p.re, p.re, a[k], MPFR_RNDN);
+    }
+    out.set(*z[i]);
+    if (mpfr_zero_p(p.re) && mpfr_zero_p(p.im)) return true;
+    if (mpfr_zero_p(d.re) && mpfr_zero_p(d.im)) return false; // leave a critical point to the neighbours' pull
+    p.div(p, d); // Newton ratio N
+    mpfr_set_ui(one.re, 1, MPFR_RNDN);
+    for (size_t j = 0; j < n; ++j) {
+        if (j == i) continue;
+        t.sub(*z[i], *z[j]);
+        if (mpfr_zero_p(t.re) && mpfr_zero_p(t.im)) continue;
+        t.div(one, t);
+        mpfr_add(s.re, s.re, t.re, MPFR_RNDN); mpfr_add(s.im, s.im, t.im, MPFR_RNDN);
+    }
+    s.mul(s, p); s.sub(one, s);  // 1 - N s
+    if (mpfr_zero_p(s.re) && mpfr_zero_p(s.im)) return false;
+    p.div(p, s);                 // correction w
+    out.sub(*z[i], p);
+    mpfr_t aw, az; mpfr_init2(aw, 32); mpfr_init2(az, 32);
+    p.abs(aw); z[i]->abs(az);
+    bool converged = mpfr_zero_p(aw) || (!mpfr_zero_p(az) && mpfr_get_exp(aw) <= mpfr_get_exp(az) - (mpfr_exp_t)prec + 4);
+    mpfr_clear(aw); mpfr_clear(az);
+    return converged;
+}
+
+// Bits lost evaluating p near z: log2(sum|a_k||z|^k / (|z| |p'(z)|)), or a large value on a multiple root
+static long roots_condition_bits(const MpfrComplex &z, const vector<mpfr_ptr> &a) {
+    mpfr_prec_t prec = z.prec();
+    size_t n = a.size() - 1;
+    MpfrComplex p(prec), d(prec);
+    mpfr_t az, m; mpfr_init2(az, prec); mpfr_init2(m, prec);
+    z.abs(az);
+    mpfr_set_zero(m, 1);
+    mpfr_set(p.re, a[0], MPFR_RNDN);
+    for (size_t k = 0; k <= n; ++k) {
+        mpfr_mul(m, m, az, MPFR_RNDN);
+        mpfr_t c; mpfr_init2(c, prec); mpfr_abs(c, a[k], MPFR_RNDN);
+        mpfr_add(m, m, c, MPFR_RNDN);
+        mpfr_clear(c);
+        if (k == 0) continue;
+        d.mul(d, z); mpfr_add(d.re, d.re, p.re, MPFR_RNDN); mpfr_add(d.im, d.im, p.im, MPFR_RNDN);
+        p.mul(p, z); mpfr_add(p.re, p.re, a[k], MPFR_RNDN);
+    }
+    d.abs(p.re);
+    long bits = LONG_MAX / 4;
+    if (!mpfr_zero_p(p.re) && !mpfr_zero_p(az))
+        bits = (long)mpfr_get_exp(m) - (long)mpfr_get_exp(az) - (long)mpfr_get_exp(p.re);
+    mpfr_clear(az); mpfr_clear(m);
+    return max(0L, bits);
+}
+
+static ValuePtr fn_roots(const vector<ValuePtr> &args, const EvalConfig &cfg) {
+    const vector<ValuePtr> &cs = list_arg(*args[0], "roots");
+    mpfr_prec_t target = cfg.mpfr_prec, max_prec = (mpfr_prec_t)target * ROOTS_MAX_PREC_FACTOR + ROOTS_GUARD_BITS;
+    vector<mpfr_ptr> a;
+    vector<unique_ptr<BigValue>> coeffs; // owns the mpfr_t behind a
+    for (auto &c : cs) {
+        coeffs.emplace_back(new BigValue());
+        mpfr_set_prec(coeffs.back()->f, max_prec);
+        load_mpfr(coeffs.back()->f, *c);
+        if (!mpfr_number_p(coeffs.back()->f)) throw runtime_error("roots() coefficients must be finite");
+        a.push_back(coeffs.back()->f);
+    }
+    // leading zeros lower the degree; trailing zeros are exact roots at 0
+    size_t lead = 0;
+    while (lead < a.size() && mpfr_zero_p(a[lead])) ++lead;
+    a.erase(a.begin(), a.begin() + lead);
+    if (a.empty()) throw runtime_error("roots() of the zero polynomial");
+    size_t zeros = 0;
+    while (mpfr_zero_p(a.back())) { a.pop_back(); ++zeros; }
+    size_t n = a.size() - 1;
+    if (n + zeros > MAX_ROOTS_DEGREE) throw runtime_error("roots() degree is too large (max " + to_string(MAX_ROOTS_DEGREE) + ")");
+
+    vector<unique_ptr<MpfrComplex>> z, next;
+    if (n > 0) {
+        vector<long double> ald(n + 1);
+        for (size_t k = 0; k <= n; ++k) {
+            ald[k] = mpfr_get_ld(a[k], MPFR_RNDN);
+            if (!isfinite(ald[k]) || (ald[k] == 0 && (k == 0 || k == n))) throw runtime_error("roots() coefficients are out of range");
+        }
+        vector<cld> approx = aberth_long_double(ald, cfg);
+        for (size_t i = 0; i < n; ++i) {
+            z.emplace_back(new MpfrComplex(target + ROOTS_GUARD_BITS));
+            mpfr_set_ld(z[i]->re, approx[i].real(), MPFR_RNDN);
+            mpfr_set_ld(z[i]->im, approx[i].imag(), MPFR_RNDN);
+            next.emplace_back(new MpfrComplex(target + ROOTS_GUARD_BITS));
+        }
+    }
+    vector<MpfrComplex *> zs;
+    for (auto &r : z) zs.push_back(r.get());
+    vector<char> done(n, 0);
+    uint64_t grain = max<uint64_t>(1, PARALLEL_MIN_ITEMS / 16 / max<size_t>(n, 1));
+    for (int round = 0; round < ROOTS_PREC_ROUNDS && n > 0; ++round) {
+        for (int it = 0; it < ROOTS_MPFR_ITERATIONS; ++it) {
+            check_deadline(cfg);
+            atomic<size_t> moving{0};
+            parallel_range(0, n, [&](uint64_t i) {
+                next[i]->set_prec(zs[i]->prec());
+                if (done[i]) { next[i]->set(*zs[i]); return; }
+                if (aberth_mpfr_step(zs, i, *next[i], a)) done[i] = 1;
+                else moving++;
+            }, grain);
+            for (size_t i = 0; i < n; ++i) zs[i]->set(*next[i]);
+            if (!moving) break;
+        }
+        // raise precision only where the condition number eats into the target
+        atomic<size_t> raised{0};
+        parallel_range(0, n, [&](uint64_t i) {
+            mpfr_prec_t need = min<mpfr_prec_t>(max_prec, target + ROOTS_GUARD_BITS + roots_condition_bits(*zs[i], a));
+            if (need <= zs[i]->prec()) return;
+            zs[i]->set_prec(need);
+            done[i] = 0;
+            raised++;
+        }, grain);
+        if (!raised) break;
+    }
+
+    // imaginary parts below half the target precision are rounding residue of a real root. Real coefficients:
+    // non-real roots come in conjugate pairs, so pair each root above the axis with the nearest mirror image
+    // below it and make the pair exactly symmetric
+    vector<char> is_real(n);
+    vector<size_t> upper, lower;
+    for (size_t i = 0; i < n; ++i) {
+        mpfr_t az; mpfr_init2(az, 32);
+        zs[i]->abs(az);
+        is_real[i] = mpfr_zero_p(zs[i]->im) || mpfr_get_exp(zs[i]->im) <= mpfr_get_exp(az) - (mpfr_exp_t)target / 2;
+        mpfr_clear(az);
+        if (is_real[i]) mpfr_set_zero(zs[i]->im, 1);
+        else (mpfr_sgn(zs[i]->im) > 0 ? upper : lower).push_back(i);
+    }
+    MpfrComplex diff(64);
+    mpfr_t dist, best; mpfr_init2(dist, 64); mpfr_init2(best, 64);
+    for (size_t u : upper) {
+        size_t pick = SIZE_MAX;
+        for (size_t k = 0; k < lower.size(); ++k) {
+            if (lower[k] == SIZE_MAX) continue;
+            mpfr_sub(diff.re, zs[u]->re, zs[lower[k]]->re, MPFR_RNDN);
+            mpfr_add(diff.im, zs[u]->im, zs[lower[k]]->im, MPFR_RNDN);
+            diff.abs(dist);
+            if (pick == SIZE_MAX || mpfr_cmp(dist, best) < 0) { pick = k; mpfr_set(best, dist, MPFR_RNDN); }
+        }
+        if (pick == SIZE_MAX) break;
+        size_t l = lower[pick];
+        lower[pick] = SIZE_MAX;
+        mpfr_add(zs[u]->re, zs[u]->re, zs[l]->re, MPFR_RNDN); mpfr_div_2ui(zs[u]->re, zs[u]->re, 1, MPFR_RNDN);
+        mpfr_sub(zs[u]->im, zs[u]->im, zs[l]->im, MPFR_RNDN); mpfr_div_2ui(zs[u]->im, zs[u]->im, 1, MPFR_RNDN);
+        zs[l]->set_prec(zs[u]->prec());
+        mpfr_set(zs[l]->re, zs[u]->re, MPFR_RNDN);
+        mpfr_neg(zs[l]->im, zs[u]->im, MPFR_RNDN);
+    }
+    mpfr_clear(dist); mpfr_clear(best);
+    // real roots ascending, then the non-real ones as complex values
+    vector<ValuePtr> real_roots, complex_roots;
+    for (size_t k = 0; k < zeros; ++k) real_roots.push_back(make_shared<BigValue>());
+    vector<size_t> order(n);
+    for (size_t i = 0; i < n; ++i) order[i] = i;
+    sort(order.begin(), order.end(), [&](size_t x, size_t y) {
+        int c = mpfr_cmp(zs[x]->re, zs[y]->re);
+        return c ? c < 0 : mpfr_cmp(zs[x]->im, zs[y]->im) < 0;
+    });
+    for (size_t i : order) {
+        auto re = make_shared<BigValue>();
+        re->is_int = false;
+        mpfr_set_prec(re->f, target);
+        mpfr_set(re->f, zs[i]->re, MPFR_RNDN);
+        if (is_real[i]) { real_roots.push_back(re); continue; }
+        re->make_complex(target);
+        mpfr_set(re->im.get(), zs[i]->im, MPFR_RNDN);
+        complex_roots.push_back(re);
+    }
+    sort(real_roots.begin(), real_roots.end(), [](const ValuePtr &x, const ValuePtr &y) {
+        mpfr_t a, b; mpfr_init2(a, mpfr_get_prec(x->f)); mpfr_init2(b, mpfr_get_prec(y->f));
+        load_mpfr(a, *x); load_mpfr(b, *y);
+        bool less = mpfr_cmp(a, b) < 0;
+        mpfr_clear(a); mpfr_clear(b);
+        return less;
+    });
+    real_roots.insert(real_roots.end(), complex_roots.begin(), complex_roots.end());
+    return list_result(move(real_roots));
+}
+
+// ----- complex values: i, 2i, sqrt/exp/^ of complex or negative arguments, re/im/abs/arg/conj -----
+// A complex BigValue keeps the real part in f and the imaginary part in im, both at --precision and in SI
+// units of one dimension. Operations run on MpfrComplex with COMPLEX_GUARD_BITS extra bits and round each part
+// once into the result. A result whose imaginary part comes out exactly zero is real again, so i*i is -1 and
+// (1+i)^4 is -4. ^ gives the principal value: square-and-multiply for integer exponents (exact on Gaussian
+// integers), |b|^e (cos pi e + i sin pi e) for a negative real base b, where half-integer e gives an exactly
+// imaginary result, and exp(w log z) otherwise.
+static const int COMPLEX_GUARD_BITS = 32;
+
+static void load_complex(MpfrComplex &z, const BigValue &v) {
+    if (v.is_cplx) {
+        mpfr_set(z.re, v.f, MPFR_RNDN);
+        mpfr_set(z.im, v.im.get(), MPFR_RNDN);
+        return;
+    }
+    load_mpfr(z.re, v);
+    mpfr_set_zero(z.im, 1);
+}
+
+// z rounded to the result precision; a real value when the imaginary part is zero
+static ValuePtr complex_value(const MpfrComplex &z, const Dimension &dim, const EvalConfig &cfg) {
+    if (!mpfr_number_p(z.re) || !mpfr_number_p(z.im)) throw runtime_error("complex result overflows");
+    auto v = mpfr_result(cfg);
+    mpfr_set(v->f, z.re, MPFR_RNDN);
+    if (!mpfr_zero_p(z.im)) {
+        v->make_complex(cfg.mpfr_prec);
+        mpfr_set(v->im.get(), z.im, MPFR_RNDN);
+    }
+    v->dim = dim;
+    return v;
+}
+
+static ValuePtr complex_arith(char op, const BigValue &a, const BigValue &b, const Dimension &rdim, const EvalConfig &cfg) {
+    mpfr_prec_t prec = cfg.mpfr_prec + COMPLEX_GUARD_BITS;
+    MpfrComplex x(prec), y(prec);
+    load_complex(x, a); load_complex(y, b);
+    if (op == '+') x.add(x, y);
+    else if (op == '-') x.sub(x, y);
+    else if (op == '*') x.mul(x, y);
+    else {
+        if (mpfr_zero_p(y.re) && mpfr_zero_p(y.im)) throw runtime_error("division by zero");
+        x.div(x, y);
+    }
+    return complex_value(x, rdim, cfg);
+}
+
+// r = e^z.re (cos z.im + i sin z.im); r may alias z
+static void complex_exp_into(MpfrComplex &r, const MpfrComplex &z) {
+    mpfr_prec_t prec = r.prec();
+    mpfr_t m, s, c; mpfr_init2(m, prec); mpfr_init2(s, prec); mpfr_init2(c, prec);
+    mpfr_exp(m, z.re, MPFR_RNDN);
+    mpfr_sin_cos(s, c, z.im, MPFR_RNDN);
+    mpfr_mul(r.re, m, c, MPFR_RNDN);
+    mpfr_mul(r.im, m, s, MPFR_RNDN);
+    mpfr_clear(m); mpfr_clear(s); mpfr_clear(c);
+}
+
+static ValuePtr complex_exp(const BigValue &x, const EvalConfig &cfg) {
+    MpfrComplex z(cfg.mpfr_prec + COMPLEX_GUARD_BITS);
+    load_complex(z, x);
+    complex_exp_into(z, z);
+    if (mpfr_inf_p(z.re) || mpfr_inf_p(z.im)) throw runtime_error("exp() overflows");
+    return complex_value(z, Dimension(), cfg);
+}
+
+// Principal square root: t = sqrt((|z| + |re|) / 2) has no cancellation, the other part is |im| / 2t
+static ValuePtr complex_sqrt(const BigValue &x, const EvalConfig &cfg) {
+    mpfr_prec_t prec = cfg.mpfr_prec + COMPLEX_GUARD_BITS;
+    MpfrComplex z(prec), r(prec);
+    load_complex(z, x);
+    mpfr_t t, a; mpfr_init2(t, prec); mpfr_init2(a, prec);
+    z.abs(t);
+    mpfr_abs(a, z.re, MPFR_RNDN);
+    mpfr_add(t, t, a, MPFR_RNDN);
+    mpfr_div_2ui(t, t, 1, MPFR_RNDN);
+    mpfr_sqrt(t, t, MPFR_RNDN);
+    if (!mpfr_zero_p(t)) {
+        mpfr_abs(a, z.im, MPFR_RNDN);
+        mpfr_div(a, a, t, MPFR_RNDN);
+        mpfr_div_2ui(a, a, 1, MPFR_RNDN);
+        if (mpfr_sgn(z.re) >= 0) { mpfr_set(r.re, t, MPFR_RNDN); mpfr_setsign(r.im, a, mpfr_signbit(z.im), MPFR_RNDN); }
+        else { mpfr_set(r.re, a, MPFR_RNDN); mpfr_setsign(r.im, t, mpfr_signbit(z.im), MPFR_RNDN); }
+    }
+    mpfr_clear(t); mpfr_clear(a);
+    return complex_value(r, Dimension(), cfg);
+}
+
+static ValuePtr complex_power(const BigValue &base, const BigValue &ev, const Dimension &rdim, const EvalConfig &cfg) {
+    mpfr_prec_t prec = cfg.mpfr_prec + COMPLEX_GUARD_BITS;
+    MpfrComplex z(prec), w(prec), r(prec);
+    load_complex(z, base); load_complex(w, ev);
+    bool zero = mpfr_zero_p(z.re) && mpfr_zero_p(z.im);
+    long n = 0;
+    if (small_integer(ev, n)) {
+        if (zero && n < 0) throw runtime_error("division by zero");
+        unsigned long k = n < 0 ? 0UL - (unsigned long)n : (unsigned long)n;
+        mpfr_set_ui(r.re, 1, MPFR_RNDN);
+        for (int bit = 63; bit >= 0; --bit) {
+            r.mul(r, r);
+            if ((k >> bit) & 1) r.mul(r, z);
+        }
+        if (n < 0) {
+            MpfrComplex one(prec);
+            mpfr_set_ui(one.re, 1, MPFR_RNDN);
+            r.div(one, r);
+        }
+    } else if (zero) {
+        if (mpfr_sgn(w.re) <= 0) throw runtime_error("0 to a power whose real part is not positive");
+    } else if (!base.is_cplx && !ev.is_cplx) {
+        // negative real base, real exponent e: |b|^e e^(i pi e)
+        mpfr_t m, t, s, c; mpfr_init2(m, prec); mpfr_init2(t, prec); mpfr_init2(s, prec); mpfr_init2(c, prec);
+        mpfr_neg(m, z.re, MPFR_RNDN);
+        mpfr_pow(m, m, w.re, MPFR_RNDN);
+        mpfr_mul_2ui(t, w.re, 1, MPFR_RNDN);
+        if (mpfr_integer_p(t)) {
+            // e = k + 1/2: e^(i pi e) = (-1)^k i
+            mpfr_floor(t, w.re);
+            mpfr_div_2ui(t, t, 1, MPFR_RNDN);
+            mpfr_setsign(r.im, m, !mpfr_integer_p(t), MPFR_RNDN);
+        } else {
+            mpfr_const_pi(t, MPFR_RNDN);
+            mpfr_mul(t, t, w.re, MPFR_RNDN);
+            mpfr_sin_cos(s, c, t, MPFR_RNDN);
+            mpfr_mul(r.re, m, c, MPFR_RNDN);
+            mpfr_mul(r.im, m, s, MPFR_RNDN);
+        }
+        mpfr_clear(m); mpfr_clear(t); mpfr_clear(s); mpfr_clear(c);
+    } else {
+        // log z = log|z| + i arg z
+        z.abs(r.re);
+        mpfr_log(r.re, r.re, MPFR_RNDN);
+        mpfr_atan2(r.im, z.im, z.re, MPFR_RNDN);
+        r.mul(r, w);
+        complex_exp_into(r, r);
+    }
+    return complex_value(r, rdim, cfg);
+}
+
+static ValuePtr fn_re(const vector<ValuePtr> &args, const EvalConfig &cfg) {
+    const BigValue &x = *args[0];
+    if (x.is_list) throw runtime_error("re() expects a number, not a list");
+    if (!x.is_cplx) return args[0];
+    auto v = mpfr_result(cfg);
+    mpfr_set(v->f, x.f, MPFR_RNDN);
+    return v;
+}
+
+static ValuePtr fn_im(const vector<ValuePtr> &args, const EvalConfig &cfg) {
+    const BigValue &x = *args[0];
+    if (x.is_list) throw runtime_error("im() expects a number, not a list");
+    if (!x.is_cplx) return make_shared<BigValue>();
+    auto v = mpfr_result(cfg);
+    mpfr_set(v->f, x.im.get(), MPFR_RNDN);
+    return v;
+}
+
+static ValuePtr fn_abs(const vector<ValuePtr> &args, const EvalConfig &cfg) {
+    const BigValue &x = *args[0];
+    if (x.is_list) throw runtime_error("abs() expects a number, not a list");
+    if (x.is_cplx) {
+        auto v = mpfr_result(cfg);
+        mpfr_hypot(v->f, x.f, x.im.get(), MPFR_RNDN);
+        return v;
+    }
+    if (real_sign(x) >= 0) return args[0];
+    auto v = make_shared<BigValue>(x);
+    if (v->is_int || v->is_dec) mpz_neg(v->i, v->i);
+    else mpfr_neg(v->f, v->f, MPFR_RNDN);
+    if (v->is_rat) mpq_neg(v->q, v->q);
+    return v;
+}
+
+static ValuePtr fn_arg(const vector<ValuePtr> &args, const EvalConfig &cfg) {
+    const BigValue &x = *args[0];
+    if (x.is_list) throw runtime_error("arg() expects a number, not a list");
+    if (!x.is_cplx && real_sign(x) >= 0) return make_shared<BigValue>();
+    auto v = mpfr_result(cfg);
+    if (x.is_cplx) mpfr_atan2(v->f, x.im.get(), x.f, MPFR_RNDN);
+    else mpfr_const_pi(v->f, MPFR_RNDN);
+    return v;
+}
+
+static ValuePtr fn_conj(const vector<ValuePtr> &args, const EvalConfig &) {
+    const BigValue &x = *args[0];
+    if (x.is_list) throw runtime_error("conj() expects a number, not a list");
+    if (!x.is_cplx) return args[0];
+    auto v = make_shared<BigValue>(x);
+    mpfr_neg(v->im.get(), v->im.get(), MPFR_RNDN);
+    return v;
+}
+
+// ----- continued fractions: cf(x, n), rationalize(x, maxden), 'x to frac' -----
+// Every input is treated as an exact rational a/b: integers and decimals as they are, an MPFR value as its
+// binary significand over a power of two. The partial quotients come from a half-GCD: cf_advance takes the
+// quotients of a/b while the product matrix of the steps [[q, 1], [1, 0]] grows by at most kbits bits, and
+// for a long a it computes them from the leading 2 kbits bits only, recursively, then applies the inverse
+// matrix to the full a and b. A quotient taken from truncated numbers holds for the full ones exactly when
+// the reduced pair still satisfies a' > b' >= 0 (a/b = [q1; ..., qk, a'/b'] with a tail > 1 fixes the prefix),
+// so wrong tail quotients are dropped by that test rather than by error bounds. That is O(M(n) log n)
+// instead of the quadratic term-by-term division; small inputs use plain division.
+// MPFR results are only known to half an ulp, so cf() keeps the terms shared by both ends of that interval
+// and 'to frac' shows the simplest fraction inside it. rationalize() returns an exact fraction.
+static const size_t CF_PLAIN_BITS = 4096;   // below this, plain division
+static const size_t CF_GUARD_BITS = 64;     // extra leading bits kept when truncating
+static const size_t MAX_CF_TERMS = 100000;  // cf() result size
+
+// Product of the quotient steps taken so far: (a, b) = M (a', b'), and M = [[p_k, p_(k-1)], [q_k, q_(k-1)]]
+// holds the last two convergents
+struct CfMatrix {
+    mpz_t m[2][2];
+    size_t steps = 0; // det M = (-1)^steps
+    CfMatrix() {
+        for (auto &row : m) for (auto &x : row) mpz_init(x);
+        mpz_set_ui(m[0][0], 1); mpz_set_ui(m[1][1], 1);
+    }
+    CfMatrix(const CfMatrix &) = delete;
+    CfMatrix &operator=(const CfMatrix &) = delete;
+    ~CfMatrix() { for (auto &row : m) for (auto &x : row) mpz_clear(x); }
+    // M *= [[q, 1], [1, 0]]
+    void step(mpz_srcptr q) {
+        for (auto &row : m) { mpz_addmul(row[1], row[0], q); mpz_swap(row[0], row[1]); }
+        ++steps;
+    }
+    // M *= [[0, 1], [1, -q]], undoing step(q)
+    void unstep(mpz_srcptr q) {
+        for (auto &row : m) { mpz_swap(row[0], row[1]); mpz_submul(row[1], row[0], q); }
+        --steps;
+    }
+    // M *= o
+    void mul(const CfMatrix &o) {
+        mpz_t t0, t1; mpz_init(t0); mpz_init(t1);
+        for (auto &row : m) {
+            mpz_mul(t0, row[0], o.m[0][0]); mpz_addmul(t0, row[1], o.m[1][0]);
+            mpz_mul(t1, row[0], o.m[0][1]); mpz_addmul(t1, row[1], o.m[1][1]);
+            mpz_swap(row[0], t0); mpz_swap(row[1], t1);
+        }
+        mpz_clear(t0); mpz_clear(t1);
+        steps += o.steps;
+    }
+    size_t bits() const { return mpz_sizeinbase(m[0][0], 2); } // m00 is the largest entry
+};
+
+static void cf_plain(mpz_t a, mpz_t b, size_t kbits, MpzVector &qs, CfMatrix &M, size_t max_terms) {
+    mpz_t q, r; mpz_init(q); mpz_init(r);
+    for (size_t used = 0; mpz_sgn(b) && used < kbits && qs.size() < max_terms;) {
+        mpz_tdiv_qr(q, r, a, b);
+        used += mpz_sizeinbase(q, 2);
+        M.step(q);
+        qs.push_back(q);
+        mpz_swap(a, b); mpz_swap(b, r);
+    }
+    mpz_clear(q); mpz_clear(r);
+}
+
+// (a, b) <- L^-1 (a, b), dropping the last quotients of qs (and L) while the result is not a valid remainder
+// pair, i.e. while they do not hold for the full a and b
+static void cf_apply_checked(mpz_t a, mpz_t b, CfMatrix &L, MpzVector &qs) {
+    mpz_t x, y; mpz_init(x); mpz_init(y);
+    mpz_mul(x, L.m[1][1], a); mpz_submul(x, L.m[0][1], b);
+    mpz_mul(y, L.m[0][0], b); mpz_submul(y, L.m[1][0], a);
+    if (L.steps % 2) { mpz_neg(x, x); mpz_neg(y, y); }
+    while (qs.size() && !(mpz_sgn(y) >= 0 && mpz_cmp(x, y) > 0)) {
+        // one step back: (x, y) <- (q x + y, x)
+        mpz_srcptr q = qs[qs.size() - 1];
+        mpz_addmul(y, x, q);
+        mpz_swap(x, y);
+        L.unstep(q);
+        qs.pop_back();
+    }
+    mpz_swap(a, x); mpz_swap(b, y);
+    mpz_clear(x); mpz_clear(y);
+}
+
+// Append to qs (and M) the quotients of a/b, a > b >= 0, until M has grown by about kbits bits, b is 0 or
+// there are max_terms quotients; a and b become the remainders
+static void cf_advance(mpz_t a, mpz_t b, size_t kbits, MpzVector &qs, CfMatrix &M, size_t max_terms, const EvalConfig &cfg) {
+    while (mpz_sgn(b) && kbits > 0 && qs.size() < max_terms) {
+        check_deadline(cfg);
+        size_t n = mpz_sizeinbase(a, 2);
+        if (kbits <= CF_PLAIN_BITS || n <= CF_PLAIN_BITS) { cf_plain(a, b, kbits, qs, M, max_terms); return; }
+        CfMatrix L;
+        MpzVector lq;
+        if (n > 2 * kbits + CF_GUARD_BITS) {
+            // quotients of the leading bits, kept as far as they hold for the full numbers
+            mpz_t ta, tb; mpz_init(ta); mpz_init(tb);
+            size_t shift = n - (2 * kbits + CF_GUARD_BITS);
+            mpz_tdiv_q_2exp(ta, a, shift); mpz_tdiv_q_2exp(tb, b, shift);
+            if (mpz_cmp(ta, tb) > 0) cf_advance(ta, tb, kbits, lq, L, max_terms - qs.size(), cfg);
+            mpz_clear(ta); mpz_clear(tb);
+            cf_apply_checked(a, b, L, lq);
+            if (lq.size() == 0) cf_plain(a, b, 1, lq, L, 1); // truncation decided nothing: one exact step
+        } else {
+            // a has at most about 2 kbits bits: the first half of the budget, then the loop spends the rest
+            cf_advance(a, b, kbits / 2, lq, L, max_terms - qs.size(), cfg);
+        }
+        for (size_t k = 0; k < lq.size(); ++k) qs.push_back(lq[k]);
+        M.mul(L);
+        kbits -= min(kbits, L.bits());
+    }
+}
+
+// M = product of the steps for terms[begin, end), by halves so the big products are balanced
+static void cf_product(const MpzVector &terms, size_t begin, size_t end, CfMatrix &M) {
+    if (end - begin <= 16) {
+        for (size_t k = begin; k < end; ++k) M.step(terms[k]);
+        return;
+    }
+    size_t mid = begin + (end - begin) / 2;
+    cf_product(terms, begin, mid, M);
+    CfMatrix R;
+    cf_product(terms, mid, end, R);
+    M.mul(R);
+}
+
+// v = a / b exactly (b > 0, not reduced). False for an MPFR value, which is only known to half an ulp:
+// then v = a * 2^e with a its full significand.
+static bool exact_rational(const BigValue &v, mpz_t a, mpz_t b, long &e, const string &fname, const EvalConfig &cfg) {
+    if (v.is_list) throw runtime_error(fname + "() expects a number, not a list");
+    long double lg = v.estimate_log10();
+    if (isfinite(lg) && fabsl(lg) > (long double)cfg.max_digits) throw runtime_error(fname + "() argument is too large");
+    mpz_set_ui(b, 1);
+    if (v.is_int) { load_scaled(a, v, 0); return true; }
+    if (v.is_dec) { mpz_set(a, v.i); mpz_ui_pow_ui(b, 10, v.dec_scale); return true; }
+    if (v.is_rat) { mpz_set(a, mpq_numref(v.q)); mpz_set(b, mpq_denref(v.q)); return true; }
+    if (!mpfr_number_p(v.f)) throw runtime_error(fname + "() of a non-finite number");
+    if (mpfr_zero_p(v.f)) { mpz_set_ui(a, 0); return true; }
+    e = (long)mpfr_get_z_2exp(a, v.f);
+    return false;
+}
+
+// a / b = m * 2^e
+static void dyadic_fraction(mpz_t a, mpz_t b, mpz_srcptr m, long e) {
+    mpz_set(a, m);
+    mpz_set_ui(b, 1);
+    if (e >= 0) mpz_mul_2exp(a, a, (unsigned long)e);
+    else mpz_mul_2exp(b, b, (unsigned long)-e);
+}
+
+// Partial quotients of a/b (b > 0): floor(a/b) first, at most max_terms in all. True when the expansion
+// ended with an exact zero remainder, i.e. terms is all of it.
+static bool cf_expand(mpz_srcptr a0, mpz_srcptr b0, size_t max_terms, MpzVector &terms, const EvalConfig &cfg) {
+    mpz_t a, b, q; mpz_init(a); mpz_init(b); mpz_init(q);
+    mpz_fdiv_qr(q, b, a0, b0);
+    mpz_set(a, b0);
+    terms.push_back(q);
+    CfMatrix M;
+    // about 1.7 bits of matrix growth per quotient on average; the whole expansion needs bits(b)
+    size_t budget = min<size_t>(2 * max_terms + CF_GUARD_BITS, mpz_sizeinbase(a, 2) + CF_GUARD_BITS);
+    while (mpz_sgn(b) && terms.size() < max_terms) {
+        cf_advance(a, b, budget, terms, M, max_terms, cfg);
+        budget *= 2;
+    }
+    bool ended = mpz_sgn(b) == 0;
+    mpz_clear(a); mpz_clear(b); mpz_clear(q);
+    return ended;
+}
+
+// Half-ulp interval [lo, hi] around the MPFR value m * 2^e, as fractions
+static void ulp_interval(mpz_srcptr m, long e, mpz_t lo_a, mpz_t lo_b, mpz_t hi_a, mpz_t hi_b) {
+    mpz_t t; mpz_init(t);
+    mpz_mul_2exp(t, m, 1);
+    mpz_sub_ui(t, t, 1);
+    dyadic_fraction(lo_a, lo_b, t, e - 1);
+    mpz_add_ui(t, t, 2);
+    dyadic_fraction(hi_a, hi_b, t, e - 1);
+    mpz_clear(t);
+}
+
+static ValuePtr fn_cf(const vector<ValuePtr> &args, const EvalConfig &cfg) {
+    uint64_t n = u64_arg(*args[1], "cf", MAX_CF_TERMS);
+    mpz_t a, b; mpz_init(a); mpz_init(b);
+    long e = 0;
+    MpzVector terms;
+    if (n > 0 && exact_rational(*args[0], a, b, e, "cf", cfg)) {
+        cf_expand(a, b, n, terms, cfg);
+    } else if (n > 0) {
+        // only the terms both ends of the rounding interval agree on, unless the value itself (2.5) has an
+        // expansion that ends, with an exact zero remainder, right after them: the ends split only on the
+        // form of its last term ([2; 2, ...] and [2; 1, 1, ...])
+        mpz_t c, d; mpz_init(c); mpz_init(d);
+        MpzVector mid, hi;
+        dyadic_fraction(c, d, a, e);
+        bool ended = cf_expand(c, d, n, mid, cfg);
+        mpz_set(c, a);
+        ulp_interval(c, e, a, b, c, d);
+        cf_expand(a, b, n + 1, terms, cfg);
+        cf_expand(c, d, n + 1, hi, cfg);
+        size_t k = 0;
+        while (k < min<size_t>(n, min(terms.size(), hi.size())) && mpz_cmp(terms[k], hi[k]) == 0) ++k;
+        if (ended && k + 1 >= mid.size()) terms = move(mid);
+        else while (terms.size() > k) terms.pop_back();
+        mpz_clear(c); mpz_clear(d);
+    }
+    mpz_clear(a); mpz_clear(b);
+    vector<ValuePtr> items;
+    for (size_t k = 0; k < terms.size(); ++k) items.push_back(mpz_result(terms[k]));
+    return list_result(move(items));
+}
+
+// Best approximation p/q with 1 <= q <= maxden: the last convergent within the bound, or the semiconvergent
+// (t p_k + p_(k-1)) / (t q_k + q_(k-1)) with the largest allowed t when that is closer
+static ValuePtr fn_rationalize(const vector<ValuePtr> &args, const EvalConfig &cfg) {
+    mpz_t a, b, maxden, q; mpz_init(a); mpz_init(b); mpz_init(maxden); mpz_init(q);
+    mpz_arg(maxden, *args[1], "rationalize", cfg);
+    if (mpz_sgn(maxden) <= 0) { mpz_clear(a); mpz_clear(b); mpz_clear(maxden); mpz_clear(q); throw runtime_error("rationalize() needs a maximum denominator >= 1"); }
+    long e = 0;
+    if (!exact_rational(*args[0], a, b, e, "rationalize", cfg)) { mpz_set(q, a); dyadic_fraction(a, b, q, e); }
+    mpz_t x, y; mpz_init(x); mpz_init(y);
+    mpz_fdiv_qr(q, y, a, b);
+    mpz_set(x, b);
+    MpzVector qs;
+    CfMatrix M;
+    M.step(q);
+    qs.push_back(q);
+    while (mpz_sgn(y) && mpz_cmp(M.m[1][0], maxden) <= 0)
+        cf_advance(x, y, mpz_sizeinbase(maxden, 2) + 2, qs, M, SIZE_MAX, cfg);
+    bool have_next = false;
+    mpz_t next; mpz_init(next);
+    while (mpz_cmp(M.m[1][0], maxden) > 0) {
+        mpz_set(next, qs[qs.size() - 1]);
+        have_next = true;
+        M.unstep(next);
+        qs.pop_back();
+    }
+    mpz_t p, d; mpz_init_set(p, M.m[0][0]); mpz_init_set(d, M.m[1][0]);
+    if (have_next) {
+        // t = floor((maxden - q_(k-1)) / q_k) < next
+        mpz_t t; mpz_init(t);
+        mpz_sub(t, maxden, M.m[1][1]);
+        mpz_fdiv_q(t, t, M.m[1][0]);
+        if (mpz_sgn(t) > 0) {
+            mpz_t sp, sd; mpz_init_set(sp, M.m[0][1]); mpz_init_set(sd, M.m[1][1]);
+            mpz_addmul(sp, t, M.m[0][0]); mpz_addmul(sd, t, M.m[1][0]);
+            // closer: |a/b - sp/sd| < |a/b - p/d|, i.e. |a sd - b sp| d < |a d - b p| sd
+            mpz_t es, ec; mpz_init(es); mpz_init(ec);
+            mpz_mul(es, a, sd); mpz_submul(es, b, sp); mpz_abs(es, es); mpz_mul(es, es, d);
+            mpz_mul(ec, a, d); mpz_submul(ec, b, p); mpz_abs(ec, ec); mpz_mul(ec, ec, sd);
+            if (mpz_cmp(es, ec) < 0) { mpz_swap(p, sp); mpz_swap(d, sd); }
+            mpz_clear(es); mpz_clear(ec); mpz_clear(sp); mpz_clear(sd);
+        }
+        mpz_clear(t);
+    }
+    ValuePtr r = rational_result(p, d, cfg);
+    mpz_clear(p); mpz_clear(d); mpz_clear(next); mpz_clear(x); mpz_clear(y);
+    mpz_clear(a); mpz_clear(b); mpz_clear(maxden); mpz_clear(q);
+    return r;
+}
+
+// Simplest fraction (smallest denominator) in the closed interval [lo, hi], 0 < lo < hi, from their
+// expansions: the common prefix, then at the first difference the lower end's term + 1, or the lower end
+// itself if its expansion stops there. The ends swap roles at every level.
+static void simplest_between(const MpzVector &lo, const MpzVector &hi, MpzVector &out) {
+    mpz_t t; mpz_init(t);
+    for (size_t j = 0; j < lo.size() && j < hi.size(); ++j) {
+        const MpzVector &lower = j % 2 ? hi : lo, &upper = j % 2 ? lo : hi;
+        if (j + 1 == lower.size() || mpz_cmp(upper[j], lower[j]) > 0) {
+            mpz_set(t, lower[j]);
+            if (j + 1 != lower.size()) mpz_add_ui(t, t, 1);
+            out.push_back(t);
+            break;
+        }
+        out.push_back(lower[j]);
+    }
+    mpz_clear(t);
+}
+
+// 'x to frac': exact values as a reduced fraction, MPFR values as the simplest fraction that rounds to them
+static string fraction_text(const BigValue &v, const EvalConfig &cfg) {
+    mpz_t a, b; mpz_init(a); mpz_init(b);
+    long e = 0;
+    mpq_t r; mpq_init(r);
+    if (exact_rational(v, a, b, e, "to frac", cfg)) {
+        mpz_set(mpq_numref(r), a); mpz_set(mpq_denref(r), b);
+        mpq_canonicalize(r); // GMP's gcd is subquadratic
+    } else {
+        bool negative = mpz_sgn(a) < 0;
+        mpz_abs(a, a);
+        mpz_t c, d, m; mpz_init(c); mpz_init(d); mpz_init_set(m, a);
+        ulp_interval(m, e, a, b, c, d);
+        MpzVector lo, hi, s;
+        cf_expand(a, b, SIZE_MAX, lo, cfg);
+        cf_expand(c, d, SIZE_MAX, hi, cfg);
+        simplest_between(lo, hi, s);
+        CfMatrix M;
+        cf_product(s, 0, s.size(), M);
+        mpz_set(mpq_numref(r), M.m[0][0]); mpz_set(mpq_denref(r), M.m[1][0]);
+        // inside [lo, hi] by construction; the binary value itself otherwise
+        mpq_t l, h; mpq_init(l); mpq_init(h);
+        mpz_set(mpq_numref(l), a); mpz_set(mpq_denref(l), b); mpq_canonicalize(l);
+        mpz_set(mpq_numref(h), c); mpz_set(mpq_denref(h), d); mpq_canonicalize(h);
+        if (s.size() == 0 || mpz_sgn(mpq_denref(r)) == 0 || mpq_cmp(r, l) < 0 || mpq_cmp(r, h) > 0) {
+            dyadic_fraction(mpq_numref(r), mpq_denref(r), m, e);
+            mpq_canonicalize(r);
+        }
+        if (negative) mpq_neg(r, r);
+        mpq_clear(l); mpq_clear(h); mpz_clear(c); mpz_clear(d); mpz_clear(m);
+    }
+    char *num = mpz_get_str(nullptr, 10, mpq_numref(r)), *den = mpz_get_str(nullptr, 10, mpq_denref(r));
+    string out = num;
+    if (mpz_cmp_ui(mpq_denref(r), 1) != 0) out += string("/") + den;
+    free(num); free(den);
+    mpq_clear(r); mpz_clear(a); mpz_clear(b);
+    return v.dim == Dimension() ? out : out + " " + BigValue::compound_unit_string(v.dim);
+}
+
+// ----- combinatorial numbers: partitions(n), bernoulli(n), stirling1(n, k), stirling2(n, k), zeta(s) -----
+// partitions(n) sums the Hardy-Ramanujan-Rademacher series
+//   p(n) = sum_k 4 sqrt(3) A_k(n) / (sqrt(k) m) (cosh z_k - sinh(z_k) / z_k),  m = 24n - 1, z_k = pi sqrt(m) / 6k
+// up to Lehmer's bound on the tail, each term at the precision its size needs (term k is about e^(z_1 / k)),
+// so all but the first few run in long double. A_k(n) is a sum of cos(pi j / 6k) over the h coprime to k,
+// with j exact from the Dedekind sum s(h, k). Terms are split across threads. The sum has to land within 1/4
+// of an integer or the result is refused; small n use Euler's pentagonal recurrence instead.
+// bernoulli(n) is the exact fraction p/q: q comes exactly from von Staudt-Clausen, so p = B_n q only has to be known to
+// within 1/4, from |B_n| = 2 n! zeta(n) / (2 pi)^n. 1/zeta(n) is an Euler product in which prime p only
+// needs the bits p^-n still reaches; the primes are split across threads.
+// stirling2(n, k) is the alternating sum of C(k, j) j^n over j, divided by k!, with the j split across
+// threads. stirling1(n, k) is the signed coefficient of x^k in x (x - 1) ... (x - n + 1), from a product tree
+// of polynomials truncated to the coefficients needed and multiplied by Kronecker substitution (one mpz_mul
+// per product). zeta(s) is MPFR's.
+static const uint64_t PARTITIONS_MAX = 10000000000ULL;   // ~30,000 series terms
+static const uint64_t PARTITIONS_EXACT_MAX = 1000;       // below: O(n^1.5) recurrence
+static const uint64_t BERNOULLI_MAX = 1000000;
+static const uint64_t STIRLING_MAX = 1000000;
+static const long double STIRLING1_MAX_BITS = 1ULL << 33; // truncated product: coefficients times their size
+static const int COMB_GUARD_BITS = 32;
+static const mpfr_prec_t COMB_LDOUBLE_BITS = 56;          // terms that need no more run in long double
+
+// p(0..n) by p(m) = sum_k (-1)^(k+1) (p(m - k(3k-1)/2) + p(m - k(3k+1)/2))
+static void partitions_table(uint64_t n, MpzVector &p) {
+    mpz_set_ui(p[0], 1);
+    for (uint64_t m = 1; m <= n; ++m) {
+        for (uint64_t k = 1; k * (3 * k - 1) / 2 <= m; ++k) {
+            uint64_t g1 = k * (3 * k - 1) / 2, g2 = k * (3 * k + 1) / 2;
+            if (k % 2) mpz_add(p[m], p[m], p[m - g1]); else mpz_sub(p[m], p[m], p[m - g1]);
+            if (g2 > m) continue;
+            if (k % 2) mpz_add(p[m], p[m], p[m - g2]); else mpz_sub(p[m], p[m], p[m - g2]);
+        }
+    }
+}
+
+// 6k s(h, k) for the Dedekind sum s, 0 <= h < k, gcd(h, k) = 1 (always an integer), by the reciprocity
+// 12hk s(h, k) = h^2 + k^2 + 1 - 3hk - 2k (6h s(k mod h, h)) from s(0, 1) = 0
+static long long dedekind6(uint64_t h, uint64_t k) {
+    uint64_t hs[96], ks[96];
+    int depth = 0;
+    while (h > 0) { hs[depth] = h; ks[depth] = k; ++depth; uint64_t r = k % h; k = h; h = r; }
+    __int128 s = 0;
+    while (depth--) {
+        __int128 a = hs[depth], b = ks[depth];
+        s = (a * a + b * b + 1 - 3 * a * b - 2 * b * s) / (2 * a);
+    }
+    return (long long)s;
+}
+
+// Lehmer: |p(n) - (sum of the first N terms)| < 44 pi^2 / (225 sqrt 3) / sqrt N + pi sqrt 2 / 75 sqrt(N / (n - 1)) sinh(pi sqrt(2n/3) / N)
+static uint64_t rademacher_terms(uint64_t n) {
+    auto tail = [&](long double N) {
+        long double pi = acosl(-1.0L);
+        return 44 * pi * pi / (225 * sqrtl(3.0L)) / sqrtl(N) + pi * sqrtl(2.0L) / 75 * sqrtl(N / (n - 1)) * sinhl(pi * sqrtl(2.0L * n / 3) / N);
+    };
+    uint64_t hi = 1;
+    while (!(tail((long double)hi) < 0.25L)) hi *= 2;
+    uint64_t lo = hi / 2;
+    while (hi - lo > 1) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        (tail((long double)mid) < 0.25L ? hi : lo) = mid;
+    }
+    return hi;
+}
+
+// counts[j], j in [0, 6k]: A_k(n) = sum_j counts[j] cos(pi j / 6k)
+static void rademacher_counts(uint64_t n, uint64_t k, vector<uint32_t> &counts) {
+    counts.assign(6 * k + 1, 0);
+    uint64_t nk = n % k;
+    for (uint64_t h = 0; h < k; ++h) {
+        if (gcd(h, k) != 1) continue;
+        // pi (s(h, k) - 2nh / k) = pi j / 6k, taken mod 2 pi and folded by cos(-x) = cos x
+        long long j = (dedekind6(h, k) - 12 * (long long)((unsigned __int128)nk * h % k)) % (long long)(12 * k);
+        if (j < 0) j += 12 * k;
+        if (j > (long long)(6 * k)) j = 12 * k - j;
+        counts[j]++;
+    }
+}
+
+static ValuePtr fn_partitions(const vector<ValuePtr> &args, const EvalConfig &cfg) {
+    uint64_t n = u64_arg(*args[0], "partitions", PARTITIONS_MAX);
+    if (n <= PARTITIONS_EXACT_MAX) {
+        MpzVector p(n + 1);
+        partitions_table(n, p);
+        return mpz_result(p[n]);
+    }
+    long double pi = acosl(-1.0L), m = 24.0L * n - 1, z1 = pi * sqrtl(m) / 6;
+    long double log2_p = z1 / logl(2.0L); // log2 of the first term, within a few bits
+    if (log2_p * log10l(2.0L) > cfg.max_digits) throw runtime_error("partitions() result is too large");
+    uint64_t terms = rademacher_terms(n);
+    long double slack = log2l((long double)terms) + COMB_GUARD_BITS;
+    mpfr_prec_t acc_prec = (mpfr_prec_t)(log2_p + slack);
+    mpfr_t pisqrtm;
+    mpfr_init2(pisqrtm, acc_prec + COMB_GUARD_BITS);
+    mpfr_set_ui(pisqrtm, 24, MPFR_RNDN);
+    mpfr_mul_ui(pisqrtm, pisqrtm, n, MPFR_RNDN);
+    mpfr_sub_ui(pisqrtm, pisqrtm, 1, MPFR_RNDN);
+    mpfr_sqrt(pisqrtm, pisqrtm, MPFR_RNDN);
+    {
+        mpfr_t t; mpfr_init2(t, acc_prec + COMB_GUARD_BITS);
+        mpfr_const_pi(t, MPFR_RNDN);
+        mpfr_mul(pisqrtm, pisqrtm, t, MPFR_RNDN);
+        mpfr_clear(t);
+    }
+    // chunk c takes k = c + 1, c + 1 + chunks, ... so the expensive first terms land on different threads
+    unsigned chunks = (unsigned)min<uint64_t>(worker_threads(), max<uint64_t>(1, terms / 64));
+    vector<__mpfr_struct> sums(chunks);
+    vector<long double> small(chunks, 0);
+    for (auto &s : sums) { mpfr_init2(&s, acc_prec); mpfr_set_zero(&s, 1); }
+    atomic<bool> timed_out{false};
+    parallel_range(0, chunks, [&](uint64_t c) {
+        vector<uint32_t> counts;
+        mpfr_t z, sh, ch, a, w;
+        mpfr_init2(z, 2); mpfr_init2(sh, 2); mpfr_init2(ch, 2); mpfr_init2(a, 2); mpfr_init2(w, 2);
+        for (uint64_t k = c + 1; k <= terms && !timed_out; k += chunks) {
+            if (limit_exceeded(cfg)) { timed_out = true; break; }
+            rademacher_counts(n, k, counts);
+            long double zk = z1 / k;
+            // |A_k| <= k: the term is below sqrt(k) e^(z_k) 4 sqrt 3 / m
+            long double log2_term = (zk + logl(4 * sqrtl(3.0L) * sqrtl((long double)k) / m)) / logl(2.0L);
+            mpfr_prec_t prec = (mpfr_prec_t)max<long double>(0, log2_term + slack + log2l((long double)k));
+            if (prec <= COMB_LDOUBLE_BITS) {
+                long double ak = 0;
+                for (size_t j = 0; j < counts.size(); ++j)
+                    if (counts[j]) ak += counts[j] * cosl(pi * j / (6.0L * k));
+                small[c] += 4 * sqrtl(3.0L) / (sqrtl((long double)k) * m) * ak * (coshl(zk) - sinhl(zk) / zk);
+                continue;
+            }
+            for (mpfr_ptr x : { z, sh, ch, a, w }) mpfr_set_prec(x, prec);
+            mpfr_div_ui(z, pisqrtm, 6 * k, MPFR_RNDN);
+            mpfr_sinh_cosh(sh, ch, z, MPFR_RNDN);
+            mpfr_div(sh, sh, z, MPFR_RNDN);
+            mpfr_sub(ch, ch, sh, MPFR_RNDN);
+            mpfr_set_zero(a, 1);
+            for (size_t j = 0; j < counts.size(); ++j) {
+                if (!counts[j]) continue;
+                mpfr_const_pi(w, MPFR_RNDN);
+                mpfr_mul_ui(w, w, j, MPFR_RNDN);
+                mpfr_div_ui(w, w, 6 * k, MPFR_RNDN);
+                mpfr_cos(w, w, MPFR_RNDN);
+                mpfr_mul_ui(w, w, counts[j], MPFR_RNDN);
+                mpfr_add(a, a, w, MPFR_RNDN);
+            }
+            mpfr_mul(ch, ch, a, MPFR_RNDN);
+            mpfr_set_ui(w, 48, MPFR_RNDN);
+            mpfr_div_ui(w, w, k, MPFR_RNDN);
+            mpfr_sqrt(w, w, MPFR_RNDN); // 4 sqrt 3 / sqrt k
+            mpfr_mul(ch, ch, w, MPFR_RNDN);
+            mpfr_div_ui(ch, ch, 24 * n - 1, MPFR_RNDN);
+            mpfr_add(&sums[c], &sums[c], ch, MPFR_RNDN);
+        }
+        for (mpfr_ptr x : { z, sh, ch, a, w }) mpfr_clear(x);
+    }, 1);
+    mpfr_t total; mpfr_init2(total, acc_prec);
+    mpfr_set_zero(total, 1);
+    for (unsigned c = 0; c < chunks; ++c) {
+        mpfr_add(total, total, &sums[c], MPFR_RNDN);
+        mpfr_add_d(total, total, (double)small[c], MPFR_RNDN); // below 2^24: exact enough in a double
+        mpfr_clear(&sums[c]);
+    }
+    mpfr_clear(pisqrtm);
+    auto v = make_shared<BigValue>();
+    mpfr_get_z(v->i, total, MPFR_RNDN);
+    mpfr_sub_z(total, total, v->i, MPFR_RNDN);
+    bool exact = mpfr_cmp_d(total, 0.25) < 0 && mpfr_cmp_d(total, -0.25) > 0;
+    mpfr_clear(total);
+    if (timed_out) throw_limit_exceeded(cfg);
+    if (!exact) throw runtime_error("partitions() lost precision");
+    return v;
+}
+
+
+// product of the primes p with (p - 1) | n: the denominator of B_n for even n
+static void bernoulli_denominator(uint64_t n, mpz_t q, const EvalConfig &cfg) {
+    auto primes = primes_upto(n + 1, cfg);
+    auto is_prime = [&](uint64_t p) { return binary_search(primes->begin(), primes->end(), (uint32_t)p); };
+    mpz_set_ui(q, 1);
+    for (uint64_t d = 1; d * d <= n; ++d) {
+        if (n % d) continue;
+        if (is_prime(d + 1)) mpz_mul_ui(q, q, d + 1);
+        if (n / d != d && is_prime(n / d + 1)) mpz_mul_ui(q, q, n / d + 1);
+    }
+}
+
+// B_n = p / q for small even n from the tangent numbers T_k (Brent-Harvey): B_2k = (-1)^(k-1) 2k T_k / (4^k (4^k - 1))
+static void bernoulli_tangent(uint64_t n, mpz_t p, mpz_t q) {
+    uint64_t m = n / 2;
+    MpzVector t(m + 1);
+    mpz_set_ui(t[1], 1);
+    for (uint64_t k = 2; k <= m; ++k) mpz_mul_ui(t[k], t[k - 1], k - 1);
+    for (uint64_t k = 2; k <= m; ++k)
+        for (uint64_t j = k; j <= m; ++j) {
+            mpz_mul_ui(t[j], t[j], j - k + 2);
+            mpz_addmul_ui(t[j], t[j - 1], j - k);
+        }
+    mpq_t b; mpq_init(b);
+    mpz_mul_ui(mpq_numref(b), t[m], n);
+    mpz_set_ui(mpq_denref(b), 0);
+    mpz_setbit(mpq_denref(b), n);
+    mpz_sub_ui(mpq_denref(b), mpq_denref(b), 1);
+    mpz_mul_2exp(mpq_denref(b), mpq_denref(b), n);
+    mpq_canonicalize(b);
+    if (m % 2 == 0) mpq_neg(b, b);
+    mpz_set(p, mpq_numref(b)); mpz_set(q, mpq_denref(b));
+    mpq_clear(b);
+}
+
+static const uint64_t BERNOULLI_TANGENT_MAX = 200; // the Euler product needs primes up to 2^(bits / n)
+
+static ValuePtr fn_bernoulli(const vector<ValuePtr> &args, const EvalConfig &cfg) {
+    uint64_t n = u64_arg(*args[0], "bernoulli", BERNOULLI_MAX);
+    mpz_t p, q; mpz_init(p); mpz_init(q);
+    mpz_set_ui(q, 1);
+    if (n == 0) mpz_set_ui(p, 1);
+    else if (n == 1) { mpz_set_si(p, -1); mpz_set_ui(q, 2); }
+    else if (n % 2) mpz_set_ui(p, 0);
+    else if (n <= BERNOULLI_TANGENT_MAX) bernoulli_tangent(n, p, q);
+    else {
+        bernoulli_denominator(n, q, cfg);
+        long double pi = acosl(-1.0L);
+        long double log2_p = (lgammal(n + 1.0L) + logl(2.0L) - n * logl(2 * pi)) / logl(2.0L) + mpz_sizeinbase(q, 2);
+        if (log2_p * log10l(2.0L) > cfg.max_digits) { mpz_clear(p); mpz_clear(q); throw runtime_error("bernoulli() result is too large"); }
+        mpfr_prec_t prec = (mpfr_prec_t)log2_p + 2 * COMB_GUARD_BITS;
+        // 1/zeta(n) = prod (1 - p^-n) over the primes with p^-n above 2^-prec
+        uint64_t last = (uint64_t)exp2l((long double)prec / n) + 1;
+        auto primes = primes_upto(last, cfg);
+        size_t count = upper_bound(primes->begin(), primes->end(), (uint32_t)last) - primes->begin();
+        unsigned chunks = (unsigned)min<uint64_t>(worker_threads(), max<uint64_t>(1, count / 16));
+        vector<__mpfr_struct> part(chunks);
+        for (auto &x : part) { mpfr_init2(&x, prec); mpfr_set_ui(&x, 1, MPFR_RNDN); }
+        atomic<bool> timed_out{false};
+        // the small primes cost most, so chunk c takes every chunks-th prime
+        parallel_range(0, chunks, [&](uint64_t c) {
+            mpfr_t x, t; mpfr_init2(x, 2); mpfr_init2(t, 2);
+            for (size_t i = c; i < count && !timed_out; i += chunks) {
+                if (limit_exceeded(cfg)) { timed_out = true; break; }
+                uint32_t pr = (*primes)[i];
+                long double need = prec - n * log2l((long double)pr) + COMB_GUARD_BITS;
+                if (need < COMB_GUARD_BITS) break;
+                mpfr_set_prec(x, (mpfr_prec_t)need); mpfr_set_prec(t, (mpfr_prec_t)need);
+                mpfr_ui_pow_ui(x, pr, n, MPFR_RNDN);
+                mpfr_ui_div(x, 1, x, MPFR_RNDN);
+                // part -= part p^-n: only the leading bits of part reach the last place
+                mpfr_set(t, &part[c], MPFR_RNDN);
+                mpfr_mul(t, t, x, MPFR_RNDN);
+                mpfr_sub(&part[c], &part[c], t, MPFR_RNDN);
+            }
+            mpfr_clear(x); mpfr_clear(t);
+        }, 1);
+        mpfr_t num, den;
+        mpfr_init2(num, prec); mpfr_init2(den, prec);
+        mpfr_fac_ui(num, n, MPFR_RNDN);
+        mpfr_mul_z(num, num, q, MPFR_RNDN);
+        mpfr_mul_2ui(num, num, 1, MPFR_RNDN);
+        mpfr_const_pi(den, MPFR_RNDN);
+        mpfr_mul_2ui(den, den, 1, MPFR_RNDN);
+        mpfr_pow_ui(den, den, n, MPFR_RNDN);
+        for (auto &x : part) { mpfr_mul(den, den, &x, MPFR_RNDN); mpfr_clear(&x); }
+        mpfr_div(num, num, den, MPFR_RNDN);
+        mpfr_get_z(p, num, MPFR_RNDN);
+        mpfr_sub_z(num, num, p, MPFR_RNDN);
+        bool exact = mpfr_cmp_d(num, 0.25) < 0 && mpfr_cmp_d(num, -0.25) > 0;
+        mpfr_clear(num); mpfr_clear(den);
+        if (timed_out || !exact) {
+            mpz_clear(p); mpz_clear(q);
+            if (timed_out) throw_limit_exceeded(cfg);
+            throw runtime_error("bernoulli() lost precision");
+        }
+        if (n % 4 == 0) mpz_neg(p, p);
+    }
+    ValuePtr r = rational_result(p, q, cfg);
+    mpz_clear(p); mpz_clear(q);
+    return r;
+}
+
+// log2 of C(n, k)
+static long double log2_binomial(uint64_t n, uint64_t k) {
+    return (lgammal(n + 1.0L) - lgammal(k + 1.0L) - lgammal(n - k + 1.0L)) / logl(2.0L);
+}
+
+static ValuePtr fn_stirling2(const vector<ValuePtr> &args, const EvalConfig &cfg) {
+    uint64_t n = u64_arg(*args[0], "stirling2", STIRLING_MAX), k = u64_arg(*args[1], "stirling2", STIRLING_MAX);
+    if (k > n || (k == 0 && n > 0)) return int_result(0);
+    if (k == n || k == 1) return int_result(1);
+    // S(n, k) <= C(n, k) k^(n - k)
+    if ((log2_binomial(n, k) + (n - k) * log2l((long double)k)) * log10l(2.0L) > cfg.max_digits) throw runtime_error("stirling2() result is too large");
+    // k! S(n, k) = sum_j (-1)^(k - j) C(k, j) j^n, j = 1..k in contiguous runs so C(k, j) is updated in place
+    unsigned chunks = (unsigned)min<uint64_t>(worker_threads(), max<uint64_t>(1, k / 16));
+    MpzVector part(chunks);
+    atomic<bool> timed_out{false};
+    parallel_range(0, chunks, [&](uint64_t c) {
+        uint64_t j0 = 1 + k * c / chunks, j1 = 1 + k * (c + 1) / chunks;
+        mpz_t b, t; mpz_init(b); mpz_init(t);
+        mpz_bin_uiui(b, k, j0);
+        for (uint64_t j = j0; j < j1; ++j) {
+            if (limit_exceeded(cfg)) { timed_out = true; break; }
+            mpz_ui_pow_ui(t, j, n);
+            if ((k - j) % 2) mpz_submul(part[c], t, b); else mpz_addmul(part[c], t, b);
+            mpz_mul_ui(b, b, k - j);
+            mpz_divexact_ui(b, b, j + 1);
+        }
+        mpz_clear(b); mpz_clear(t);
+    }, 1);
+    if (timed_out) throw_limit_exceeded(cfg);
+    auto v = make_shared<BigValue>();
+    for (unsigned c = 0; c < chunks; ++c) mpz_add(v->i, v->i, part[c]);
+    mpz_t f; mpz_init(f);
+    mpz_fac_ui(f, k);
+    mpz_divexact(v->i, v->i, f);
+    mpz_clear(f);
+    return v;
+}
+
+// f g truncated to len coefficients, all non-negative, by Kronecker substitution: each polynomial is packed
+// into one integer with limb-aligned slots wide enough that no coefficient of the product carries over
+static MpzVector poly_mul_trunc(const MpzVector &f, const MpzVector &g, size_t len) {
+    size_t nf = min(f.size(), len), ng = min(g.size(), len), out = min(len, nf + ng - 1);
+    size_t fb = 0, gb = 0;
+    for (size_t i = 0; i < nf; ++i) fb = max(fb, mpz_sizeinbase(f[i], 2));
+    for (size_t i = 0; i < ng; ++i) gb = max(gb, mpz_sizeinbase(g[i], 2));
+    size_t slot = (fb + gb + 64 - __builtin_clzll(min(nf, ng)) + GMP_NUMB_BITS) / GMP_NUMB_BITS;
+    auto pack = [&](const MpzVector &p, size_t n, mpz_t z) {
+        mp_limb_t *limbs = mpz_limbs_write(z, n * slot);
+        memset(limbs, 0, n * slot * sizeof(mp_limb_t));
+        for (size_t i = 0; i < n; ++i) memcpy(limbs + i * slot, mpz_limbs_read(p[i]), mpz_size(p[i]) * sizeof(mp_limb_t));
+        mpz_limbs_finish(z, n * slot);
+    };
+    mpz_t a, b; mpz_init(a); mpz_init(b);
+    pack(f, nf, a);
+    pack(g, ng, b);
+    mpz_mul(a, a, b);
+    MpzVector h(out);
+    const mp_limb_t *limbs = mpz_limbs_read(a);
+    size_t size = mpz_size(a);
+    for (size_t i = 0; i < out && i * slot < size; ++i)
+        mpz_import(h[i], min(slot, size - i * slot), -1, sizeof(mp_limb_t), 0, 0, limbs + i * slot);
+    mpz_clear(a); mpz_clear(b);
+    return h;
+}
+
+// prod (a_i + b_i t) for i in [lo, hi), truncated to len coefficients; (a_i, b_i) = (i, 1), or (1, i) if flip
+static MpzVector stirling1_product(uint64_t lo, uint64_t hi, bool flip, size_t len, const EvalConfig &cfg, atomic<bool> &timed_out) {
+    if (timed_out) return MpzVector(1); // discarded: the caller throws
+    if (hi - lo <= 32) {
+        MpzVector p(min<size_t>(len, hi - lo + 1));
+        mpz_set_ui(p[0], 1);
+        for (uint64_t i = lo; i < hi; ++i) {
+            uint64_t a = flip ? 1 : i, b = flip ? i : 1;
+            for (size_t j = min<size_t>(p.size() - 1, i - lo + 1); j > 0; --j) {
+                mpz_mul_ui(p[j], p[j], a);
+                mpz_addmul_ui(p[j], p[j - 1], b);
+            }
+            mpz_mul_ui(p[0], p[0], a);
+        }
+        return p;
+    }
+    if (limit_exceeded(cfg)) timed_out = true;
+    uint64_t mid = lo + (hi - lo) / 2;
+    return poly_mul_trunc(stirling1_product(lo, mid, flip, len, cfg, timed_out), stirling1_product(mid, hi, flip, len, cfg, timed_out), len);
+}
+
+static ValuePtr fn_stirling1(const vector<ValuePtr> &args, const EvalConfig &cfg) {
+    uint64_t n = u64_arg(*args[0], "stirling1", STIRLING_MAX), k = u64_arg(*args[1], "stirling1", STIRLING_MAX);
+    if (k > n || (k == 0 && n > 0)) return int_result(0);
+    if (k == n) return int_result(1);
+    // |s(n, k)| = [x^(k-1)] prod_(i=1..n-1) (i + x) = [y^(n-k)] prod_(i=1..n-1) (1 + i y): keep the shorter
+    bool flip = n - k < k - 1;
+    size_t len = (size_t)(flip ? n - k : k - 1) + 1;
+    long double log2_s = min(lgammal((long double)n) / logl(2.0L), log2_binomial(n - 1, n - k) + (n - k) * log2l((long double)n));
+    if (log2_s * log10l(2.0L) > cfg.max_digits || log2_s * len > STIRLING1_MAX_BITS) throw runtime_error("stirling1() result is too large");
+    unsigned chunks = (unsigned)min<uint64_t>(worker_threads(), max<uint64_t>(1, n / 256));
+    vector<MpzVector> part(chunks);
+    atomic<bool> timed_out{false};
+    parallel_range(0, chunks, [&](uint64_t c) {
+        part[c] = stirling1_product(1 + (n - 1) * c / chunks, 1 + (n - 1) * (c + 1) / chunks, flip, len, cfg, timed_out);
+    }, 1);
+    if (timed_out) throw_limit_exceeded(cfg);
+    for (unsigned c = 1; c < chunks; ++c) {
+        check_deadline(cfg);
+        part[0] = poly_mul_trunc(part[0], part[c], len);
+    }
+    auto v = make_shared<BigValue>();
+    if (part[0].size() == len) mpz_set(v->i, part[0][len - 1]);
+    if ((n - k) % 2) mpz_neg(v->i, v->i);
+    return v;
+}
+
+static ValuePtr fn_zeta(const vector<ValuePtr> &args, const EvalConfig &cfg) {
+    const BigValue &s = *args[0];
+    if (s.is_list) throw runtime_error("zeta() expects a number, not a list");
+    auto v = mpfr_result(cfg);
+    mpz_t z; mpz_init(z);
+    bool natural = s.estimate_log10() < 18 && integer_value(s, z) && mpz_sgn(z) >= 0;
+    unsigned long u = natural ? mpz_get_ui(z) : 0;
+    mpz_clear(z);
+    if (natural && u == 1) throw runtime_error("zeta() has a pole at s = 1");
+    if (natural) mpfr_zeta_ui(v->f, u, MPFR_RNDN);
+    else {
+        load_mpfr(v->f, s);
+        mpfr_zeta(v->f, v->f, MPFR_RNDN);
+    }
+    if (!mpfr_number_p(v->f)) throw runtime_error("zeta() overflows");
+    return v;
+}
+
+// ----- repeating decimals: exact rationals print as I.pre(period) -----
+// With the reduced denominator q = 2^a 5^b d and gcd(d, 10) = 1, the pre-period has max(a, b) digits and the
+// period is the multiplicative order of 10 mod d. That order divides the Carmichael function
+// lambda(d) = lcm p^(e-1) (p - 1) over the prime powers p^e of d, so d is factored (trial division, then
+// Pollard-Brent rho) and each p - 1 is factored to reduce ord_p(10) from p - 1 with modular powers.
+// ord_{p^e}(10) = ord_p(10) p^max(0, e - v) with v = v_p(10^ord_p(10) - 1) lifts it to the prime power,
+// so 1/3^100000 gets its period without dividing out a single digit. The digits themselves are produced
+// REPEAT_CHUNK at a time as floor(r 10^chunk / q), only up to cfg.repeat_digits. If a factorization does not
+// finish within the rho budget (or the deadline) the period length is unknown and the digits end in "...".
+static const unsigned long REPEAT_CHUNK = 4096;              // digits per division
+static const uint32_t REPEAT_TRIAL_LIMIT = 1 << 16;          // trial division bound before rho
+static const size_t REPEAT_RHO_MAX_BITS = 1024;              // composites above this are not attempted
+static const size_t REPEAT_PRIME_TEST_MAX_BITS = 4096;       // nor are primality tests
+static const unsigned long REPEAT_RHO_BUDGET = 1UL << 21;    // squarings per factorization
+
+static bool repeat_timed_out(const EvalConfig &cfg) { return deadline_passed(cfg); }
+
+// A nontrivial factor f of the odd composite n, or false once budget is spent
+static bool rho_factor(mpz_t f, const mpz_t n, unsigned long &budget, const EvalConfig &cfg) {
+    mpz_t x, y, ys, acc, t; mpz_init(x); mpz_init(y); mpz_init(ys); mpz_init(acc); mpz_init(t);
+    bool found = false;
+    auto step = [&](mpz_t z, unsigned long c) { mpz_mul(z, z, z); mpz_add_ui(z, z, c); mpz_mod(z, z, n); };
+    for (unsigned long c = 1; !found && budget > 0 && !repeat_timed_out(cfg); ++c) {
+        mpz_set_ui(y, 2); mpz_set_ui(acc, 1); mpz_set_ui(f, 1);
+        for (unsigned long r = 1; mpz_cmp_ui(f, 1) == 0 && budget > 0; r *= 2) {
+            mpz_set(x, y);
+            for (unsigned long k = 0; k < r; ++k) step(y, c);
+            for (unsigned long k = 0; k < r && mpz_cmp_ui(f, 1) == 0; k += 128) {
+                mpz_set(ys, y);
+                unsigned long lim = min(128UL, r - k);
+                for (unsigned long j = 0; j < lim; ++j) {
+                    step(y, c);
+                    mpz_sub(t, x, y);
+                    mpz_mul(acc, acc, t); mpz_mod(acc, acc, n);
+                }
+                mpz_gcd(f, acc, n);
+            }
+            budget = budget > 2 * r ? budget - 2 * r : 0;
+            if (repeat_timed_out(cfg)) budget = 0;
+        }
+        if (mpz_cmp(f, n) == 0) {
+            // the batched product lost the factor: redo the last batch one step at a time
+            do {
+                step(ys, c);
+                mpz_sub(t, x, ys);
+                mpz_gcd(f, t, n);
+            } while (mpz_cmp_ui(f, 1) == 0);
+        }
+        found = mpz_cmp_ui(f, 1) != 0 && mpz_cmp(f, n) != 0;
+    }
+    mpz_clear(x); mpz_clear(y); mpz_clear(ys); mpz_clear(acc); mpz_clear(t);
+    return found;
+}
+
+static const vector<uint32_t> &repeat_small_primes() {
+    static const vector<uint32_t> primes = [] {
+        vector<uint32_t> out;
+        vector<bool> composite(REPEAT_TRIAL_LIMIT);
+        for (uint32_t p = 2; p < REPEAT_TRIAL_LIMIT; ++p) {
+            if (composite[p]) continue;
+            out.push_back(p);
+            for (uint32_t m = p * p; m < REPEAT_TRIAL_LIMIT; m += p) composite[m] = true;
+        }
+        return out;
+    }();
+    return primes;
+}
+
+// Distinct primes of n > 0 with their exponents, or false if a composite part could not be split
+static bool factor_distinct(const mpz_t n, MpzVector &ps, vector<unsigned long> &es, const EvalConfig &cfg) {
+    mpz_t rest, p; mpz_init_set(rest, n); mpz_init(p);
+    for (uint32_t s : repeat_small_primes()) {
+        if (mpz_cmp_ui(rest, 1) == 0) break;
+        if (!mpz_divisible_ui_p(rest, s)) continue;
+        mpz_set_ui(p, s);
+        es.push_back(mpz_remove(rest, rest, p));
+        ps.push_back(p);
+    }
+    unsigned long budget = REPEAT_RHO_BUDGET;
+    MpzVector pending;
+    if (mpz_cmp_ui(rest, 1) != 0) pending.push_back(rest);
+    bool ok = true;
+    while (ok && pending.size() > 0) {
+        mpz_set(p, pending[pending.size() - 1]);
+        pending.pop_back();
+        size_t bits = mpz_sizeinbase(p, 2);
+        if (bits > REPEAT_PRIME_TEST_MAX_BITS) { ok = false; break; }
+        if (mpz_probab_prime_p(p, 25)) {
+            size_t k = 0;
+            while (k < ps.size() && mpz_cmp(ps[k], p) != 0) ++k;
+            if (k == ps.size()) {
+                mpz_set(rest, n);
+                es.push_back(mpz_remove(rest, rest, p));
+                ps.push_back(p);
+            }
+            continue;
+        }
+        if (bits > REPEAT_RHO_MAX_BITS || !rho_factor(rest, p, budget, cfg)) { ok = false; break; }
+        pending.push_back(rest);
+        mpz_divexact(rest, p, rest);
+        pending.push_back(rest);
+    }
+    mpz_clear(rest); mpz_clear(p);
+    return ok;
+}
+
+// Multiplicative order of 10 modulo d (gcd(d, 10) = 1, d > 1) into ord; false when d or some p - 1 could
+// not be factored
+static bool order_of_ten(mpz_t ord, const mpz_t d, const EvalConfig &cfg) {
+    MpzVector ps; vector<unsigned long> es;
+    if (!factor_distinct(d, ps, es, cfg)) return false;
+    mpz_t o, pe, t, ten; mpz_init(o); mpz_init(pe); mpz_init(t); mpz_init_set_ui(ten, 10);
+    mpz_set_ui(ord, 1);
+    bool ok = true;
+    for (size_t k = 0; ok && k < ps.size(); ++k) {
+        mpz_srcptr p = ps[k];
+        // ord_p(10): the divisor of p - 1 left after taking out every prime r with 10^(o/r) = 1
+        mpz_sub_ui(o, p, 1);
+        MpzVector rs; vector<unsigned long> re;
+        if (!factor_distinct(o, rs, re, cfg)) { ok = false; break; }
+        for (size_t j = 0; j < rs.size(); ++j)
+            for (unsigned long m = 0; m < re[j]; ++m) {
+                mpz_divexact(t, o, rs[j]);
+                mpz_powm(t, ten, t, p);
+                if (mpz_cmp_ui(t, 1) != 0) break;
+                mpz_divexact(o, o, rs[j]);
+            }
+        if (es[k] > 1) {
+            mpz_pow_ui(pe, p, es[k]);
+            mpz_powm(t, ten, o, pe);
+            mpz_sub_ui(t, t, 1);
+            unsigned long v = mpz_sgn(t) == 0 ? es[k] : mpz_remove(t, t, p);
+            if (v < es[k]) {
+                mpz_pow_ui(t, p, es[k] - v);
+                mpz_mul(o, o, t);
+            }
+        }
+        mpz_lcm(ord, ord, o);
+    }
+    mpz_clear(o); mpz_clear(pe); mpz_clear(t); mpz_clear(ten);
+    return ok;
+}
+
+static string repeating_decimal(const BigValue &v, const EvalConfig &cfg) {
+    mpz_t num, den, ip, d, period, t, p10; mpz_init(num); mpz_init(den); mpz_init(ip); mpz_init(d);
+    mpz_init(period); mpz_init(t); mpz_init(p10);
+    mpz_abs(num, mpq_numref(v.q));
+    mpz_set(den, mpq_denref(v.q));
+    mpz_tdiv_qr(ip, num, num, den); // num: remainder, the fraction is num / den
+    unsigned long twos = mpz_scan1(den, 0);
+    mpz_tdiv_q_2exp(d, den, twos);
+    mpz_set_ui(t, 5);
+    unsigned long fives = mpz_remove(d, d, t);
+    unsigned long pre = max(twos, fives);
+    // period length: 0 when the expansion terminates, unknown when order_of_ten gives up
+    bool known = mpz_cmp_ui(d, 1) == 0 || order_of_ten(period, d, cfg);
+    if (mpz_cmp_ui(d, 1) == 0) mpz_set_ui(period, 0);
+    unsigned long budget = cfg.repeat_digits, want = budget;
+    bool cut = true;
+    mpz_add_ui(t, period, pre);
+    if (known && mpz_cmp_ui(t, budget) <= 0) { want = mpz_get_ui(t); cut = false; }
+    string digits;
+    digits.reserve(want);
+    while (digits.size() < want) {
+        if (!digits.empty() && repeat_timed_out(cfg)) { cut = true; break; }
+        unsigned long chunk = min(REPEAT_CHUNK, want - digits.size());
+        mpz_ui_pow_ui(p10, 10, chunk);
+        mpz_mul(num, num, p10);
+        mpz_tdiv_qr(t, num, num, den);
+        char *s = mpz_get_str(nullptr, 10, t);
+        size_t len = mpz_sgn(t) == 0 ? 0 : strlen(s);
+        digits.append(chunk - len, '0');
+        digits.append(s, len);
+        free(s);
+    }
+    char *is = mpz_get_str(nullptr, 10, ip);
+    string out = string(mpq_sgn(v.q) < 0 ? "-" : "") + is + ".";
+    free(is);
+    if (digits.size() <= pre) out += digits;
+    else out += digits.substr(0, pre) + (mpz_sgn(period) != 0 || !known ? "(" : "") + digits.substr(pre);
+    if (cut) {
+        out += "...";
+        if (digits.size() > pre && (mpz_sgn(period) != 0 || !known)) out += ")";
+        if (known && mpz_sgn(period) != 0) {
+            char *s = mpz_get_str(nullptr, 10, period);
+            size_t len = strlen(s);
+            out += len <= 40 ? string(" [period: ") + s + (strcmp(s, "1") ? " digits]" : " digit]") : " [period: over 10^" + to_string(len - 1) + " digits]";
+            free(s);
+        }
+    } else if (mpz_sgn(period) != 0) out += ")";
+    mpz_clear(num); mpz_clear(den); mpz_clear(ip); mpz_clear(d);
+    mpz_clear(period); mpz_clear(t); mpz_clear(p10);
+    return out;
+}
+
+// ----- digit queries: digitsum(x), digitcount(x), digit(x, k), digitfreq(x) -----
+// Decimal digit statistics of an exact integer without its decimal string. |x| is split by a tree of powers
+// P_j = 10^(DIGIT_LEAF 2^j): each level divides every block by the next smaller power into a high and a low
+// half, the blocks of a level across threads, down to leaves of at most DIGIT_LEAF digits whose counts come
+// from a short mpz_get_str. Every leaf below the leading one stands for exactly DIGIT_LEAF digits, leading
+// zeros included. Trailing zeros kept apart (z10) count as zeros. digit(x, k) needs a single division: k >= 0
+// counts from the units digit (0), k < 0 from the leading digit (-1). The arguments of these functions may
+// have DIGIT_ARG_SCALE times max_digits digits and integer powers there are exact, so digitsum(2^10000000)
+// works with the default limits.
+static const size_t DIGIT_LEAF = 1024; // digits per leaf block
+
+struct DigitCounts {
+    uint64_t n[10] = {};
+};
+
+// |x| of an exact integer argument into z, its trailing zeros kept as a power of ten apart
+static void digit_arg(const BigValue &v, const string &fname, mpz_t z, unsigned long &zeros) {
+    if (v.is_list) throw runtime_error(fname + "() expects a number, not a list");
+    zeros = 0;
+    if (v.is_int) {
+        mpz_abs(z, v.i);
+        if (mpz_sgn(v.i) != 0) zeros = v.z10;
+        return;
+    }
+    bool rounded = !v.is_dec && !v.is_rat && mpfr_regular_p(v.f) && mpfr_get_exp(v.f) > mpfr_get_prec(v.f);
+    if (rounded || !integer_value(v, z)) throw runtime_error(fname + "() expects an exact integer");
+    mpz_abs(z, z);
+}
+
+// Decimal digits of x with zeros trailing zeros (at least 1)
+static uint64_t digit_length(const mpz_t x, unsigned long zeros) {
+    uint64_t d = mpz_sizeinbase(x, 10); // d or d - 1
+    if (d == 1) return 1 + (mpz_sgn(x) ? zeros : 0);
+    mpz_t p; mpz_init(p);
+    mpz_ui_pow_ui(p, 10, d - 1);
+    if (mpz_cmp(x, p) < 0) --d;
+    mpz_clear(p);
+    return d + zeros;
+}
+
+static DigitCounts digit_counts(const BigValue &v, const string &fname, const EvalConfig &cfg) {
+    MpzVector t(1);
+    mpz_srcptr x = t[0];
+    unsigned long zeros = 0;
+    digit_arg(v, fname, t[0], zeros);
+    DigitCounts c;
+    c.n[0] = zeros;
+    if (mpz_sgn(x) == 0) { c.n[0] = 1; return c; }
+    // powers[j] = 10^(DIGIT_LEAF 2^j) while blocks of twice that width are still shorter than x
+    size_t digits = mpz_sizeinbase(x, 10);
+    MpzVector powers;
+    mpz_t p; mpz_init(p);
+    mpz_ui_pow_ui(p, 10, DIGIT_LEAF);
+    while ((DIGIT_LEAF << powers.size()) < digits) {
+        check_deadline(cfg);
+        powers.push_back(p);
+        mpz_mul(p, p, p);
+    }
+    mpz_clear(p);
+    MpzVector blocks(1); // most significant first
+    mpz_swap(blocks[0], t[0]);
+    for (size_t j = powers.size(); j-- > 0;) {
+        check_deadline(cfg);
+        MpzVector next(2 * blocks.size());
+        parallel_range(0, blocks.size(), [&](uint64_t b) { mpz_tdiv_qr(next[2 * b], next[2 * b + 1], blocks[b], powers[j]); }, 1);
+        blocks = move(next);
+        powers.pop_back();
+    }
+    check_deadline(cfg);
+    size_t lead = 0; // blocks before the leading one are zeros above x
+    while (mpz_sgn(blocks[lead]) == 0) ++lead;
+    vector<DigitCounts> leaf(blocks.size());
+    parallel_range(lead, blocks.size(), [&](uint64_t b) {
+        char buf[DIGIT_LEAF + 2];
+        mpz_get_str(buf, 10, blocks[b]);
+        size_t len = mpz_sgn(blocks[b]) == 0 ? 0 : strlen(buf);
+        for (size_t k = 0; k < len; ++k) leaf[b].n[buf[k] - '0']++;
+        if (b > lead) leaf[b].n[0] += DIGIT_LEAF - len;
+    }, 64);
+    for (const DigitCounts &l : leaf)
+        for (int d = 0; d < 10; ++d) c.n[d] += l.n[d];
+    return c;
+}
+
+static ValuePtr fn_digitsum(const vector<ValuePtr> &args, const EvalConfig &cfg) {
+    DigitCounts c = digit_counts(*args[0], "digitsum", cfg);
+    uint64_t sum = 0;
+    for (int d = 1; d < 10; ++d) sum += d * c.n[d];
+    return int_result(sum);
+}
+
+static ValuePtr fn_digitcount(const vector<ValuePtr> &args, const EvalConfig &) {
+    MpzVector t(1);
+    unsigned long zeros = 0;
+    digit_arg(*args[0], "digitcount", t[0], zeros);
+    return int_result(digit_length(t[0], zeros));
+}
+
+static ValuePtr fn_digitfreq(const vector<ValuePtr> &args, const EvalConfig &cfg) {
+    DigitCounts c = digit_counts(*args[0], "digitfreq", cfg);
+    vector<ValuePtr> items;
+    for (int d = 0; d < 10; ++d) items.push_back(int_result(c.n[d]));
+    return list_result(move(items));
+}
+
+static ValuePtr fn_digit(const vector<ValuePtr> &args, const EvalConfig &) {
+    MpzVector t(2);
+    mpz_ptr x = t[0], k = t[1];
+    unsigned long zeros = 0;
+    digit_arg(*args[0], "digit", x, zeros);
+    if (args[1]->is_list || args[1]->estimate_log10() >= 18 || !integer_value(*args[1], k) || !mpz_fits_slong_p(k))
+        throw runtime_error("digit() expects a position: k >= 0 from the units digit, k < 0 from the leading digit");
+    long pos = mpz_get_si(k);
+    uint64_t len = digit_length(x, zeros);
+    if (pos < 0) pos += (long)len;
+    if (pos < 0) throw runtime_error("digit() position is before the leading digit");
+    if ((uint64_t)pos < zeros || (uint64_t)pos >= len) return int_result(0);
+    mpz_ui_pow_ui(k, 10, (uint64_t)pos - zeros);
+    mpz_tdiv_q(x, x, k);
+    return int_result(mpz_tdiv_ui(x, 10));
+}
+
+static const map<string, FuncDef> FUNCTIONS = {
+    { "list", { 0, INT_MAX, fn_list, false, true } },
+    { "sqrt", { 1, 1, fn_sqrt, true, true } },
+    { "exp", { 1, 1, fn_exp, true, true } },
+    { "re", { 1, 1, fn_re, true, true } },
+    { "im", { 1, 1, fn_im, true, true } },
+    { "abs", { 1, 1, fn_abs, true, true } },
+    { "arg", { 1, 1, fn_arg, true, true } },
+    { "conj", { 1, 1, fn_conj, true, true } },
+    { "rec", { 3, 4, fn_rec } },
+    { "roots", { 1, 1, fn_roots } },
+    { "primepi", { 1, 1, fn_primepi } },
+    { "nthprime", { 1, 1, fn_nthprime } },
+    { "primes", { 2, 2, fn_primes } },
+    { "cf", { 2, 2, fn_cf } },
+    { "rationalize", { 2, 2, fn_rationalize } },
+    { "partitions", { 1, 1, fn_partitions } },
+    { "bernoulli", { 1, 1, fn_bernoulli } },
+    { "stirling1", { 2, 2, fn_stirling1 } },
+    { "stirling2", { 2, 2, fn_stirling2 } },
+    { "zeta", { 1, 1, fn_zeta } },
+    { "digitsum", { 1, 1, fn_digitsum, true, false, true } },
+    { "digitcount", { 1, 1, fn_digitcount, true, false, true } },
+    { "digit", { 2, 2, fn_digit, true, false, true } },
+    { "digitfreq", { 1, 1, fn_digitfreq, true, false, true } },
+};
+
+static const FuncDef *find_function(const string &name) {
+    auto it = FUNCTIONS.find(name);
+    return it == FUNCTIONS.end() ? nullptr : &it->second;
+}
+
+struct EvalResult {
+    bool approximate = false; // text holds an overflow approximation
+    string text;              // error, approximation or 'to' conversion when value is null
+    ValuePtr value;           // shared result; never deep-copied per consumer
+    bool degraded = false;    // client over its CPU quota: evaluated with the reduced limits of QuotaPolicy
+};
+
+// Evaluate RPN with unit handling and overflow detection
+static EvalResult eval_rpn_value(const vector<Token> &rpn, const EvalConfig &cfg) {
+    EvalResult res;
+    auto fail = [&](const string &msg) { res.text = msg; return res; };
+    vector<ValuePtr> st;
+    // reject unit errors before doing any big-number work
+    vector<DimInfo> dinfo;
+    string derr;
+    if (!infer_dimensions(rpn, dinfo, derr)) return fail(string("Error: ") + derr);
+    vector<char> long_arg = long_arg_tokens(rpn);
+    try {
+        for (size_t i = 0; i < rpn.size(); ++i) {
+            const Token &tk = rpn[i];
+            check_deadline(cfg);
+            if (tk.type == T_NUM) {
+                st.push_back(token_to_bigvalue(tk, cfg));
+            } else if (tk.type == T_VAL) {
+                // precomputed value spliced into the RPN: shared, not copied
+                st.push_back(tk.val);
+            } else if (is_frac_target(rpn, i)) {
+                st.push_back(make_shared<BigValue>());
+            } else if (tk.type == T_IDENT && tk.text == IMAGINARY_UNIT) {
+                auto v = make_shared<BigValue>();
+                mpfr_set_prec(v->f, cfg.mpfr_prec);
+                v->make_complex(cfg.mpfr_prec);
+                mpfr_set_zero(v->f, 1);
+                mpfr_set_ui(v->im.get(), 1, MPFR_RNDN);
+                st.push_back(v);
+            } else if (tk.type == T_IDENT) {
+                // interpret identifier as a standalone unit (1 unit)
+                auto v = make_shared<BigValue>();
+                mpfr_set_prec(v->f, cfg.mpfr_prec);
+                if (cfg.decimal_digits >= 0) v->set_decimal_from_string_and_unit("1", tk.text);
+                else v->set_from_string_and_unit("1", tk.text);
+                st.push_back(v);
+            } else if (tk.type == T_TO) {
+                // binary operator: a to unit
+                if (st.size() < 2) return fail("Error: 'to' requires left value and right unit identifier");
+                ValuePtr unitv = st.back(); st.pop_back();
+                ValuePtr val = st.back(); st.pop_back();
+                if (val->is_list) return fail("Error: 'to' does not apply to a list");
+                if (i > 0 && is_frac_target(rpn, i - 1)) {
+                    if (val->is_cplx) return fail("Error: 'to frac' does not apply to a complex number");
+                    return fail(fraction_text(*val, cfg));
+                }
+                // The right operand is normally the unit's name; otherwise it was pushed as 1 * unit factor and
+                // is mapped back to a unit of the same dimension whose factor matches.
+                UnitPtr found = i > 0 && rpn[i - 1].type == T_IDENT ? UNIT_REG.resolve(rpn[i - 1].text) : nullptr;
+                if (!found) found = unit_with_factor(*unitv);
+                if (!found) return fail("Error: unknown target unit for 'to'");
+                if (cfg.decimal_digits >= 0 && is_exact(*val) && found->exact)
+                    return fail(exact_in_unit(*val, *found, cfg.decimal_digits, cfg.decimal_rounding));
+                return fail(convert_to_unit(*val, *found, cfg));
+            } else if (tk.type == T_OP && tk.text == "neg") {
+                ValuePtr ap = st.back(); st.pop_back();
+                if (ap->is_list) return fail("Error: operator - does not apply to a list");
+                shared_ptr<BigValue> r = ap.use_count() == 1 ? writable_result(ap) : make_shared<BigValue>(*ap);
+                if (r->is_int || r->is_dec) mpz_neg(r->i, r->i);
+                else mpfr_neg(r->f, r->f, MPFR_RNDN);
+                if (r->is_rat) mpq_neg(r->q, r->q);
+                if (r->is_cplx) mpfr_neg(r->im.get(), r->im.get(), MPFR_RNDN);
+                st.push_back(r);
+            } else if (tk.type == T_OP) {
+                const string &op = tk.text;
+                if (op != "+" && op != "-" && op != "*" && op != "/" && op != "^") return fail(string("Error: unknown operator '") + op + "'");
+                if (st.size() < 2) return fail("Error: stack underflow " + op);
+                ValuePtr bp = st.back(); st.pop_back();
+                ValuePtr ap = st.back(); st.pop_back();
+                const BigValue &a = *ap, &b = *bp;
+                if (a.is_list || b.is_list) return fail("Error: operator " + op + " does not apply to a list");
+                if (op == "+" || op == "-") {
+                    if (!dinfo[i].known && !(a.dim == b.dim)) return fail("Error: Unit mismatch for " + op);
+                    Dimension rdim = dinfo[i].known ? dinfo[i].dim : a.dim;
+                    if (a.is_cplx || b.is_cplx) { st.push_back(complex_arith(op[0], a, b, rdim, cfg)); continue; }
+                    if (cfg.decimal_digits >= 0 && is_exact(a) && is_exact(b)) {
+                        // exact: align scales, then add
+                        unsigned long sc = max(exact_scale(a), exact_scale(b));
+                        bool ints = a.is_int && b.is_int;
+                        mpz_t ta, tb; mpz_init(ta); mpz_init(tb);
+                        load_scaled(ta, a, sc); load_scaled(tb, b, sc);
+                        auto r = writable_result(ap);
+                        if (op == "+") mpz_add(r->i, ta, tb); else mpz_sub(r->i, ta, tb);
+                        mpz_clear(ta); mpz_clear(tb);
+                        set_exact_kind(*r, ints, sc);
+                        r->dim = rdim;
+                        st.push_back(r);
+                        continue;
+                    }
+                    // exact integers and fractions stay exact (2^100 + 1, 6/3 + 2^70)
+                    if (cfg.decimal_digits < 0 && is_rational(a) && is_rational(b)) {
+                        mpq_t ta, tb; mpq_init(ta); mpq_init(tb);
+                        load_q(ta, a); load_q(tb, b);
+                        if (op == "+") mpq_add(ta, ta, tb); else mpq_sub(ta, ta, tb);
+                        auto r = writable_result(ap);
+                        set_rational(*r, ta, cfg.mpfr_prec);
+                        mpq_clear(ta); mpq_clear(tb);
+                        st.push_back(r);
+                        continue;
+                    }
+                    mpfr_t ta, tb; mpfr_init2(ta, cfg.mpfr_prec); mpfr_init2(tb, cfg.mpfr_prec);
+                    load_mpfr(ta, a); load_mpfr(tb, b);
+                    auto r = writable_result(ap);
+                    r->is_int = false; r->z10 = 0; r->is_dec = false; r->is_rat = false; r->is_cplx = false;
+                    mpfr_set_prec(r->f, cfg.mpfr_prec);
+                    if (op == "+") mpfr_add(r->f, ta, tb, MPFR_RNDN); else mpfr_sub(r->f, ta, tb, MPFR_RNDN);
+                    mpfr_clear(ta); mpfr_clear(tb);
+                    r->dim = rdim;
+                    st.push_back(r);
+                } else if (op == "*") {
+                    Dimension rdim = dinfo[i].known ? dinfo[i].dim : a.dim + b.dim;
+                    if (a.is_cplx || b.is_cplx) {
+                        st.push_back(complex_arith('*', a, b, rdim, cfg));
+                    } else if (a.is_int && b.is_int && rdim == Dimension()) {
+                        // keep integer if dimensionless; in place when the left operand is unshared
+                        unsigned long rz = a.z10 + b.z10;
+                        auto r = writable_result(ap);
+                        mpz_mul(r->i, a.i, b.i);
+                        r->z10 = rz;
+                        r->is_int = true; r->is_dec = false;
+                        r->dim = rdim;
+                        st.push_back(r);
+                    } else if (cfg.decimal_digits >= 0 && is_exact(a) && is_exact(b)) {
+                        // exact: scales add
+                        unsigned long sc = exact_scale(a) + exact_scale(b);
+                        mpz_t ta, tb; mpz_init(ta); mpz_init(tb);
+                        load_scaled(ta, a, exact_scale(a)); load_scaled(tb, b, exact_scale(b));
+                        auto r = writable_result(ap);
+                        mpz_mul(r->i, ta, tb);
+                        mpz_clear(ta); mpz_clear(tb);
+                        set_exact_kind(*r, false, sc);
+                        r->dim = rdim;
+                        st.push_back(r);
+                    } else if (cfg.decimal_digits < 0 && (a.is_rat || b.is_rat) && is_rational(a) && is_rational(b)) {
+                        mpq_t ta, tb; mpq_init(ta); mpq_init(tb);
+                        load_q(ta, a); load_q(tb, b);
+                        mpq_mul(ta, ta, tb);
+                        auto r = writable_result(ap);
+                        set_rational(*r, ta, cfg.mpfr_prec);
+                        mpq_clear(ta); mpq_clear(tb);
+                        st.push_back(r);
+                    } else {
+                        mpfr_t ta, tb; mpfr_init2(ta, cfg.mpfr_prec); mpfr_init2(tb, cfg.mpfr_prec);
+                        load_mpfr(ta, a); load_mpfr(tb, b);
+                        auto r = writable_result(ap);
+                        r->is_int = false; r->z10 = 0; r->is_dec = false; r->is_rat = false; r->is_cplx = false;
+                        mpfr_set_prec(r->f, cfg.mpfr_prec);
+                        mpfr_mul(r->f, ta, tb, MPFR_RNDN);
+                        mpfr_clear(ta); mpfr_clear(tb);
+                        r->dim = rdim;
+                        st.push_back(r);
+                    }
+                } else if (op == "/") {
+                    Dimension rdim = dinfo[i].known ? dinfo[i].dim : a.dim - b.dim;
+                    if (a.is_cplx || b.is_cplx) { st.push_back(complex_arith('/', a, b, rdim, cfg)); continue; }
+                    if (cfg.decimal_digits >= 0 && is_exact(a) && is_exact(b)) {
+                        // round to N fractional digits with the configured mode
+                        if (mpz_sgn(b.i) == 0) return fail("Error: division by zero");
+                        mpz_t q; mpz_init(q);
+                        exact_div_scaled(q, a, b, (unsigned long)cfg.decimal_digits, cfg.decimal_rounding);
+                        auto r = writable_result(ap);
+                        mpz_swap(r->i, q);
+                        mpz_clear(q);
+                        set_exact_kind(*r, cfg.decimal_digits == 0 && rdim == Dimension(), (unsigned long)cfg.decimal_digits);
+                        r->dim = rdim;
+                        st.push_back(r);
+                        continue;
+                    }
+                    if (cfg.decimal_digits < 0 && is_rational(a) && is_rational(b)) {
+                        // exact quotient; an integer when it divides evenly
+                        mpq_t ta, tb; mpq_init(ta); mpq_init(tb);
+                        load_q(ta, a); load_q(tb, b);
+                        if (mpq_sgn(tb) == 0) { mpq_clear(ta); mpq_clear(tb); return fail("Error: division by zero"); }
+                        mpq_div(ta, ta, tb);
+                        auto r = writable_result(ap);
+                        set_rational(*r, ta, cfg.mpfr_prec);
+                        mpq_clear(ta); mpq_clear(tb);
+                        st.push_back(r);
+                        continue;
+                    }
+                    mpfr_t ta, tb; mpfr_init2(ta, cfg.mpfr_prec); mpfr_init2(tb, cfg.mpfr_prec);
+                    load_mpfr(ta, a); load_mpfr(tb, b);
+                    if (mpfr_zero_p(tb)) { mpfr_clear(ta); mpfr_clear(tb); return fail("Error: division by zero"); }
+                    auto r = writable_result(ap);
+                    r->is_int = false; r->z10 = 0; r->is_dec = false; r->is_rat = false; r->is_cplx = false;
+                    mpfr_set_prec(r->f, cfg.mpfr_prec);
+                    mpfr_div(r->f, ta, tb, MPFR_RNDN);
+                    mpfr_clear(ta); mpfr_clear(tb);
+                    r->dim = rdim;
+                    st.push_back(r);
+                } else {
+                    const BigValue &basev = a, &expv = b;
+                    // exponent must be unitless (Dimension==0); already checked statically unless its dimension was unknown
+                    if (!(expv.dim == Dimension())) return fail("Error: exponent must be unitless");
+                    if (basev.is_cplx || expv.is_cplx || (real_sign(basev) < 0 && !is_real_integer(expv))) {
+                        // principal value; a negative real base with a fractional exponent lands here too
+                        long k = 0;
+                        Dimension rdim = dinfo[i].known ? dinfo[i].dim : small_integer(expv, k) ? basev.dim.pow_int((int)k) : basev.dim;
+                        st.push_back(complex_power(basev, expv, rdim, cfg));
+                        continue;
+                    }
+                    // estimate log10(base) and magnitude of exponent
+                    long double log10base = basev.estimate_log10();
+                    long double exp_val_approx;
+                    bool exp_is_int = expv.is_int && mpz_sgn(expv.i) >= 0; // negative exponents take the MPFR path
+                    unsigned long exp_ul = 0;
+                    if (exp_is_int) {
+                        // if exponent too big (lots of digits), produce approximation
+                        unsigned long digits = expv.int_digits();
+                        if (digits > 18) {
+                            // produce nested approx: base^(1E<digits-1>) as a readable fallback
+                            res.approximate = true;
+                            return fail(basev.to_human(cfg.prefer_si) + string("^(1E") + to_string(digits - 1) + string(")"));
+                        }
+                        exp_ul = expv.int_get_ui();
+                        exp_val_approx = (long double)exp_ul;
+                    } else {
+                        // floating, decimal or negative exponent: approximate value
+                        exp_val_approx = expv.estimate_long_double();
+                    }
+                    // estimate log10(result) = exp * log10(base)
+                    long double est_log10 = exp_val_approx * log10base;
+                    if (!isfinite(est_log10) || est_log10 > (long_arg[i] ? cfg.max_digits * DIGIT_ARG_SCALE : cfg.max_digits)) {
+                        // overflow / huge result -> return approximate
+                        res.approximate = true;
+                        return fail(approx_from_log10(est_log10));
+                    }
+                    Dimension rdim;
+                    if (dinfo[i].known) rdim = dinfo[i].dim;
+                    else if (exp_is_int) rdim = basev.dim.pow_int((int)exp_ul);
+                    else if (expv.is_int && expv.z10 == 0 && mpz_fits_sint_p(expv.i)) rdim = basev.dim.pow_int((int)mpz_get_si(expv.i));
+                    else rdim = basev.dim; // approximate
+                    long e = 0; // exponent of an exact rational power
+                    // Try compute exactly if small
+                    if (basev.is_int && exp_is_int && (exp_ul <= 1000000UL || long_arg[i])) {
+                        // integer power (capped unless a digit query needs it exact), strength-reduced for factors of 2 and 10
+                        auto r = writable_result(ap);
+                        int_pow_reduced(*r, basev, exp_ul);
+                        r->dim = rdim;
+                        st.push_back(r);
+                    } else if (cfg.decimal_digits >= 0 && basev.is_dec && exp_is_int && exp_ul <= 1000000UL) {
+                        // exact decimal power: scale multiplies
+                        unsigned long sc = basev.dec_scale * exp_ul;
+                        auto r = writable_result(ap);
+                        mpz_pow_ui(r->i, basev.i, exp_ul);
+                        set_exact_kind(*r, false, sc);
+                        r->dim = rdim;
+                        st.push_back(r);
+                    } else if (cfg.decimal_digits < 0 && is_rational(basev) && exact_rational_power(basev, expv, e, cfg)) {
+                        // rational base or negative integer exponent: (n/d)^-k = d^k/n^k
+                        if (basev.is_int && mpz_sgn(basev.i) == 0) return fail("Error: division by zero");
+                        mpq_t x; mpq_init(x);
+                        load_q(x, basev);
+                        unsigned long k = e < 0 ? 0UL - (unsigned long)e : (unsigned long)e;
+                        mpz_pow_ui(mpq_numref(x), mpq_numref(x), k);
+                        mpz_pow_ui(mpq_denref(x), mpq_denref(x), k);
+                        if (e < 0) {
+                            mpz_swap(mpq_numref(x), mpq_denref(x));
+                            if (mpz_sgn(mpq_denref(x)) < 0) { mpz_neg(mpq_numref(x), mpq_numref(x)); mpz_neg(mpq_denref(x), mpq_denref(x)); }
+                        }
+                        auto r = writable_result(ap);
+                        set_rational(*r, x, cfg.mpfr_prec);
+                        mpq_clear(x);
+                        st.push_back(r);
+                    } else {
+                        // mpfr pow (a negative base is fine with an integral exponent)
+                        mpfr_t tbase, texp;
+                        mpfr_init2(tbase, cfg.mpfr_prec); mpfr_init2(texp, cfg.mpfr_prec);
+                        load_mpfr(tbase, basev);
+                        load_mpfr(texp, expv);
+                        auto r = writable_result(ap);
+                        r->is_int = false; r->z10 = 0; r->is_dec = false; r->is_rat = false; r->is_cplx = false;
+                        mpfr_set_prec(r->f, cfg.mpfr_prec);
+                        mpfr_pow(r->f, tbase, texp, MPFR_RNDN);
+                        mpfr_clear(tbase); mpfr_clear(texp);
+                        r->dim = rdim;
+                        st.push_back(r);
+                    }
+                }
+            } else if (tk.type == T_FUNC) {
+                // name, arity and argument dimensions were checked by infer_dimensions
+                vector<ValuePtr> args(st.end() - tk.nargs, st.end());
+                st.resize(st.size() - tk.nargs);
+                const FuncDef *fn = find_function(tk.text);
+                if (!fn->complex_args)
+                    for (const ValuePtr &arg : args)
+                        if (has_complex(*arg)) return fail("Error: " + tk.text + "() does not take complex numbers");
+                st.push_back(fn->call(args, cfg));
+            } else {
+                return fail("Internal error: unexpected token in RPN");
+            }
+        }
+        if (st.size() != 1) return fail(string("Error: invalid expression (stack size ") + to_string(st.size()) + ")");
+        res.value = st.back();
+        return res;
+    } catch (const exception &e) {
+        return fail(string("Error: ") + e.what());
+    }
+}
+
+pair<bool, string> eval_rpn(const vector<Token> &rpn, const EvalConfig &cfg) {
+    EvalResult r = eval_rpn_value(rpn, cfg);
+    if (r.value) return {false, format_value(*r.value, cfg)};
+    return {r.approximate, r.text};
+}
+
+// ----------------- Binary serialization: values and compiled RPN -----------------
+// Versioned, length-prefixed blobs for moving results between processes and caches without going through
+// decimal strings. Everything is in native byte order and 8-byte aligned, so a blob read into memory or
+// mmap'ed from a file is used in place. view_value() hands out read-only mpz/mpfr over the stored limbs
+// without parsing or copying. The header pins the format version, limb size and byte order, and a blob
+// written under a different one is rejected instead of misread.
+//
+//   BlobHeader | payload
+//   value payload: ValueRecord | limbs, or for a list ValueRecord | item value payloads
+//                  (a complex value is the list of its real and imaginary parts as VK_FLOAT payloads, an exact
+//                  fraction that of its numerator and positive denominator as VK_INT payloads)
+//   RPN payload:   uint64 token count | per token: TokenRecord | text (padded to 8) | value payload (T_VAL)
+// Version 2 added list values and function-call tokens, version 3 complex values, version 4 exact fractions.
+static const char BLOB_MAGIC[4] = { 'S', 'Q', 'L', 'C' };
+static const uint16_t BLOB_VERSION = 4;
+static const uint32_t BLOB_BYTE_ORDER = 0x01020304;
+enum BlobKind : uint8_t { BLOB_VALUE = 1, BLOB_RPN = 2 };
+enum ValueKind : uint8_t { VK_INT = 0, VK_DEC = 1, VK_FLOAT = 2, VK_LIST = 3, VK_COMPLEX = 4, VK_RAT = 5 };
+
+struct BlobHeader {
+    char magic[4];
+    uint16_t version;
+    uint8_t kind;          // BlobKind
+    uint8_t limb_bits;
+    uint32_t byte_order;   // BLOB_BYTE_ORDER as written
+    uint32_t reserved;
+    uint64_t payload_bytes;
+};
+struct ValueRecord {
+    uint8_t kind;          // ValueKind
+    uint8_t negative;      // VK_INT / VK_DEC: sign of the integer
+    uint16_t reserved;
+    int32_t dim[7];
+    int32_t mpfr_kind;     // VK_FLOAT: signed MPFR custom-interface kind
+    uint32_t reserved2;
+    uint64_t scale;        // VK_INT: z10, VK_DEC: dec_scale, VK_LIST: item count, VK_COMPLEX and VK_RAT: 2
+    int64_t exp;           // VK_FLOAT
+    int64_t prec;          // VK_FLOAT, VK_RAT: precision of the rounded value
+    uint64_t nlimbs;       // limbs that follow the record
+};
+struct TokenRecord {
+    uint32_t type;         // TokenType
+    uint32_t text_bytes;
+    int32_t nargs;         // T_FUNC
+    uint32_t reserved;
+    uint64_t value_bytes;  // T_VAL: size of the value payload that follows the text, else 0
+};
+static_assert(sizeof(BlobHeader) == 24 && sizeof(ValueRecord) == 72 && sizeof(TokenRecord) == 24, "blob layout");
+
+static size_t pad8(size_t n) { return (n + 7) & ~(size_t)7; }
+
+static void put_bytes(string &out, const void *p, size_t n) {
+    out.append((const char *)p, n);
+    out.append(pad8(n) - n, '\0');
+}
+
+static void put_float_payload(string &out, mpfr_srcptr x, const Dimension &dim) {
+    ValueRecord rec;
+    memset(&rec, 0, sizeof rec);
+    for (int k = 0; k < 7; ++k) rec.dim[k] = dim.p[k];
+    rec.kind = VK_FLOAT;
+    rec.mpfr_kind = mpfr_custom_get_kind(x);
+    rec.exp = mpfr_custom_get_exp(x);
+    rec.prec = mpfr_get_prec(x);
+    rec.nlimbs = mpfr_custom_get_size(rec.prec) / sizeof(mp_limb_t);
+    put_bytes(out, &rec, sizeof rec);
+    put_bytes(out, mpfr_custom_get_significand(x), rec.nlimbs * sizeof(mp_limb_t));
+}
+
+static void put_int_payload(string &out, mpz_srcptr z, const Dimension &dim) {
+    ValueRecord rec;
+    memset(&rec, 0, sizeof rec);
+    for (int k = 0; k < 7; ++k) rec.dim[k] = dim.p[k];
+    rec.kind = VK_INT;
+    rec.negative = mpz_sgn(z) < 0;
+    rec.nlimbs = mpz_size(z);
+    put_bytes(out, &rec, sizeof rec);
+    put_bytes(out, mpz_limbs_read(z), rec.nlimbs * sizeof(mp_limb_t));
+}
+
+static void put_value_payload(string &out, const BigValue &v) {
+    ValueRecord rec;
+    memset(&rec, 0, sizeof rec);
+    for (int k = 0; k < 7; ++k) rec.dim[k] = v.dim.p[k];
+    const void *limbs;
+    if (v.is_cplx) {
+        rec.kind = VK_COMPLEX;
+        rec.scale = 2;
+        put_bytes(out, &rec, sizeof rec);
+        put_float_payload(out, v.f, v.dim);
+        put_float_payload(out, v.im.get(), v.dim);
+        return;
+    } else if (v.is_rat) {
+        rec.kind = VK_RAT;
+        rec.scale = 2;
+        rec.prec = mpfr_get_prec(v.f);
+        put_bytes(out, &rec, sizeof rec);
+        put_int_payload(out, mpq_numref(v.q), v.dim);
+        put_int_payload(out, mpq_denref(v.q), v.dim);
+        return;
+    } else if (v.is_list) {
+        rec.kind = VK_LIST;
+        rec.scale = v.items.size();
+        put_bytes(out, &rec, sizeof rec);
+        for (const auto &item : v.items) put_value_payload(out, *item);
+        return;
+    } else if (v.is_int || v.is_dec) {
+        rec.kind = v.is_int ? VK_INT : VK_DEC;
+        rec.negative = mpz_sgn(v.i) < 0;
+        rec.scale = v.is_int ? v.z10 : v.dec_scale;
+        rec.nlimbs = mpz_size(v.i);
+        limbs = mpz_limbs_read(v.i);
+    } else {
+        put_float_payload(out, v.f, v.dim);
+        return;
+    }
+    put_bytes(out, &rec, sizeof rec);
+    put_bytes(out, limbs, rec.nlimbs * sizeof(mp_limb_t));
+}
+
+static string blob_with_header(BlobKind kind, const string &payload) {
+    BlobHeader h;
+    memset(&h, 0, sizeof h);
+    memcpy(h.magic, BLOB_MAGIC, 4);
+    h.version = BLOB_VERSION;
+    h.kind = kind;
+    h.limb_bits = (uint8_t)(sizeof(mp_limb_t) * 8);
+    h.byte_order = BLOB_BYTE_ORDER;
+    h.payload_bytes = payload.size();
+    string out((const char *)&h, sizeof h);
+    return out + payload;
+}
+
+string serialize_value(const BigValue &v) {
+    string payload;
+    put_value_payload(payload, v);
+    return blob_with_header(BLOB_VALUE, payload);
+}
+
+string serialize_rpn(const vector<Token> &rpn) {
+    string payload;
+    uint64_t n = rpn.size();
+    put_bytes(payload, &n, sizeof n);
+    for (const Token &tk : rpn) {
+        string value;
+        if (tk.type == T_VAL) {
+            if (!tk.val) throw runtime_error("Cannot serialize an unbound value token");
+            put_value_payload(value, *tk.val);
+        }
+        TokenRecord rec = { (uint32_t)tk.type, (uint32_t)tk.text.size(), tk.nargs, 0, value.size() };
+        put_bytes(payload, &rec, sizeof rec);
+        put_bytes(payload, tk.text.data(), tk.text.size());
+        payload += value;
+    }
+    return blob_with_header(BLOB_RPN, payload);
+}
+
+struct ValueView;
+static size_t parse_value_payload(const char *p, size_t avail, ValueView &view, int depth = 0);
+
+// Read-only view of a value payload inside a blob. It stays valid as long as the blob memory does.
+struct ValueView {
+    const ValueRecord *rec = nullptr;
+    const mp_limb_t *limbs = nullptr;  // VK_LIST: start of the item payloads
+    size_t bytes = 0;                  // whole payload, list items included
+
+    bool is_float() const { return rec->kind == VK_FLOAT; }
+    bool is_list() const { return rec->kind == VK_LIST; }
+    bool is_complex() const { return rec->kind == VK_COMPLEX; }
+    bool is_rational() const { return rec->kind == VK_RAT; }
+    // VK_LIST: the items, in order; VK_COMPLEX: the real and imaginary parts; VK_RAT: numerator and denominator
+    vector<ValueView> items() const {
+        vector<ValueView> out(rec->scale);
+        const char *p = (const char *)limbs, *end = (const char *)rec + bytes;
+        for (auto &item : out) p += parse_value_payload(p, end - p, item, 1);
+        return out;
+    }
+    // VK_INT / VK_DEC: the integer, aliasing the stored limbs
+    mpz_srcptr integer(mpz_t tmp) const {
+        mp_size_t n = (mp_size_t)rec->nlimbs;
+        return mpz_roinit_n(tmp, limbs, rec->negative ? -n : n);
+    }
+    // VK_FLOAT: the MPFR number, aliasing the stored significand; use only as a source operand
+    mpfr_srcptr real(mpfr_t tmp) const {
+        mpfr_custom_init_set(tmp, rec->mpfr_kind, rec->exp, rec->prec, const_cast<mp_limb_t *>(limbs));
+        return tmp;
+    }
+    ValuePtr copy() const {
+        auto v = make_shared<BigValue>();
+        for (int k = 0; k < 7; ++k) v->dim.p[k] = rec->dim[k];
+        if (is_list()) {
+            v->is_int = false;
+            v->is_list = true;
+            for (const ValueView &item : items()) v->items.push_back(item.copy());
+        } else if (is_complex()) {
+            vector<ValueView> parts = items();
+            mpfr_t tmp;
+            mpfr_set_prec(v->f, parts[0].rec->prec);
+            mpfr_set(v->f, parts[0].real(tmp), MPFR_RNDN);
+            v->make_complex(parts[1].rec->prec);
+            mpfr_set(v->im.get(), parts[1].real(tmp), MPFR_RNDN);
+        } else if (is_rational()) {
+            vector<ValueView> parts = items();
+            mpz_t tmp;
+            mpq_t q; mpq_init(q);
+            mpz_set(mpq_numref(q), parts[0].integer(tmp));
+            mpz_set(mpq_denref(q), parts[1].integer(tmp));
+            mpq_canonicalize(q);
+            set_rational(*v, q, (int)rec->prec);
+            mpq_clear(q);
+        } else if (is_float()) {
+            mpfr_t tmp;
+            v->is_int = false;
+            mpfr_set_prec(v->f, rec->prec);
+            mpfr_set(v->f, real(tmp), MPFR_RNDN); // same precision: exact
+        } else {
+            mpz_t tmp;
+            mpz_set(v->i, integer(tmp));
+            v->is_int = rec->kind == VK_INT;
+            v->is_dec = rec->kind == VK_DEC;
+            (v->is_int ? v->z10 : v->dec_scale) = rec->scale;
+        }
+        return v;
+    }
+};
+
+static void blob_check(bool ok) {
+    if (!ok) throw runtime_error("Corrupt or truncated blob");
+}
+
+// Precisions the engine evaluates at. Anything else is corruption, and would trip MPFR's assertions.
+static bool blob_prec_ok(int64_t prec) { return prec >= MPFR_PREC_MIN && prec <= MAX_MPFR_PREC; }
+
+// Validates a value payload at p (8-byte aligned, avail bytes) and returns its size
+static size_t parse_value_payload(const char *p, size_t avail, ValueView &view, int depth) {
+    blob_check(avail >= sizeof(ValueRecord) && depth < 64);
+    view.rec = (const ValueRecord *)p;
+    view.limbs = (const mp_limb_t *)(p + sizeof(ValueRecord));
+    const ValueRecord &r = *view.rec;
+    blob_check(r.nlimbs <= (avail - sizeof(ValueRecord)) / sizeof(mp_limb_t));
+    if (r.kind == VK_LIST || r.kind == VK_COMPLEX || r.kind == VK_RAT) {
+        blob_check(r.nlimbs == 0 && r.scale <= (avail - sizeof(ValueRecord)) / sizeof(ValueRecord));
+        blob_check(r.kind == VK_LIST || r.scale == 2);
+        if (r.kind == VK_RAT) blob_check(blob_prec_ok(r.prec));
+        size_t used = sizeof(ValueRecord);
+        for (uint64_t k = 0; k < r.scale; ++k) {
+            ValueView item;
+            used += parse_value_payload(p + used, avail - used, item, depth + 1);
+            if (r.kind == VK_COMPLEX) blob_check(item.is_float());
+            // the denominator is positive
+            if (r.kind == VK_RAT) blob_check(item.rec->kind == VK_INT && item.rec->scale == 0 && (k == 0 || (!item.rec->negative && item.rec->nlimbs > 0)));
+        }
+        return view.bytes = used;
+    }
+    if (r.kind == VK_FLOAT) {
+        int k = r.mpfr_kind < 0 ? -r.mpfr_kind : r.mpfr_kind;
+        blob_check(blob_prec_ok(r.prec) && k <= MPFR_REGULAR_KIND);
+        blob_check(r.nlimbs == mpfr_custom_get_size(r.prec) / sizeof(mp_limb_t));
+        if (k == MPFR_REGULAR_KIND) blob_check(r.exp >= mpfr_get_emin() && r.exp <= mpfr_get_emax());
+    } else {
+        blob_check(r.kind == VK_INT || r.kind == VK_DEC);
+        // z10 / dec_scale are zero-filled when the value is used: no more than the engine's digit limit
+        blob_check(r.scale <= (uint64_t)DEFAULT_MAX_DIGITS);
+        blob_check(r.nlimbs == 0 || view.limbs[r.nlimbs - 1] != 0); // normalised, as mpz_roinit_n requires
+    }
+    return view.bytes = sizeof(ValueRecord) + r.nlimbs * sizeof(mp_limb_t);
+}
+
+// Checks the header and returns the payload (aligned like the blob itself)
+static const char *blob_payload(const void *data, size_t len, BlobKind kind, size_t &payload_bytes) {
+    if (((uintptr_t)data & 7) != 0) throw runtime_error("Blob is not 8-byte aligned");
+    blob_check(len >= sizeof(BlobHeader));
+    const BlobHeader &h = *(const BlobHeader *)data;
+    if (memcmp(h.magic, BLOB_MAGIC, 4) != 0) throw runtime_error("Not a superqalc blob");
+    if (h.version != BLOB_VERSION) throw runtime_error("Unsupported blob version " + to_string(h.version));
+    if (h.limb_bits != sizeof(mp_limb_t) * 8 || h.byte_order != BLOB_BYTE_ORDER)
+        throw runtime_error("Blob was written on an incompatible platform");
+    if (h.kind != kind) throw runtime_error("Unexpected blob kind");
+    blob_check(h.payload_bytes <= len - sizeof(BlobHeader));
+    payload_bytes = h.payload_bytes;
+    return (const char *)data + sizeof(BlobHeader);
+}
+
+// Zero-copy access to a value blob, e.g. one mmap'ed from a file
+ValueView view_value(const void *data, size_t len) {
+    size_t n;
+    const char *p = blob_payload(data, len, BLOB_VALUE, n);
+    ValueView view;
+    blob_check(parse_value_payload(p, n, view) == n);
+    return view;
+}
+
+// Blobs that arrive through byte strings need not be aligned; such blobs are copied once before viewing
+template <class F>
+static auto with_aligned_blob(const void *data, size_t len, F &&fn) -> decltype(fn(data)) {
+    if (((uintptr_t)data & 7) == 0) return fn(data);
+    vector<uint64_t> buf(pad8(len) / 8);
+    memcpy(buf.data(), data, len);
+    return fn((const void *)buf.data());
+}
+
+ValuePtr deserialize_value(const void *data, size_t len) {
+    return with_aligned_blob(data, len, [&](const void *d) { return view_value(d, len).copy(); });
+}
+
+vector<Token> deserialize_rpn(const void *data, size_t len) {
+    return with_aligned_blob(data, len, [&](const void *d) {
+        size_t n;
+        const char *p = blob_payload(d, len, BLOB_RPN, n), *end = p + n;
+        blob_check(n >= sizeof(uint64_t));
+        uint64_t count;
+        memcpy(&count, p, sizeof count);
+        p += sizeof count;
+        blob_check(count <= (size_t)(end - p) / sizeof(TokenRecord));
+        vector<Token> rpn;
+        rpn.reserve(count);
+        for (uint64_t k = 0; k < count; ++k) {
+            blob_check((size_t)(end - p) >= sizeof(TokenRecord));
+            const TokenRecord &rec = *(const TokenRecord *)p;
+            p += sizeof rec;
+            blob_check(rec.type <= T_FUNC && pad8(rec.text_bytes) <= (size_t)(end - p));
+            Token tk{ (TokenType)rec.type, string(p, rec.text_bytes), nullptr, rec.nargs };
+            p += pad8(rec.text_bytes);
+            blob_check((rec.type == T_VAL) == (rec.value_bytes != 0) && rec.value_bytes <= (size_t)(end - p));
+            if (rec.type == T_VAL) {
+                ValueView view;
+                blob_check(parse_value_payload(p, rec.value_bytes, view) == rec.value_bytes);
+                tk.val = view.copy();
+                p += rec.value_bytes;
+            }
+            rpn.push_back(move(tk));
+        }
+        blob_check(p == end);
+        return rpn;
+    });
+}
+
+// ----------------- Sessions: reactive named values -----------------
+// A Session holds named cells ("rate" -> "5%", "total" -> "principal * rate"). Each cell keeps its compiled
+// RPN and its last value. Changing a cell only marks that cell; recompute() walks the cells in dependency
+// order and re-evaluates a cell only if it changed itself or one of the cells it references produced a
+// different value, so unchanged heavy intermediates are reused as shared ValuePtrs. Names shadow units.
+// Not thread-safe: callers serialise access to one Session.
+struct SessionCell {
+    string expr;
+    vector<Token> rpn;
+    vector<string> refs;  // identifiers the expression mentions (potential dependencies)
+    ValuePtr value;       // null if the cell has no exact value (error, approximation, 'to' conversion)
+    string text;          // formatted result or error
+    bool approximate = false;
+    bool changed = true;  // needs evaluation on the next recompute()
+};
+
+static bool same_value(const ValuePtr &a, const ValuePtr &b) {
+    if (a == b) return true;
+    if (!a || !b || a->is_int != b->is_int || a->is_dec != b->is_dec || a->is_list != b->is_list || a->is_rat != b->is_rat ||
+        a->is_cplx != b->is_cplx || !(a->dim == b->dim)) return false;
+    if (a->is_list) {
+        if (a->items.size() != b->items.size()) return false;
+        for (size_t k = 0; k < a->items.size(); ++k) if (!same_value(a->items[k], b->items[k])) return false;
+        return true;
+    }
+    if (a->is_int) return a->z10 == b->z10 && mpz_cmp(a->i, b->i) == 0;
+    if (a->is_dec) return a->dec_scale == b->dec_scale && mpz_cmp(a->i, b->i) == 0;
+    if (a->is_rat) return mpq_equal(a->q, b->q) != 0;
+    if (a->is_cplx && (mpfr_equal_p(a->im.get(), b->im.get()) == 0 || mpfr_get_prec(a->im.get()) != mpfr_get_prec(b->im.get()))) return false;
+    return mpfr_equal_p(a->f, b->f) != 0 && mpfr_get_prec(a->f) == mpfr_get_prec(b->f);
+}
+
+static bool valid_session_name(const string &name) {
+    if (name.empty() || name == "to") return false;
+    for (char c : name) if (!isalpha((unsigned char)c) && c != '_') return false; // tokenizer identifiers have no digits
+    return true;
+}
+
+class Session {
+public:
+    EvalConfig cfg;
+
+    // define or redefine a cell; takes effect on the next recompute()
+    void set(const string &name, const string &expr) {
+        if (!valid_session_name(name)) throw runtime_error("Invalid variable name: " + name);
+        bool is_new = !cells.count(name);
+        SessionCell &c = cells[name];
+        c.expr = expr;
+        c.refs.clear();
+        c.rpn.clear();
+        c.changed = true;
+        try {
+            c.rpn = shunting_yard(tokenize(expr));
+            for (const Token &tk : c.rpn) if (tk.type == T_IDENT) c.refs.push_back(tk.text);
+        } catch (const exception &e) {
+            c.rpn.clear();
+            c.text = string("Parse error: ") + e.what();
+        }
+        // cells that mention a new name now bind to it instead of a unit
+        if (is_new) for (auto &kv : cells) if (mentions(kv.second, name)) kv.second.changed = true;
+    }
+
+    void remove(const string &name) {
+        if (!cells.erase(name)) return;
+        for (auto &kv : cells) if (mentions(kv.second, name)) kv.second.changed = true;
+    }
+
+    // Re-evaluate what changed, in topological order. Returns the names whose result was recomputed.
+    vector<string> recompute() {
+        vector<string> order, cyclic;
+        topo_order(order, cyclic);
+        std::set<string> value_changed;
+        vector<string> updated;
+        for (const string &name : cyclic) {
+            SessionCell &c = cells[name];
+            c.value.reset(); c.approximate = false; c.changed = false;
+            c.text = "Error: circular reference involving '" + name + "'";
+            value_changed.insert(name);
+            updated.push_back(name);
+        }
+        for (const string &name : order) {
+            SessionCell &c = cells[name];
+            bool dirty = c.changed;
+            for (const string &r : c.refs) if (value_changed.count(r)) { dirty = true; break; }
+            if (!dirty) continue;
+            ValuePtr before = c.value;
+            evaluate_cell(c);
+            c.changed = false;
+            updated.push_back(name);
+            if (!same_value(before, c.value) || !c.value) value_changed.insert(name);
+        }
+        return updated;
+    }
+
+    bool has(const string &name) const { return cells.count(name) != 0; }
+    const SessionCell &cell(const string &name) const {
+        auto it = cells.find(name);
+        if (it == cells.end()) throw runtime_error("Unknown variable: " + name);
+        return it->second;
+    }
+    vector<string> names() const {
+        vector<string> out;
+        for (auto &kv : cells) out.push_back(kv.first);
+        return out;
+    }
+
+private:
+    map<string, SessionCell> cells;
+
+    static bool mentions(const SessionCell &c, const string &name) {
+        return find(c.refs.begin(), c.refs.end(), name) != c.refs.end();
+    }
+
+    // DFS post-order over cell references; cells on a cycle are reported separately
+    void topo_order(vector<string> &order, vector<string> &cyclic) const {
+        map<string, int> state; // 0 new, 1 on stack, 2 done
+        std::set<string> on_cycle;
+        vector<string> path;
+        function<void(const string &)> visit = [&](const string &name) {
+            state[name] = 1;
+            path.push_back(name);
+            for (const string &r : cells.at(name).refs) {
+                if (!cells.count(r)) continue;
+                if (state[r] == 1) {
+                    for (auto it = find(path.begin(), path.end(), r); it != path.end(); ++it) on_cycle.insert(*it);
+                } else if (state[r] == 0) {
+                    visit(r);
+                }
+            }
+            path.pop_back();
+            state[name] = 2;
+            order.push_back(name);
+        };
+        for (auto &kv : cells) if (state[kv.first] == 0) visit(kv.first);
+        order.erase(remove_if(order.begin(), order.end(), [&](const string &n) { return on_cycle.count(n) != 0; }), order.end());
+        cyclic.assign(on_cycle.begin(), on_cycle.end());
+    }
+
+    void evaluate_cell(SessionCell &c) {
+        c.value.reset();
+        c.approximate = false;
+        if (c.rpn.empty()) { if (c.text.empty()) c.text = "Error: empty expression"; return; }
+        // bind referenced cells as shared values
+        vector<Token> bound = c.rpn;
+        for (Token &tk : bound) {
+            if (tk.type != T_IDENT) continue;
+            auto it = cells.find(tk.text);
+            if (it == cells.end()) continue;
+            if (!it->second.value) { c.text = "Error: '" + tk.text + "' has no exact value"; return; }
+            tk.type = T_VAL;
+            tk.val = it->second.value;
+        }
+        EvalResult r = eval_rpn_value(bound, cfg);
+        c.value = r.value;
+        c.approximate = r.approximate;
+        c.text = r.value ? format_value(*r.value, cfg) : r.text;
+    }
+};
+
+// ----------------- Client quotas -----------------
+// Fairness between the clients of an in-process engine (API keys, Discord user IDs). Each client has a
+// token bucket of requests and one of CPU seconds. A request is refused while the request bucket is empty;
+// a client whose CPU bucket is exhausted is still served, in degraded mode: a small digit limit and
+// precision (big results come back as the usual approximations) and a short CPU cap. The CPU and GMP byte
+// caps are enforced inside the evaluation by check_deadline, because callers cannot preempt it; the CPU
+// actually used, workers included, is charged afterwards and may leave the bucket in debt.
+struct QuotaPolicy {
+    double requests_per_minute = 60, request_burst = 20;
+    double cpu_seconds_per_minute = 20, cpu_burst = 20;
+    double max_request_cpu = 10;               // seconds per evaluation
+    long long max_request_bytes = 1LL << 30;   // GMP/MPFR bytes one evaluation may hold at once
+    long double degraded_max_digits = 1000;
+    int degraded_precision = 64;
+    double degraded_request_cpu = 0.25;
+};
+
+struct ClientUsage {
+    uint64_t requests = 0, rejected = 0, degraded = 0;
+    double cpu_seconds = 0;
+    long long gmp_bytes = 0;       // sum over requests of the peak bytes held
+    long long gmp_peak_bytes = 0;  // largest single-request peak
+};
+
+static const size_t MAX_QUOTA_CLIENTS = 100000; // beyond this, idle clients with full buckets are forgotten
+
+class QuotaManager {
+public:
+    static QuotaManager &instance() {
+        static QuotaManager q;
+        return q;
+    }
+
+    void set_policy(const QuotaPolicy &p) { lock_guard<mutex> g(mu_); policy_ = p; }
+    QuotaPolicy policy() const { lock_guard<mutex> g(mu_); return policy_; }
+
+    ClientUsage usage(const string &client) const {
+        lock_guard<mutex> g(mu_);
+        auto it = clients_.find(client);
+        return it == clients_.end() ? ClientUsage() : it->second.usage;
+    }
+    void reset(const string &client) { lock_guard<mutex> g(mu_); clients_.erase(client); }
+
+    // Opens a request: false, with the refusal in r, while the client's request bucket is empty; otherwise cfg
+    // gets the client's caps and r.degraded tells whether its CPU bucket was exhausted
+    bool admit(const string &client, EvalConfig &cfg, EvalResult &r) {
+        lock_guard<mutex> g(mu_);
+        Client &c = client_state(client);
+        if (c.requests < 1) {
+            ++c.usage.rejected;
+            double wait = (1 - c.requests) * 60 / max(policy_.requests_per_minute, 1e-9);
+            ostringstream ss; ss << fixed << setprecision(1) << wait;
+            r.text = "Error: too many requests, retry in " + ss.str() + " s";
+            return false;
+        }
+        c.requests -= 1;
+        ++c.usage.requests;
+        r.degraded = c.cpu <= 0;
+        if (r.degraded) ++c.usage.degraded;
+        double cap = r.degraded ? policy_.degraded_request_cpu : policy_.max_request_cpu;
+        cfg.cpu_limit_ns = (long long)(cap * 1e9);
+        cfg.max_gmp_bytes = policy_.max_request_bytes;
+        if (r.degraded) {
+            cfg.max_digits = min(cfg.max_digits, policy_.degraded_max_digits);
+            cfg.mpfr_prec = min(cfg.mpfr_prec, policy_.degraded_precision);
+        }
+        return true;
+    }
+
+    // Charges an admitted request's CPU seconds and peak GMP bytes
+    void charge(const string &client, double cpu, long long bytes) {
+        lock_guard<mutex> g(mu_);
+        Client &c = client_state(client);
+        c.cpu -= cpu;
+        c.usage.cpu_seconds += cpu;
+        c.usage.gmp_bytes += bytes;
+        c.usage.gmp_peak_bytes = max(c.usage.gmp_peak_bytes, bytes);
+    }
+
+    EvalResult evaluate(const string &client, const vector<Token> &rpn, EvalConfig cfg) {
+        EvalResult admitted;
+        if (!admit(client, cfg, admitted)) return admitted;
+        install_gmp_accounting();
+        gmp_peak_bytes = gmp_live_bytes;
+        cfg.gmp_start_bytes = gmp_live_bytes;
+        cfg.cpu_start_ns = thread_cpu_ns();
+        EvalResult r = eval_rpn_value(rpn, cfg);
+        r.degraded = admitted.degraded;
+        charge(client, (thread_cpu_ns() - cfg.cpu_start_ns) / 1e9, max(0LL, gmp_peak_bytes - cfg.gmp_start_bytes));
+        return r;
+    }
+
+private:
+    struct Client {
+        double requests = 0, cpu = 0; // bucket levels; cpu may go negative
+        chrono::steady_clock::time_point refilled;
+        ClientUsage usage;
+    };
+    mutable mutex mu_;
+    QuotaPolicy policy_;
+    unordered_map<string, Client> clients_;
+
+    // caller holds mu_; the client's buckets are refilled up to now
+    Client &client_state(const string &client) {
+        auto now = chrono::steady_clock::now();
+        auto it = clients_.find(client);
+        if (it == clients_.end()) {
+            if (clients_.size() >= MAX_QUOTA_CLIENTS) forget_idle(now);
+            Client c;
+            c.requests = policy_.request_burst;
+            c.cpu = policy_.cpu_burst;
+            c.refilled = now;
+            it = clients_.emplace(client, c).first;
+        }
+        Client &c = it->second;
+        double dt = chrono::duration<double>(now - c.refilled).count();
+        c.refilled = now;
+        c.requests = min(policy_.request_burst, c.requests + dt * policy_.requests_per_minute / 60);
+        c.cpu = min(policy_.cpu_burst, c.cpu + dt * policy_.cpu_seconds_per_minute / 60);
+        return c;
+    }
+
+    void forget_idle(chrono::steady_clock::time_point now) {
+        for (auto it = clients_.begin(); it != clients_.end();) {
+            double dt = chrono::duration<double>(now - it->second.refilled).count();
+            bool full = it->second.requests + dt * policy_.requests_per_minute / 60 >= policy_.request_burst &&
+                        it->second.cpu + dt * policy_.cpu_seconds_per_minute / 60 >= policy_.cpu_burst;
+            it = full ? clients_.erase(it) : next(it);
+        }
+    }
+};
+
+// ----------------- Streaming evaluation -----------------
+// Input that arrives in pieces, e.g. a long calculation pasted over several chat messages. append() tokenizes
+// up to the last token that more text could still change and pushes the tokens through a ShuntingYard, whose
+// RPN output is final as soon as it is written. While the input is still arriving, a background thread folds
+// that output: every operator or function call whose operands are all there is evaluated and replaced by a
+// T_VAL token (the splice sessions use for cells), so finish() is left with what the last chunks added. The
+// first subtree that fails or only has an approximation stops the folding, and finish() reports it from the
+// full evaluation; so does 'to', whose right side is a unit rather than a value. With a client, the stream is
+// one request under QuotaManager, admitted by the first append(); the worker's CPU time and GMP bytes are
+// charged with finish()'s. append(), finish() and close() may come from different threads: they take turns on
+// call_mu_. close() (and the destructor) cancel the worker's evaluation in flight instead of waiting for it.
+class StreamEvaluator {
+public:
+    explicit StreamEvaluator(const EvalConfig &cfg = EvalConfig(), const string &client = "") : cfg_(cfg), base_cfg_(cfg), client_(client) {}
+    ~StreamEvaluator() { close(); }
+    StreamEvaluator(const StreamEvaluator &) = delete;
+    StreamEvaluator &operator=(const StreamEvaluator &) = delete;
+
+    void append(const string &chunk) {
+        lock_guard<mutex> turn(call_mu_);
+        if (!started_) start();
+        pending_ += chunk;
+        if (!error_.empty()) return;
+        vector<Token> toks;
+        size_t first = feed(toks, true);
+        lock_guard<mutex> g(mu_);
+        try {
+            for (size_t k = first; k < toks.size(); ++k) yard_.push(toks[k]);
+        } catch (const exception &e) {
+            error_ = string("Parse error: ") + e.what();
+        }
+        cv_.notify_one();
+    }
+
+    // Evaluates everything appended since the last finish() and starts over
+    EvalResult finish() {
+        lock_guard<mutex> turn(call_mu_);
+        stop_worker();
+        EvalResult r = admitted_;
+        if (!started_ || r.text.empty()) {
+            vector<Token> toks;
+            size_t first = feed(toks, false);
+            try {
+                if (error_.empty()) {
+                    for (size_t k = first; k < toks.size(); ++k) yard_.push(toks[k]);
+                    yard_.finish();
+                }
+            } catch (const exception &e) {
+                error_ = string("Parse error: ") + e.what();
+            }
+            r = run();
+        }
+        reset();
+        return r;
+    }
+
+    // Drops the input; an evaluation running in the worker stops at its next deadline check
+    void close() {
+        cancel_ = true;
+        lock_guard<mutex> turn(call_mu_);
+        stop_worker();
+        reset();
+    }
+
+private:
+    EvalConfig cfg_, base_cfg_;
+    string client_;
+    bool started_ = false;
+    EvalResult admitted_;      // the refusal, or degraded, from QuotaManager::admit
+    string pending_;           // text not tokenized yet
+    Token last_{T_COMMA, ""};  // last token so far: a following sign is unary after an operator
+    bool has_last_ = false;
+    string error_;             // parse error; the rest of the input is only collected
+    ShuntingYard yard_;        // output is shared with the worker under mu_
+    size_t scan_ = 0;          // output tokens the worker has looked at
+    bool stop_ = false;
+    atomic<bool> cancel_{false};
+    long long worker_cpu_ns_ = 0, worker_bytes_ = 0;
+    mutex call_mu_;            // held for a whole append() or finish()
+    mutex mu_;
+    condition_variable cv_;
+    thread worker_;
+
+    void start() {
+        started_ = true;
+        if (!client_.empty()) {
+            if (!QuotaManager::instance().admit(client_, cfg_, admitted_)) return;
+            install_gmp_accounting();
+        }
+        worker_ = thread([this] { fold(); });
+    }
+
+    // Tokenizes pending_ after last_ into toks; returns the index of the first new token
+    size_t feed(vector<Token> &toks, bool more_input) {
+        if (has_last_) toks.push_back(last_);
+        size_t first = toks.size();
+        pending_.erase(0, tokenize_more(pending_, 0, toks, more_input));
+        if (toks.size() > first) { last_ = toks.back(); has_last_ = true; }
+        return first;
+    }
+
+    void fold() {
+        EvalConfig cfg = cfg_;
+        cfg.cancel = &cancel_;
+        gmp_peak_bytes = gmp_live_bytes;
+        cfg.gmp_start_bytes = gmp_live_bytes;
+        cfg.cpu_start_ns = thread_cpu_ns();
+        vector<Token> &rpn = yard_.output;
+        vector<size_t> starts; // where the subtree of each operand on the evaluation stack begins in rpn
+        unique_lock<mutex> lk(mu_);
+        while (true) {
+            cv_.wait(lk, [&] { return stop_ || scan_ < rpn.size(); });
+            if (stop_) break;
+            const Token &tk = rpn[scan_];
+            size_t arity = tk.type == T_FUNC ? (size_t)tk.nargs : tk.type != T_OP ? 0 : tk.text == "neg" ? 1 : 2;
+            if (tk.type == T_TO || starts.size() < arity) break;
+            if (tk.type != T_FUNC && tk.type != T_OP) { starts.push_back(scan_++); continue; }
+            size_t s = arity ? starts[starts.size() - arity] : scan_, e = scan_;
+            vector<Token> sub(rpn.begin() + s, rpn.begin() + e + 1);
+            lk.unlock();
+            EvalResult r = eval_rpn_value(sub, cfg);
+            lk.lock();
+            if (!r.value) break;
+            starts.resize(starts.size() - arity);
+            starts.push_back(s);
+            rpn.erase(rpn.begin() + s + 1, rpn.begin() + e + 1);
+            rpn[s] = Token{T_VAL, "", r.value};
+            scan_ = s + 1;
+        }
+        worker_cpu_ns_ = thread_cpu_ns() - cfg.cpu_start_ns;
+        worker_bytes_ = max(0LL, gmp_peak_bytes - cfg.gmp_start_bytes);
+    }
+
+    void stop_worker() {
+        if (!worker_.joinable()) return;
+        { lock_guard<mutex> g(mu_); stop_ = true; }
+        cv_.notify_one();
+        worker_.join();
+    }
+
+    // Evaluates the folded RPN in the calling thread, charging the client for it and the worker
+    EvalResult run() {
+        EvalResult r;
+        EvalConfig cfg = cfg_;
+        cfg.cancel = &cancel_;
+        bool metered = started_ && !client_.empty();
+        if (metered) {
+            gmp_peak_bytes = gmp_live_bytes;
+            cfg.gmp_start_bytes = gmp_live_bytes;
+            cfg.cpu_start_ns = thread_cpu_ns();
+            if (cfg.cpu_limit_ns >= 0) cfg.cpu_limit_ns = max(0LL, cfg.cpu_limit_ns - worker_cpu_ns_);
+        }
+        if (!error_.empty()) r.text = error_;
+        else if (yard_.output.empty()) r.text = "Error: empty expression";
+        else r = eval_rpn_value(yard_.output, cfg);
+        if (metered) {
+            r.degraded = admitted_.degraded;
+            long long bytes = max(worker_bytes_, gmp_peak_bytes - cfg.gmp_start_bytes);
+            QuotaManager::instance().charge(client_, (worker_cpu_ns_ + thread_cpu_ns() - cfg.cpu_start_ns) / 1e9, max(0LL, bytes));
+        }
+        return r;
+    }
+
+    void reset() {
+        cfg_ = base_cfg_;
+        started_ = false;
+        admitted_ = EvalResult();
+        pending_.clear();
+        has_last_ = false;
+        error_.clear();
+        yard_ = ShuntingYard();
+        scan_ = 0;
+        stop_ = false;
+        cancel_ = false;
+        worker_cpu_ns_ = worker_bytes_ = 0;
+    }
+};
+
+// ----------------- CLI and main -----------------
+// Define SUPERQALC_NO_MAIN to include this file as the evaluation engine of another program (superqalc_tower).
+#ifndef SUPERQALC_NO_MAIN
+static bool enter_pressed_nonblocking() {
+    fd_set set; FD_ZERO(&set); FD_SET(0, &set);
+    struct timeval tv; tv.tv_sec = 0; tv.tv_usec = 0;
+    int rv = select(1, &set, NULL, NULL, &tv);
+    if (rv > 0) {
+        char buf[2] = {0}; ssize_t n = read(0, buf, 1);
+        if (n > 0 && (buf[0] == '\n' || buf[0] == '\r')) return true;
+    }
+    return false;
+}
+
+static void print_usage_and_exit(const char *prog) {
+    cerr << "Usage: " << prog << " '<expression>' [--si] [--max-digits=N] [--precision=bits] [--decimal=N] [--round=half-even|half-up|down|up|floor|ceiling] [--repeat-digits=N] [--timeout=seconds] [--python]\nExamples:\n  " << prog << " \"5 m + 12 cm\"\n  " << prog << " \"100 km to m\"\n  " << prog << " \"primepi(1e12)\"\n";
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    ios::sync_with_stdio(false);
+    cin.tie(nullptr);
+
+    if (argc < 2) print_usage_and_exit(argv[0]);
+    string expr = argv[1];
+    EvalConfig cfg;
+    double timeout_s = -1;
+    bool python_syntax = false;
+    for (int i = 2; i < argc; ++i) {
+        string a = argv[i];
+        if (a.rfind("--max-digits=", 0) == 0) {
+            cfg.max_digits = safe_stold(a.substr(12));
+        } else if (a.rfind("--precision=", 0) == 0) {
             cfg.mpfr_prec = stoi(a.substr(12));
+            if (cfg.mpfr_prec < MPFR_PREC_MIN || cfg.mpfr_prec > MAX_MPFR_PREC) print_usage_and_exit(argv[0]);
+        } else if (a.rfind("--decimal=", 0) == 0) {
+            cfg.decimal_digits = stoi(a.substr(10));
+            if (cfg.decimal_digits < 0) print_usage_and_exit(argv[0]);
+        } else if (a.rfind("--repeat-digits=", 0) == 0) {
+            cfg.repeat_digits = stoul(a.substr(16));
+        } else if (a.rfind("--round=", 0) == 0) {
+            static const map<string, DecimalRounding> modes = {
+                {"half-even", DR_HALF_EVEN}, {"half-up", DR_HALF_UP}, {"down", DR_DOWN},
+                {"up", DR_UP}, {"floor", DR_FLOOR}, {"ceiling", DR_CEILING} };
+            auto it = modes.find(a.substr(8));
+            if (it == modes.end()) print_usage_and_exit(argv[0]);
+            cfg.decimal_rounding = it->second;
+        } else if (a.rfind("--timeout=", 0) == 0) {
+            timeout_s = stod(a.substr(10));
         } else if (a == "--si") {
             cfg.prefer_si = true;
+        } else if (a == "--python") {
+            python_syntax = true;
         } else if (a == "--help" || a == "-h") {
             print_usage_and_exit(argv[0]);
         } else {
@@ -758,7 +4788,14 @@ int main(int argc, char **argv) {
 
     vector<Token> tokens;
     try {
-        tokens = tokenize(expr);
+        if (python_syntax) {
+            PythonParse p = tokenize_python(expr);
+            // exit status 2: symbolic, leave it to SymPy
+            if (!p.numeric) { cerr << "Not numeric: " << p.reason << "\n"; return 2; }
+            tokens = move(p.tokens);
+        } else {
+            tokens = tokenize(expr);
+        }
     } catch (const exception &e) {
         cerr << "Tokenize error: " << e.what() << "\n";
         return 1;
@@ -775,6 +4812,7 @@ int main(int argc, char **argv) {
         if (enter_pressed_nonblocking()) { cout << "Aborted.\n"; return 0; }
         usleep(CLI_ABORT_POLL_MS * 1000);
     }
+    if (timeout_s >= 0) cfg.deadline = chrono::steady_clock::now() + chrono::microseconds((long long)(timeout_s * 1e6));
     auto res = eval_rpn(rpn, cfg);
     if (res.first) {
         cout << "warning: Floating point overflow\n";
@@ -784,3 +4822,4 @@ int main(int argc, char **argv) {
     }
     return 0;
 }
+#endif // SUPERQALC_NO_MAIN
@@ -0,0 +1,462 @@
+// superqalc_perffuzz.cpp
+// Performance fuzzer for the onefile and tower pipelines. It looks for algorithmically slow inputs
+// rather than crashes: it mutates a corpus of expressions and measures two costs per input byte for
+// each pipeline, wall time and peak GMP/MPFR heap. Mutants that set a new maximum for their target
+// and length class stay in the corpus. Inputs over the cost budget are saved to --out as regression
+// benchmarks, which --replay measures again later.
+// Each input runs in a forked child. A runaway evaluation is killed at --timeout-ms and charged as
+// over budget; it does not stall the fuzzer.
+// Build: g++ -O2 -std=c++17 -pthread superqalc_perffuzz.cpp -o superqalc_perffuzz -lmpfr -lgmp
+//
+// Usage: superqalc_perffuzz [--target=onefile|tower|both] [--seconds=N] [--iterations=N] [--out=DIR]
+//        superqalc_perffuzz --replay FILE...
+
+#define SUPERQALC_TOWER_NO_MAIN
+#include "superqalc_tower.cpp"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <random>
+#include <csignal>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <dirent.h>
+
+// ----------------- Configuration -----------------
+struct FuzzConfig {
+    bool targets[2] = {true, true};       // onefile, tower
+    long long iterations = 0;             // 0: until --seconds runs out
+    long long seconds = 60;
+    size_t max_len = 256;                 // mutants longer than this are truncated
+    int timeout_ms = 2000;                // per input; a timeout always counts as over budget
+    long long mem_limit_mb = 4096;        // RLIMIT_AS of the child
+    double budget_us_per_byte = 1000.0;   // wall time allowed per input byte
+    double budget_kb_per_byte = 256.0;    // peak GMP/MPFR heap allowed per input byte
+    string out_dir = "perf_regressions";
+    vector<string> corpus_dirs;
+    unsigned long long seed = 0;          // 0: random
+};
+
+enum FuzzTarget { FT_ONEFILE, FT_TOWER };
+static const char *TARGET_NAMES[2] = { "onefile", "tower" };
+static const char *STAGE_NAMES[2][3] = {
+    { "tokenize", "shunting_yard", "eval_rpn" },
+    { "parse_tower", "eval_tower", "format_tower" } };
+
+// Known pathological shapes: deep towers, long operator runs, giant literals, unit chains.
+static const char *SEED_INPUTS[] = {
+    "1+1", "5 km + 3 m", "100 km to m", "2^10", "10^999999", "9^9^9", "999^9999^999",
+    "10^10^10", "(2+3)^(10*7)^1e5", "1e100000", "2^(2^64)", "0.1*3", "1/3", "3 m / 2 s",
+    "(((((1)))))", "1-----1", "12345678901234567890*98765432109876543210", "2^2^2^2^2",
+    "45 deg to rad", "50% * 3 km", "1.5e3 m to km", "primepi(1e12)", "nthprime(10^9)", "primes(1, 1000)",
+    "cf(pi, 20)", "rationalize(pi, 1000)", "0.75 to frac", "partitions(10^6)", "bernoulli(1000)", "stirling1(300, 150)",
+    "stirling2(300, 150)", "zeta(3)", "1/7", "22/7 - 3", "(2/3)^-50", "1/3^99999", "sqrt(-1)",
+    "(-8)^(1/3)", "(1+i)^99999", "i^i", "exp(i*pi)", "digitsum(2^10000000)", "digitfreq(3^99999)", "digit(7^5000, -1)", "digitcount(10^(10^9))", "rec([1,1],[0,1],10^18,10^9+7)", "rec([2,-1],[3,5],1000)", "roots([1,0,-2])",
+    "slog_10(10^10^10)", "ssrt_3(10^10)", "ssrt_1000000(2)",
+};
+
+// Pieces the mutator splices in, biased toward the operators and units the engines special-case.
+static const char *DICTIONARY[] = {
+    "^", "^9", "^99", "^10", "^1e9", "*", "/", "+", "-", "(", ")", " to ", " to m", "e", "e9", "e99999",
+    ".", "9", "99", "999", "10", "0.5", "1e5", "km", "m", "s", "cm", "deg", "rad", "%", "kg", " ",
+    "primepi(", "nthprime(", "primes(", "cf(", "rationalize(", "frac", "partitions(", "bernoulli(",
+    "stirling1(", "stirling2(", "zeta(", "1/", "/7", "^-", "i", "2i", "sqrt(-", "digitsum(", "digitcount(", "digit(", "digitfreq(", ",", "rec(", "roots(", "[", "]",
+    "slog_", "ssrt_", "ssrt(",
+};
+static const string ALPHABET = "0123456789+-*/^().e kmsto%,[]";
+
+// ----------------- Heap accounting -----------------
+// GMP (and MPFR, which allocates through GMP's hooks) reports block sizes on free and realloc, so the
+// live byte count is exact without per-block headers. The counter is signed because blocks created
+// before the hooks were installed may still be freed through them.
+static atomic<long long> HEAP_LIVE{0};
+static atomic<long long> HEAP_PEAK{0};
+
+static void note_heap(long long live) {
+    long long peak = HEAP_PEAK.load();
+    while (live > peak && !HEAP_PEAK.compare_exchange_weak(peak, live)) {}
+}
+static void *fuzz_alloc(size_t n) {
+    void *p = malloc(n);
+    if (!p) abort();
+    note_heap(HEAP_LIVE += (long long)n);
+    return p;
+}
+static void *fuzz_realloc(void *p, size_t old_n, size_t n) {
+    void *q = realloc(p, n);
+    if (!q) abort();
+    note_heap(HEAP_LIVE += (long long)n - (long long)old_n);
+    return q;
+}
+static void fuzz_free(void *p, size_t n) {
+    free(p);
+    HEAP_LIVE -= (long long)n;
+}
+
+// ----------------- Running one input -----------------
+enum RunStatus { RUN_OK, RUN_TIMEOUT, RUN_CRASH };
+
+struct RunCost {
+    long long stage_ns[3] = { 0, 0, 0 };
+    long long peak_bytes = 0;   // above the heap in use when the input started
+    int status = RUN_OK;
+    int signal = 0;             // RUN_CRASH: terminating signal (SIGABRT for GMP overflow / out of memory)
+
+    long long total_ns() const { return stage_ns[0] + stage_ns[1] + stage_ns[2]; }
+    int slowest_stage() const { return (int)(max_element(stage_ns, stage_ns + 3) - stage_ns); }
+};
+
+// Records the stage time even when the stage throws: an error found late can be the expensive part.
+template <class F>
+static void timed_stage(long long &ns, F &&fn) {
+    auto t0 = chrono::steady_clock::now();
+    auto lap = [&] { ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - t0).count(); };
+    try {
+        fn();
+    } catch (...) {
+        lap();
+        throw;
+    }
+    lap();
+}
+
+// Runs in the child. Evaluation errors are ordinary results here: only their cost matters.
+static void run_pipeline(FuzzTarget target, const string &input, RunCost &cost) {
+    long long base = HEAP_LIVE.load();
+    HEAP_PEAK = base;
+    try {
+        if (target == FT_ONEFILE) {
+            vector<Token> tokens, rpn;
+            timed_stage(cost.stage_ns[0], [&] { tokens = tokenize(input); });
+            timed_stage(cost.stage_ns[1], [&] { rpn = shunting_yard(tokens); });
+            timed_stage(cost.stage_ns[2], [&] { eval_rpn(rpn, EvalConfig()); });
+        } else {
+            // slog/ssrt go through eval_hyper_inverse first, as in the tower main; all of it counts as evaluation
+            string inverse;
+            bool handled = false;
+            timed_stage(cost.stage_ns[1], [&] { handled = eval_hyper_inverse(input, inverse); });
+            if (!handled) {
+                vector<string> levels;
+                timed_stage(cost.stage_ns[0], [&] { levels = parse_tower(input); });
+                timed_stage(cost.stage_ns[1], [&] { levels = eval_tower_levels(levels); });
+                timed_stage(cost.stage_ns[2], [&] { format_tower(levels); });
+            }
+        }
+    } catch (const exception &) {
+    }
+    cost.peak_bytes = HEAP_PEAK.load() - base;
+}
+
+static RunCost run_input(FuzzTarget target, const string &input, const FuzzConfig &cfg) {
+    RunCost cost;
+    int fds[2];
+    if (pipe(fds) != 0) throw runtime_error("pipe failed");
+    auto t0 = chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid < 0) throw runtime_error("fork failed");
+    if (pid == 0) {
+        close(fds[0]);
+        struct rlimit lim;
+        lim.rlim_cur = lim.rlim_max = (rlim_t)cfg.mem_limit_mb << 20;
+        setrlimit(RLIMIT_AS, &lim);
+        run_pipeline(target, input, cost);
+        ssize_t w = write(fds[1], &cost, sizeof cost);
+        _exit(w == (ssize_t)sizeof cost ? 0 : 1);
+    }
+    close(fds[1]);
+    struct pollfd pfd = { fds[0], POLLIN, 0 };
+    int ready = poll(&pfd, 1, cfg.timeout_ms);
+    bool got = false;
+    if (ready > 0) got = read(fds[0], &cost, sizeof cost) == (ssize_t)sizeof cost;
+    else kill(pid, SIGKILL);
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (ready <= 0) {
+        cost = RunCost();
+        cost.status = RUN_TIMEOUT;
+        cost.stage_ns[1] = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - t0).count();
+    } else if (!got) {
+        cost = RunCost();
+        cost.status = RUN_CRASH;
+        cost.signal = WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+    }
+    return cost;
+}
+
+static double us_per_byte(const RunCost &c, const string &input) { return c.total_ns() / 1e3 / max<size_t>(1, input.size()); }
+static double kb_per_byte(const RunCost &c, const string &input) { return c.peak_bytes / 1024.0 / max<size_t>(1, input.size()); }
+
+// "" when within budget, otherwise the reason, which also prefixes the saved file name
+static string over_budget(const RunCost &c, const string &input, const FuzzConfig &cfg) {
+    if (c.status == RUN_TIMEOUT) return "timeout";
+    if (c.status == RUN_CRASH) return "crash";
+    if (us_per_byte(c, input) > cfg.budget_us_per_byte) return "slow";
+    if (kb_per_byte(c, input) > cfg.budget_kb_per_byte) return "mem";
+    return "";
+}
+
+static string describe(FuzzTarget target, const RunCost &c, const string &input) {
+    ostringstream ss;
+    ss << TARGET_NAMES[target] << ", " << input.size() << " B: ";
+    if (c.status == RUN_TIMEOUT) { ss << "timed out after " << c.total_ns() / 1000000 << " ms"; return ss.str(); }
+    if (c.status == RUN_CRASH) { ss << "crashed (signal " << c.signal << ")"; return ss.str(); }
+    ss << fixed << setprecision(1) << c.total_ns() / 1e3 << " us (" << us_per_byte(c, input) << " us/B, slowest "
+       << STAGE_NAMES[target][c.slowest_stage()] << "), peak " << c.peak_bytes / 1024.0 << " KiB ("
+       << kb_per_byte(c, input) << " KiB/B)";
+    return ss.str();
+}
+
+// ----------------- Regression benchmarks -----------------
+static unsigned long long fnv1a(const string &s) {
+    unsigned long long h = 1469598103934665603ULL;
+    for (unsigned char c : s) { h ^= c; h *= 1099511628211ULL; }
+    return h;
+}
+
+static vector<string> list_files(const string &dir) {
+    vector<string> out;
+    DIR *d = opendir(dir.c_str());
+    if (!d) return out;
+    while (struct dirent *e = readdir(d)) {
+        string name = e->d_name;
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".txt") == 0) out.push_back(dir + "/" + name);
+    }
+    closedir(d);
+    sort(out.begin(), out.end());
+    return out;
+}
+
+static string read_input_file(const string &path) {
+    ifstream in(path, ios::binary);
+    if (!in) throw runtime_error("cannot read " + path);
+    string s((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    if (!s.empty() && s.back() == '\n') s.pop_back();
+    return s;
+}
+
+// Saves <out>/<target>-<reason>-<hash>.txt holding the raw input, and appends a line to index.tsv.
+// Returns the path, or "" if that input was already saved.
+static string save_benchmark(FuzzTarget target, const string &reason, const string &input, const RunCost &c, const FuzzConfig &cfg) {
+    mkdir(cfg.out_dir.c_str(), 0755);
+    ostringstream name;
+    name << TARGET_NAMES[target] << "-" << reason << "-" << hex << setw(16) << setfill('0') << fnv1a(input) << ".txt";
+    string path = cfg.out_dir + "/" + name.str();
+    if (ifstream(path)) return "";
+    ofstream(path, ios::binary) << input << "\n";
+    ofstream index(cfg.out_dir + "/index.tsv", ios::app);
+    index << name.str() << "\t" << describe(target, c, input) << "\n";
+    return path;
+}
+
+// Target from a saved benchmark's name; files not made by this tool run on every enabled target.
+static vector<FuzzTarget> targets_for_file(const string &path, const FuzzConfig &cfg) {
+    string base = path.substr(path.find_last_of('/') + 1);
+    for (int t = 0; t < 2; ++t)
+        if (base.rfind(string(TARGET_NAMES[t]) + "-", 0) == 0) return { (FuzzTarget)t };
+    vector<FuzzTarget> out;
+    for (int t = 0; t < 2; ++t) if (cfg.targets[t]) out.push_back((FuzzTarget)t);
+    return out;
+}
+
+static int replay(const vector<string> &paths, const FuzzConfig &cfg) {
+    int over = 0;
+    for (const auto &p : paths) {
+        string input = read_input_file(p);
+        for (FuzzTarget t : targets_for_file(p, cfg)) {
+            RunCost c = run_input(t, input, cfg);
+            string reason = over_budget(c, input, cfg);
+            cout << p << ": " << describe(t, c, input);
+            if (!reason.empty()) { cout << "  OVER BUDGET (" << reason << ")"; ++over; }
+            cout << "\n";
+        }
+    }
+    cout << over << " over budget\n";
+    return over ? 1 : 0;
+}
+
+// ----------------- Mutation -----------------
+struct CorpusEntry {
+    string input;
+    FuzzTarget target;
+    double us_per_byte, kb_per_byte;
+};
+
+static size_t pick(mt19937_64 &rng, size_t n) { return n ? (size_t)(rng() % n) : 0; }
+
+static string mutate_once(string s, const vector<CorpusEntry> &corpus, mt19937_64 &rng) {
+    size_t n = s.size();
+    size_t a = pick(rng, n + 1), b = pick(rng, n + 1);
+    if (a > b) swap(a, b);
+    switch (pick(rng, 9)) {
+    case 0: { // grow a digit run: giant literals
+        size_t i = pick(rng, n);
+        if (n == 0 || !isdigit((unsigned char)s[i])) return s + string(1 + pick(rng, 64), '9');
+        size_t j = i;
+        while (j < n && isdigit((unsigned char)s[j])) ++j;
+        return s.substr(0, j) + string(1 + pick(rng, 4 * (j - i + 1)), s[i]) + s.substr(j);
+    }
+    case 1: // deepen a tower
+        return s + "^" + to_string(2 + pick(rng, 999));
+    case 2: // run of one operator
+        return s.substr(0, a) + string(1 + pick(rng, 32), "+-*/^"[pick(rng, 5)]) + s.substr(a);
+    case 3: // parenthesise
+        return s.substr(0, a) + "(" + s.substr(a, b - a) + ")" + s.substr(b);
+    case 4: // duplicate a slice
+        return s.substr(0, b) + s.substr(a, b - a) + s.substr(b);
+    case 5: // dictionary insert
+        return s.substr(0, a) + DICTIONARY[pick(rng, sizeof DICTIONARY / sizeof *DICTIONARY)] + s.substr(a);
+    case 6: // delete a slice
+        return s.substr(0, a) + s.substr(b);
+    case 7: // flip one character
+        if (n) s[pick(rng, n)] = ALPHABET[pick(rng, ALPHABET.size())];
+        return s;
+    default: { // crossover with another corpus entry
+        const string &o = corpus[pick(rng, corpus.size())].input;
+        return s.substr(0, a) + o.substr(pick(rng, o.size() + 1));
+    }
+    }
+}
+
+// Tournament of three, on time or on memory with equal odds, so both kinds of pathology keep breeding.
+static const CorpusEntry &select_parent(const vector<CorpusEntry> &corpus, mt19937_64 &rng) {
+    bool by_mem = rng() & 1;
+    const CorpusEntry *best = &corpus[pick(rng, corpus.size())];
+    for (int k = 0; k < 2; ++k) {
+        const CorpusEntry *c = &corpus[pick(rng, corpus.size())];
+        if (by_mem ? c->kb_per_byte > best->kb_per_byte : c->us_per_byte > best->us_per_byte) best = c;
+    }
+    return *best;
+}
+
+// ----------------- Fuzz loop -----------------
+static int length_class(size_t n) {
+    int c = 0;
+    while (n >>= 1) ++c;
+    return c;
+}
+
+static void fuzz(const FuzzConfig &cfg) {
+    mt19937_64 rng(cfg.seed ? cfg.seed : random_device{}());
+    vector<CorpusEntry> corpus;
+    // best (us/B, KiB/B) seen per target and length class; an input that beats either is kept
+    map<pair<int, int>, pair<double, double>> best;
+    set<unsigned long long> seen;
+    long long execs = 0, saved = 0;
+    auto start = chrono::steady_clock::now();
+
+    auto consider = [&](FuzzTarget t, const string &input, bool is_seed) {
+        if (!seen.insert(fnv1a(input) ^ (unsigned long long)t).second) return;
+        RunCost c = run_input(t, input, cfg);
+        ++execs;
+        string reason = over_budget(c, input, cfg);
+        if (!reason.empty()) {
+            string path = save_benchmark(t, reason, input, c, cfg);
+            if (!path.empty()) { ++saved; cout << "saved " << path << ": " << describe(t, c, input) << "\n"; }
+        }
+        // timeouts and crashes are already recorded; breeding from them would only hit the same wall
+        if (c.status != RUN_OK) return;
+        double us = us_per_byte(c, input), kb = kb_per_byte(c, input);
+        auto &b = best[{ (int)t, length_class(input.size()) }];
+        if (is_seed || us > b.first || kb > b.second) {
+            b.first = max(b.first, us);
+            b.second = max(b.second, kb);
+            corpus.push_back({ input, t, us, kb });
+        }
+    };
+
+    vector<string> seeds(begin(SEED_INPUTS), end(SEED_INPUTS));
+    vector<string> dirs = cfg.corpus_dirs;
+    dirs.push_back(cfg.out_dir);
+    for (const auto &d : dirs)
+        for (const auto &p : list_files(d)) seeds.push_back(read_input_file(p));
+    for (const auto &s : seeds)
+        for (int t = 0; t < 2; ++t)
+            if (cfg.targets[t]) consider((FuzzTarget)t, s.substr(0, cfg.max_len), true);
+    if (corpus.empty()) throw runtime_error("no seed input ran to completion");
+
+    for (long long it = 0; cfg.iterations == 0 || it < cfg.iterations; ++it) {
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (cfg.iterations == 0 && elapsed >= cfg.seconds) break;
+        const CorpusEntry &parent = select_parent(corpus, rng);
+        string input = parent.input;
+        FuzzTarget target = parent.target;
+        for (size_t k = 1 + pick(rng, 4); k > 0; --k) input = mutate_once(input, corpus, rng);
+        if (input.size() > cfg.max_len) input.resize(cfg.max_len);
+        consider(target, input, false);
+        if (execs % 200 == 0) {
+            double max_us = 0, max_kb = 0;
+            for (const auto &c : corpus) { max_us = max(max_us, c.us_per_byte); max_kb = max(max_kb, c.kb_per_byte); }
+            cout << fixed << setprecision(1) << "[" << (long long)elapsed << " s] execs " << execs << ", corpus "
+                 << corpus.size() << ", max " << max_us << " us/B, " << max_kb << " KiB/B, saved " << saved << "\n";
+        }
+    }
+    cout << "done: " << execs << " execs, corpus " << corpus.size() << ", saved " << saved << " to " << cfg.out_dir << "\n";
+}
+
+// ----------------- CLI and main -----------------
+static void print_usage_and_exit(const char *prog) {
+    cerr << "Usage: " << prog << " [--target=onefile|tower|both] [--seconds=N] [--iterations=N] [--max-len=N]\n"
+         << "       [--timeout-ms=N] [--mem-limit-mb=N] [--budget-us-per-byte=N] [--budget-kb-per-byte=N]\n"
+         << "       [--out=DIR] [--corpus=DIR] [--seed=N]\n"
+         << "       " << prog << " [--target=...] [--timeout-ms=N] [--budget-...] --replay FILE...\n";
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    // Before any GMP/MPFR work, so every block the engines allocate is counted.
+    mp_set_memory_functions(fuzz_alloc, fuzz_realloc, fuzz_free);
+
+    FuzzConfig cfg;
+    vector<string> replay_files;
+    bool replaying = false;
+    for (int i = 1; i < argc; ++i) {
+        string a = argv[i];
+        auto value = [&](const char *flag) { return a.substr(strlen(flag)); };
+        if (replaying) {
+            replay_files.push_back(a);
+        } else if (a == "--replay") {
+            replaying = true;
+        } else if (a.rfind("--target=", 0) == 0) {
+            string t = value("--target=");
+            if (t != "onefile" && t != "tower" && t != "both") print_usage_and_exit(argv[0]);
+            cfg.targets[FT_ONEFILE] = t != "tower";
+            cfg.targets[FT_TOWER] = t != "onefile";
+        } else if (a.rfind("--seconds=", 0) == 0) {
+            cfg.seconds = stoll(value("--seconds="));
+        } else if (a.rfind("--iterations=", 0) == 0) {
+            cfg.iterations = stoll(value("--iterations="));
+        } else if (a.rfind("--max-len=", 0) == 0) {
+            cfg.max_len = stoul(value("--max-len="));
+        } else if (a.rfind("--timeout-ms=", 0) == 0) {
+            cfg.timeout_ms = stoi(value("--timeout-ms="));
+        } else if (a.rfind("--mem-limit-mb=", 0) == 0) {
+            cfg.mem_limit_mb = stoll(value("--mem-limit-mb="));
+        } else if (a.rfind("--budget-us-per-byte=", 0) == 0) {
+            cfg.budget_us_per_byte = stod(value("--budget-us-per-byte="));
+        } else if (a.rfind("--budget-kb-per-byte=", 0) == 0) {
+            cfg.budget_kb_per_byte = stod(value("--budget-kb-per-byte="));
+        } else if (a.rfind("--out=", 0) == 0) {
+            cfg.out_dir = value("--out=");
+        } else if (a.rfind("--corpus=", 0) == 0) {
+            cfg.corpus_dirs.push_back(value("--corpus="));
+        } else if (a.rfind("--seed=", 0) == 0) {
+            cfg.seed = stoull(value("--seed="));
+        } else {
+            print_usage_and_exit(argv[0]);
+        }
+    }
+    if (replaying && replay_files.empty()) replay_files = list_files(cfg.out_dir);
+
+    try {
+        if (replaying) return replay(replay_files, cfg);
+        fuzz(cfg);
+    } catch (const exception &e) {
+        cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,406 @@
+// superqalc_policy.hpp
+// Compile-time specialised evaluation of onefile expressions, for C++ code that embeds the engine in hot loops.
+//
+//   #include "superqalc_policy.hpp"   // instead of superqalc_onefile.cpp
+//   superqalc::Program<superqalc::FastDouble> p("3*x^2 + 2*x + 1", {"x"});
+//   for (double x : xs) sum += p({x});
+//
+// A policy fixes, at compile time, the numeric domain (double, exact integer or MPFR at a fixed precision),
+// whether literals may carry units and what happens on overflow. Parsing reuses the onefile tokenizer and
+// shunting-yard, then Program compiles the RPN once: literals and unit factors become constants, and unit
+// dimensions are checked and folded away entirely (a dimensioned base needs a literal integer exponent), so
+// evaluation is a flat instruction loop over bare domain values with none of eval_rpn's runtime branching on
+// EvalConfig flags or value kinds. Identifiers that are not units are variables, bound by position.
+// Build: g++ -O2 -std=c++17 -pthread your_service.cpp -lmpfr -lgmp
+#pragma once
+
+#ifndef SUPERQALC_NO_MAIN
+#define SUPERQALC_NO_MAIN
+#endif
+#include "superqalc_onefile.cpp"
+
+#include <array>
+#include <stdexcept>
+#include <type_traits>
+
+namespace superqalc {
+
+// ----------------- Numeric domains -----------------
+// A domain provides value_type, conversion from an exact rational (literals and unit factors), the arithmetic
+// operators and a text form. pow_int is the integer-exponent power; has_real_functions enables sqrt/exp/'^'
+// with non-integer exponents.
+
+struct DoubleDomain {
+    using value_type = double;
+    static constexpr bool has_real_functions = true;
+    static value_type from_q(mpq_srcptr q) {
+        mpfr_t t; mpfr_init2(t, 53);
+        mpfr_set_q(t, q, MPFR_RNDN); // correctly rounded, unlike mpq_get_d
+        double d = mpfr_get_d(t, MPFR_RNDN);
+        mpfr_clear(t);
+        return d;
+    }
+    static value_type add(value_type a, value_type b) { return a + b; }
+    static value_type sub(value_type a, value_type b) { return a - b; }
+    static value_type mul(value_type a, value_type b) { return a * b; }
+    static value_type div(value_type a, value_type b) { return a / b; }
+    static value_type neg(value_type a) { return -a; }
+    static value_type pow(value_type a, value_type b) { return std::pow(a, b); }
+    static value_type pow_int(value_type a, long n) { return std::pow(a, (double)n); }
+    static value_type sqrt(value_type a) { return std::sqrt(a); }
+    static value_type exp(value_type a) { return std::exp(a); }
+    static bool finite(value_type a) { return std::isfinite(a); }
+    static string str(value_type a) { ostringstream ss; ss << setprecision(17) << a; return ss.str(); }
+};
+
+// Owning GMP integer with value semantics
+class BigInt {
+public:
+    BigInt() { mpz_init(z_); }
+    explicit BigInt(long v) { mpz_init_set_si(z_, v); }
+    BigInt(const BigInt &o) { mpz_init_set(z_, o.z_); }
+    BigInt(BigInt &&o) noexcept { mpz_init(z_); mpz_swap(z_, o.z_); }
+    BigInt &operator=(BigInt o) noexcept { mpz_swap(z_, o.z_); return *this; }
+    ~BigInt() { mpz_clear(z_); }
+    mpz_ptr get() { return z_; }
+    mpz_srcptr get() const { return z_; }
+private:
+    mpz_t z_;
+};
+
+// Exact integers; '/' must divide exactly and results are limited to DEFAULT_MAX_DIGITS digits
+struct IntegerDomain {
+    using value_type = BigInt;
+    static constexpr bool has_real_functions = false;
+    static value_type from_q(mpq_srcptr q) {
+        if (mpz_cmp_ui(mpq_denref(q), 1) != 0) throw runtime_error("not an integer in the integer domain");
+        value_type r; mpz_set(r.get(), mpq_numref(q)); return r;
+    }
+    static value_type add(const value_type &a, const value_type &b) { value_type r; mpz_add(r.get(), a.get(), b.get()); return r; }
+    static value_type sub(const value_type &a, const value_type &b) { value_type r; mpz_sub(r.get(), a.get(), b.get()); return r; }
+    static value_type mul(const value_type &a, const value_type &b) { value_type r; mpz_mul(r.get(), a.get(), b.get()); return r; }
+    static value_type div(const value_type &a, const value_type &b) {
+        if (mpz_sgn(b.get()) == 0) throw runtime_error("division by zero");
+        if (!mpz_divisible_p(a.get(), b.get())) throw runtime_error("inexact division in the integer domain");
+        value_type r; mpz_divexact(r.get(), a.get(), b.get()); return r;
+    }
+    static value_type neg(const value_type &a) { value_type r; mpz_neg(r.get(), a.get()); return r; }
+    static value_type pow(const value_type &a, const value_type &b) {
+        if (mpz_sgn(b.get()) < 0 || !mpz_fits_slong_p(b.get())) throw runtime_error("exponent out of range in the integer domain");
+        return pow_int(a, mpz_get_si(b.get()));
+    }
+    static value_type pow_int(const value_type &a, long n) {
+        if (n < 0) throw runtime_error("negative exponent in the integer domain");
+        // refuse before allocating, whatever the overflow policy
+        if (mpz_cmpabs_ui(a.get(), 1) > 0 && (long double)n * (mpz_sizeinbase(a.get(), 2) - 1) * log10l(2.0L) > DEFAULT_MAX_DIGITS)
+            throw overflow_error("result exceeds " + to_string((long long)DEFAULT_MAX_DIGITS) + " digits");
+        value_type r; mpz_pow_ui(r.get(), a.get(), (unsigned long)n); return r;
+    }
+    static value_type sqrt(const value_type &) { throw runtime_error("sqrt() is not available in the integer domain"); }
+    static value_type exp(const value_type &) { throw runtime_error("exp() is not available in the integer domain"); }
+    static bool finite(const value_type &a) { return mpz_sizeinbase(a.get(), 10) <= DEFAULT_MAX_DIGITS + 1; }
+    static string str(const value_type &a) { char *s = mpz_get_str(nullptr, 10, a.get()); string out(s); free(s); return out; }
+};
+
+// Owning MPFR real at a fixed precision
+template <mpfr_prec_t Bits>
+class Real {
+public:
+    Real() { mpfr_init2(x_, Bits); mpfr_set_zero(x_, 1); }
+    Real(const Real &o) { mpfr_init2(x_, Bits); mpfr_set(x_, o.x_, MPFR_RNDN); }
+    Real(Real &&o) noexcept { mpfr_init2(x_, Bits); mpfr_swap(x_, o.x_); }
+    Real &operator=(Real o) noexcept { mpfr_swap(x_, o.x_); return *this; }
+    ~Real() { mpfr_clear(x_); }
+    mpfr_ptr get() { return x_; }
+    mpfr_srcptr get() const { return x_; }
+private:
+    mpfr_t x_;
+};
+
+template <mpfr_prec_t Bits = DEFAULT_MPFR_PREC>
+struct MpfrDomain {
+    using value_type = Real<Bits>;
+    static constexpr bool has_real_functions = true;
+    static value_type from_q(mpq_srcptr q) { value_type r; mpfr_set_q(r.get(), q, MPFR_RNDN); return r; }
+    static value_type add(const value_type &a, const value_type &b) { value_type r; mpfr_add(r.get(), a.get(), b.get(), MPFR_RNDN); return r; }
+    static value_type sub(const value_type &a, const value_type &b) { value_type r; mpfr_sub(r.get(), a.get(), b.get(), MPFR_RNDN); return r; }
+    static value_type mul(const value_type &a, const value_type &b) { value_type r; mpfr_mul(r.get(), a.get(), b.get(), MPFR_RNDN); return r; }
+    static value_type div(const value_type &a, const value_type &b) { value_type r; mpfr_div(r.get(), a.get(), b.get(), MPFR_RNDN); return r; }
+    static value_type neg(const value_type &a) { value_type r; mpfr_neg(r.get(), a.get(), MPFR_RNDN); return r; }
+    static value_type pow(const value_type &a, const value_type &b) { value_type r; mpfr_pow(r.get(), a.get(), b.get(), MPFR_RNDN); return r; }
+    static value_type pow_int(const value_type &a, long n) { value_type r; mpfr_pow_si(r.get(), a.get(), n, MPFR_RNDN); return r; }
+    static value_type sqrt(const value_type &a) { value_type r; mpfr_sqrt(r.get(), a.get(), MPFR_RNDN); return r; }
+    static value_type exp(const value_type &a) { value_type r; mpfr_exp(r.get(), a.get(), MPFR_RNDN); return r; }
+    static bool finite(const value_type &a) { return mpfr_number_p(a.get()); }
+    static string str(const value_type &a) {
+        char *s = nullptr;
+        mpfr_asprintf(&s, "%.12Rg", a.get());
+        string out(s); mpfr_free_str(s);
+        return out;
+    }
+};
+
+// ----------------- Overflow policies -----------------
+// Certified: every intermediate result is checked (doubles must stay finite, integers within the digit
+// limit, MPFR values must be numbers) and a violation throws overflow_error. Unchecked: no per-operation test;
+// IEEE inf/nan or huge integers propagate to the result.
+struct Certified { static constexpr bool check = true; };
+struct Unchecked { static constexpr bool check = false; };
+
+// ----------------- Policies -----------------
+template <class Domain, bool Units, class Overflow>
+struct Policy {
+    using domain = Domain;
+    static constexpr bool units = Units;
+    using overflow = Overflow;
+};
+
+using FastDouble = Policy<DoubleDomain, false, Certified>;      // units off, every result certified finite
+using RawDouble = Policy<DoubleDomain, false, Unchecked>;      // units off, plain IEEE semantics
+using UnitDouble = Policy<DoubleDomain, true, Certified>;      // unit literals and 'to', dimensions checked at compile time
+using ExactInteger = Policy<IntegerDomain, false, Certified>;  // exact integers
+template <mpfr_prec_t Bits = DEFAULT_MPFR_PREC>
+using Precise = Policy<MpfrDomain<Bits>, true, Certified>;     // MPFR with units
+
+// ----------------- Compiled programs -----------------
+template <class P>
+class Program {
+public:
+    using D = typename P::domain;
+    using value_type = typename D::value_type;
+
+    // Throws runtime_error on syntax, dimension and domain errors (all detected here, not at evaluation)
+    explicit Program(const string &expr, const vector<string> &variables = {}) : variables_(variables) {
+        compile(shunting_yard(tokenize(expr)));
+    }
+
+    // Evaluate with variables bound in the order given to the constructor; for doubles, neither this nor
+    // the initializer_list form allocates
+    value_type operator()(const value_type *args, size_t nargs) const {
+        if (nargs != variables_.size()) throw invalid_argument("expected " + to_string(variables_.size()) + " variable value(s)");
+        if constexpr (is_trivially_copyable<value_type>::value) {
+            if (max_stack_ <= SMALL_STACK) {
+                array<value_type, SMALL_STACK> st;
+                return run(st.data(), args);
+            }
+        }
+        vector<value_type> st(max_stack_);
+        return run(st.data(), args);
+    }
+    value_type operator()(initializer_list<value_type> args = {}) const { return (*this)(args.begin(), args.size()); }
+    value_type operator()(const vector<value_type> &args) const { return (*this)(args.data(), args.size()); }
+
+    // Dimension of the result (in SI terms) and, after 'to', the unit it is expressed in
+    const Dimension &dimension() const { return result_dim_; }
+    const string &unit() const { return unit_name_; }
+
+    // Result text in the onefile style: the number, then the 'to' unit or SI compound unit
+    string format(const value_type &v) const {
+        string out = D::str(v);
+        if (!unit_name_.empty()) return out + " " + unit_name_;
+        string u = BigValue::compound_unit_string(result_dim_);
+        return u.empty() ? out : out + " " + u;
+    }
+
+private:
+    enum Op : uint8_t { CONST, VAR, ADD, SUB, MUL, DIV, NEG, POW, POW_INT, SQRT, EXP };
+    struct Instr { Op op; uint32_t arg; long n; };
+    static const size_t SMALL_STACK = 64;
+
+    vector<string> variables_;
+    vector<Instr> code_;
+    vector<value_type> consts_;
+    size_t max_stack_ = 0;
+    Dimension result_dim_;
+    string unit_name_;
+
+    value_type run(value_type *st, const value_type *vars) const {
+        size_t sp = 0;
+        for (const Instr &in : code_) {
+            switch (in.op) {
+            case CONST: st[sp++] = consts_[in.arg]; continue;
+            case VAR: st[sp++] = vars[in.arg]; continue;
+            case NEG: st[sp - 1] = D::neg(st[sp - 1]); break;
+            case SQRT: st[sp - 1] = D::sqrt(st[sp - 1]); break;
+            case EXP: st[sp - 1] = D::exp(st[sp - 1]); break;
+            case POW_INT: st[sp - 1] = D::pow_int(st[sp - 1], in.n); break;
+            case ADD: --sp; st[sp - 1] = D::add(st[sp - 1], st[sp]); break;
+            case SUB: --sp; st[sp - 1] = D::sub(st[sp - 1], st[sp]); break;
+            case MUL: --sp; st[sp - 1] = D::mul(st[sp - 1], st[sp]); break;
+            case DIV: --sp; st[sp - 1] = D::div(st[sp - 1], st[sp]); break;
+            case POW: --sp; st[sp - 1] = D::pow(st[sp - 1], st[sp]); break;
+            }
+            if constexpr (P::overflow::check)
+                if (!D::finite(st[sp - 1])) throw overflow_error("overflow in " + string(op_name(in.op)));
+        }
+        return std::move(st[0]);
+    }
+
+    static const char *op_name(Op op) {
+        switch (op) {
+        case ADD: return "+"; case SUB: return "-"; case MUL: return "*"; case DIV: return "/"; case NEG: return "negation";
+        case POW: case POW_INT: return "^"; case SQRT: return "sqrt"; case EXP: return "exp"; default: return "constant";
+        }
+    }
+
+    // compile-time knowledge of each stack slot
+    struct Slot { Dimension dim; bool is_const = false; long cval = 0; size_t code_begin = 0; };
+
+    uint32_t add_const(mpq_srcptr q) {
+        consts_.push_back(D::from_q(q));
+        if constexpr (P::overflow::check)
+            if (!D::finite(consts_.back())) throw overflow_error("constant out of range");
+        return (uint32_t)consts_.size() - 1;
+    }
+
+    static UnitPtr unit_or_null(const string &name) {
+        if (!P::units) return nullptr;
+        return UNIT_REG.resolve(name);
+    }
+
+    static void unit_factor_q(const Unit &u, mpq_t out) {
+        if (u.exact) { u.factor_q(out); return; }
+        if (!is_same<D, DoubleDomain>::value && !u.pi_divisor) throw runtime_error("unit " + u.name + " has no exact factor");
+        // pi-based units: rational approximation well beyond any domain's precision
+        mpfr_t f; mpfr_init2(f, 1024);
+        u.load_factor(f);
+        mpz_t m; mpz_init(m);
+        mpfr_exp_t e = mpfr_get_z_2exp(m, f);
+        mpq_set_z(out, m);
+        if (e >= 0) mpz_mul_2exp(mpq_numref(out), mpq_numref(out), (unsigned long)e);
+        else mpz_mul_2exp(mpq_denref(out), mpq_denref(out), (unsigned long)-e);
+        mpq_canonicalize(out);
+        mpz_clear(m); mpfr_clear(f);
+    }
+
+    void compile(const vector<Token> &rpn) {
+        vector<Slot> st;
+        auto pop = [&](const string &what) {
+            if (st.empty()) throw runtime_error("stack underflow " + what);
+            Slot s = st.back(); st.pop_back(); return s;
+        };
+        auto emit = [&](Op op, uint32_t arg = 0, long n = 0) { code_.push_back({op, arg, n}); };
+        mpq_t q, f; mpq_init(q); mpq_init(f);
+        try {
+            for (size_t k = 0; k < rpn.size(); ++k) {
+                const Token &tk = rpn[k];
+                if (tk.type == T_NUM) {
+                    size_t hash = tk.text.find('#');
+                    string num = tk.text.substr(0, hash), unit = hash == string::npos ? "" : tk.text.substr(hash + 1);
+                    mpz_t lit; mpz_init(lit);
+                    unsigned long scale = 0;
+                    bool ok = parse_exact_decimal(num, lit, scale);
+                    if (ok) decimal_to_q(q, lit, scale);
+                    mpz_clear(lit);
+                    if (!ok) throw runtime_error("bad number " + num);
+                    Slot s;
+                    s.code_begin = code_.size();
+                    if (!unit.empty()) {
+                        UnitPtr u = unit_or_null(unit);
+                        if (!u) throw runtime_error(P::units ? "Unknown unit: " + unit : "units are disabled in this policy");
+                        unit_factor_q(*u, f);
+                        mpq_mul(q, q, f);
+                        s.dim = u->dim;
+                    } else if (mpz_cmp_ui(mpq_denref(q), 1) == 0 && mpz_fits_slong_p(mpq_numref(q))) {
+                        s.is_const = true;
+                        s.cval = mpz_get_si(mpq_numref(q));
+                    }
+                    emit(CONST, add_const(q));
+                    st.push_back(s);
+                } else if (tk.type == T_IDENT) {
+                    auto v = find(variables_.begin(), variables_.end(), tk.text);
+                    Slot s;
+                    s.code_begin = code_.size();
+                    if (v != variables_.end()) {
+                        emit(VAR, (uint32_t)(v - variables_.begin()));
+                        st.push_back(s);
+                        continue;
+                    }
+                    UnitPtr u = unit_or_null(tk.text);
+                    if (!u) throw runtime_error("unknown variable or unit: " + tk.text);
+                    unit_factor_q(*u, q);
+                    emit(CONST, add_const(q));
+                    s.dim = u->dim;
+                    st.push_back(s);
+                } else if (tk.type == T_OP && tk.text == "neg") {
+                    Slot a = pop("-");
+                    a.is_const = a.is_const && a.cval != LONG_MIN;
+                    a.cval = -a.cval;
+                    emit(NEG);
+                    st.push_back(a);
+                } else if (tk.type == T_OP) {
+                    Slot b = pop(tk.text), a = pop(tk.text), r;
+                    r.code_begin = a.code_begin;
+                    const string &op = tk.text;
+                    if (op == "+" || op == "-") {
+                        if (!(a.dim == b.dim)) throw runtime_error("Unit mismatch for " + op);
+                        r.dim = a.dim;
+                        emit(op == "+" ? ADD : SUB);
+                    } else if (op == "*") {
+                        r.dim = a.dim + b.dim;
+                        emit(MUL);
+                    } else if (op == "/") {
+                        r.dim = a.dim - b.dim;
+                        emit(DIV);
+                    } else if (op == "^") {
+                        if (!(b.dim == Dimension())) throw runtime_error("exponent must be unitless");
+                        if (b.is_const && b.cval >= INT32_MIN && b.cval <= INT32_MAX) {
+                            // literal integer exponent: replace its code by an immediate operand
+                            code_.resize(b.code_begin);
+                            r.dim = a.dim.pow_int((int)b.cval);
+                            emit(POW_INT, 0, b.cval);
+                        } else {
+                            if (!(a.dim == Dimension())) throw runtime_error("a dimensioned base needs a literal integer exponent");
+                            emit(POW);
+                        }
+                    } else {
+                        throw runtime_error("unknown operator '" + op + "'");
+                    }
+                    st.push_back(r);
+                } else if (tk.type == T_FUNC) {
+                    if ((tk.text != "sqrt" && tk.text != "exp") || tk.nargs != 1)
+                        throw runtime_error("function not available in compiled programs: " + tk.text);
+                    if (!D::has_real_functions) throw runtime_error(tk.text + "() is not available in this domain");
+                    Slot a = pop(tk.text), r;
+                    if (!(a.dim == Dimension())) throw runtime_error(tk.text + "() takes dimensionless arguments");
+                    emit(tk.text == "sqrt" ? SQRT : EXP);
+                    r.code_begin = a.code_begin;
+                    st.push_back(r);
+                } else if (tk.type == T_TO) {
+                    // 'unit' must be the last token: the result is divided by its factor
+                    if (!P::units) throw runtime_error("units are disabled in this policy");
+                    if (k + 1 != rpn.size() || k == 0 || rpn[k - 1].type != T_IDENT) throw runtime_error("'to' must end the expression with a unit name");
+                    Slot target = pop("to"), val = pop("to");
+                    if (!(target.dim == val.dim)) throw runtime_error("Unit mismatch for 'to'");
+                    emit(DIV);
+                    unit_name_ = rpn[k - 1].text;
+                    st.push_back(val);
+                    result_dim_ = val.dim;
+                    break;
+                } else {
+                    throw runtime_error("unsupported token in compiled programs: " + tk.text);
+                }
+            }
+            if (st.size() != 1) throw runtime_error("invalid expression (stack size " + to_string(st.size()) + ")");
+            if (unit_name_.empty()) result_dim_ = st.back().dim;
+        } catch (...) {
+            mpq_clear(q); mpq_clear(f);
+            throw;
+        }
+        mpq_clear(q); mpq_clear(f);
+        // stack depth for the evaluation loop
+        size_t depth = 0;
+        for (const Instr &in : code_) {
+            if (in.op == CONST || in.op == VAR) max_stack_ = max(max_stack_, ++depth);
+            else if (in.op == ADD || in.op == SUB || in.op == MUL || in.op == DIV || in.op == POW) --depth;
+        }
+    }
+};
+
+// One-shot evaluation: compile and run
+template <class P>
+typename P::domain::value_type evaluate(const string &expr) {
+    return Program<P>(expr)();
+}
+
+} // namespace superqalc
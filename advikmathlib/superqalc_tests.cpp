@@ -0,0 +1,177 @@
+// Regression tests for the onefile engine: results as the CLI prints them, and binary blobs.
+// Build: g++ -O2 -std=c++17 -pthread superqalc_tests.cpp -o superqalc_tests -lmpfr -lgmp
+// Run ./superqalc_tests; it lists the failed checks and exits with status 1 if there are any.
+#define SUPERQALC_NO_MAIN
+#include "superqalc_onefile.cpp"
+
+static int checks = 0, failures = 0;
+
+static void expect(const string &what, const string &got, const string &want) {
+    ++checks;
+    if (got == want) return;
+    ++failures;
+    cout << "FAIL " << what << "\n  got:  " << got << "\n  want: " << want << "\n";
+}
+
+// Result text as the CLI prints it (approximations included)
+static string calc(const string &expr, const EvalConfig &cfg = EvalConfig()) {
+    try {
+        return eval_rpn(shunting_yard(tokenize(expr)), cfg).second;
+    } catch (const exception &e) {
+        return string("Parse error: ") + e.what();
+    }
+}
+
+static void expect_calc(const string &expr, const string &want, const EvalConfig &cfg = EvalConfig()) {
+    expect(expr, calc(expr, cfg), want);
+}
+
+// ----------------- Exact arithmetic -----------------
+static void test_exact_sums() {
+    // int + int above 2^64 must not round through MPFR
+    expect_calc("2^100+1", "1267650600228229401496703205377");
+    expect_calc("2^70-1", "1180591620717411303423");
+    expect_calc("18446744073709551616+18446744073709551616", "36893488147419103232");
+    // a quotient that reduced to an integer is as exact as one that did not
+    expect_calc("6/3+2^70", "1180591620717411303426");
+    expect_calc("5/3+2^70", "1180591620717411303425.(6)");
+}
+
+// ----------------- Combinatorial numbers -----------------
+static void test_bernoulli() {
+    // B_n is an exact fraction, an integer when the denominator is 1
+    expect_calc("bernoulli(0)", "1");
+    expect_calc("bernoulli(1)", "-0.5");
+    expect_calc("bernoulli(3)", "0");
+    expect_calc("bernoulli(12) to frac", "-691/2730");
+    expect_calc("bernoulli(20) * 330", "-174611");
+    // past the tangent-number range the numerator comes from the Euler product; the denominator is
+    // 2 * 3 * 11 * 251 (von Staudt-Clausen)
+    string frac = calc("bernoulli(250) to frac");
+    expect("bernoulli(250) denominator", frac.substr(frac.find('/') + 1), "16566");
+    expect_calc("bernoulli(250) * 16566", frac.substr(0, frac.find('/')));
+}
+
+// ----------------- Continued fractions -----------------
+static void test_continued_fractions() {
+    // rationalize() is an exact fraction that arithmetic and 'to frac' take as is
+    expect_calc("rationalize(pi, 1000) to frac", "355/113");
+    expect_calc("rationalize(-pi, 7)", "-3.(142857)");
+    expect_calc("rationalize(1/3, 10) + 1/6", "0.5");
+    expect_calc("rationalize(0.75, 100)", "0.75");
+    // an MPFR value whose own expansion ends keeps its last term, although the rounding interval's ends
+    // disagree on it ([2; 2, ...] and [2; 1, 1, ...])
+    expect_calc("cf(2.5, 5)", "[2, 2]");
+    expect_calc("cf(-2.5, 5)", "[-3, 2]");
+    expect_calc("cf(0.375, 5)", "[0, 2, 1, 2]");
+    expect_calc("cf(3.0, 5)", "[3]");
+    expect_calc("cf(2.5, 1)", "[2]");
+    expect_calc("cf(pi, 10)", "[3, 7, 15, 1, 292, 1, 1, 1, 2, 1]");
+}
+
+// ----------------- Unit conversion -----------------
+static void test_conversions() {
+    // an exact literal times an exact factor stays exact through 'to'
+    expect_calc("123456789012345678901in to m", "3135802440913580244.0854 m");
+    expect_calc("2.5km to m", "2500 m");
+    expect_calc("1ft to in", "12 in");
+    // inexact results carry as many significant digits as the precision does
+    EvalConfig low;
+    low.mpfr_prec = 20;
+    expect_calc("1m to ft", "3.2808 ft", low);
+    expect_calc("1m to ft", "3.28083989501312335958005249343832020997375328083989501312335958005249343832 ft");
+}
+
+// ----------------- Streaming -----------------
+static void test_streams() {
+    // dropping a stream cancels the evaluation its worker is in the middle of
+    auto t0 = chrono::steady_clock::now();
+    {
+        StreamEvaluator s;
+        s.append("primepi(1e14)+");
+        this_thread::sleep_for(chrono::milliseconds(100));
+    }
+    bool quick = chrono::steady_clock::now() - t0 < chrono::seconds(2);
+    expect("stream destroyed during primepi(1e14)", quick ? "quick" : "blocked", "quick");
+    StreamEvaluator s;
+    s.append("primepi(1e9)+");
+    s.close();
+    s.append("2+3");
+    EvalResult r = s.finish();
+    expect("stream after close", r.value ? format_value(*r.value, EvalConfig()) : r.text, "5");
+}
+
+// ----------------- Quotas and worker threads -----------------
+static void test_quotas() {
+    install_gmp_accounting();
+    // stirling1 and partitions do their work in parallel_range workers, which must stop at the quota too
+    EvalConfig mem;
+    mem.max_gmp_bytes = 100000;
+    expect_calc("stirling1(40000,3)", "Error: memory quota exceeded", mem);
+    EvalConfig cpu;
+    cpu.cpu_limit_ns = 50000000;
+    cpu.cpu_start_ns = thread_cpu_ns();
+    expect_calc("partitions(100000000)", "Error: CPU quota exceeded", cpu);
+    // a worker's exception reaches the caller
+    string got = "no exception";
+    try {
+        parallel_range(0, 1 << 20, [](uint64_t i) { if (i == 700000) throw runtime_error("worker failed"); }, 1);
+    } catch (const exception &e) {
+        got = e.what();
+    }
+    expect("exception in parallel_range", got, "worker failed");
+    // GMP running out of memory fails the evaluation, not the process
+    got = "allocated";
+    try {
+        counting_alloc((size_t)1 << 62);
+    } catch (const bad_alloc &e) {
+        got = e.what();
+    }
+    expect("GMP allocation of 2^62 bytes", got, "out of memory");
+}
+
+// ----------------- Binary blobs -----------------
+// Runs fn on a copy of blob; the payload must be refused as corrupt (not abort, not allocate without bound)
+template <class F>
+static void expect_corrupt(const string &what, const string &blob, F &&fn) {
+    string bad = blob;
+    fn(bad);
+    string got = "accepted";
+    try {
+        deserialize_value(bad.data(), bad.size());
+    } catch (const exception &e) {
+        got = e.what();
+    }
+    expect(what, got, "Corrupt or truncated blob");
+}
+
+// the ValueRecord of a blob's top-level value
+static ValueRecord &top_record(string &blob) { return *(ValueRecord *)&blob[sizeof(BlobHeader)]; }
+
+static void test_blobs() {
+    for (string expr : { "1/3", "2^100+1", "-22/7", "sqrt(2)", "1+2i", "[1/7, 5]", "7*10^300", "3in", "100cm" }) {
+        EvalResult r = eval_rpn_value(shunting_yard(tokenize(expr)), EvalConfig());
+        string blob = serialize_value(*r.value);
+        expect("round trip " + expr, format_value(*deserialize_value(blob.data(), blob.size()), EvalConfig()),
+               format_value(*r.value, EvalConfig()));
+    }
+    string third = serialize_value(*eval_rpn_value(shunting_yard(tokenize("1/3")), EvalConfig()).value);
+    expect_corrupt("fraction precision 2^40", third, [](string &b) { top_record(b).prec = (int64_t)1 << 40; });
+    expect_corrupt("fraction precision INT_MAX + 1", third, [](string &b) { top_record(b).prec = (int64_t)INT_MAX + 1; });
+    expect_corrupt("fraction precision 0", third, [](string &b) { top_record(b).prec = 0; });
+    string big = serialize_value(*eval_rpn_value(shunting_yard(tokenize("7*10^300")), EvalConfig()).value);
+    expect_corrupt("integer trailing zeros 2^40", big, [](string &b) { top_record(b).scale = (uint64_t)1 << 40; });
+    expect_corrupt("integer trailing zeros over max digits", big, [](string &b) { top_record(b).scale = (uint64_t)DEFAULT_MAX_DIGITS + 1; });
+}
+
+int main() {
+    test_exact_sums();
+    test_bernoulli();
+    test_continued_fractions();
+    test_conversions();
+    test_streams();
+    test_quotas();
+    test_blobs();
+    cout << checks - failures << "/" << checks << " checks passed\n";
+    return failures ? 1 : 0;
+}
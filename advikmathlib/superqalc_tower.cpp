@@ -2,6 +2,12 @@
 #include <vector>
 #include <string>
 #include <cctype>
+#include <cfloat>
+
+// Tower levels are full onefile expressions, evaluated by the onefile engine.
+// Build: g++ -O2 -std=c++17 -pthread superqalc_tower.cpp -o superqalc_tower -lmpfr -lgmp
+#define SUPERQALC_NO_MAIN
+#include "superqalc_onefile.cpp"
 
 // Check if string is all the same digit '9'
 bool is_all_nines(const std::string &num) {
@@ -41,33 +47,303 @@ std::string convert_if_special(const std::string &num) {
     return num;
 }
 
-// Recursively format tower
+// Format tower as a^(b^(c)); built in one pass so that long towers stay linear
 std::string format_tower(const std::vector<std::string> &exps) {
-    if (exps.size() == 1) {
-        return convert_if_special(exps[0]);
+    std::string out;
+    for (size_t k = 0; k < exps.size(); ++k) {
+        if (k > 0) out += "^(";
+        out += convert_if_special(exps[k]);
     }
-    return convert_if_special(exps[0]) + "^(" +
-           format_tower(std::vector<std::string>(exps.begin() + 1, exps.end())) + ")";
+    out.append(exps.empty() ? 0 : exps.size() - 1, ')');
+    return out;
 }
 
-// Parse string like "999^9999^999" into vector<string>
+// Parse string like "999^9999^999" or "(2+3)^(10*7)^1e5" into vector<string>.
+// Only '^' outside parentheses separates levels; each level is a onefile expression.
 std::vector<std::string> parse_tower(const std::string &expr) {
     std::vector<std::string> exps;
-    size_t pos = 0, prev = 0;
-    while ((pos = expr.find('^', prev)) != std::string::npos) {
-        exps.push_back(expr.substr(prev, pos - prev));
-        prev = pos + 1;
+    size_t prev = 0;
+    int depth = 0;
+    for (size_t pos = 0; pos < expr.size(); ++pos) {
+        char c = expr[pos];
+        if (c == '(') ++depth;
+        else if (c == ')') {
+            if (--depth < 0) throw std::runtime_error("Mismatched parentheses");
+        } else if (c == '^' && depth == 0) {
+            exps.push_back(trim(expr.substr(prev, pos - prev)));
+            prev = pos + 1;
+        }
     }
-    exps.push_back(expr.substr(prev));
+    if (depth != 0) throw std::runtime_error("Mismatched parentheses");
+    exps.push_back(trim(expr.substr(prev)));
     return exps;
 }
 
+static bool is_digit_string(const std::string &s) {
+    if (s.empty()) return false;
+    for (char c : s) if (!isdigit((unsigned char)c)) return false;
+    return true;
+}
+
+// Evaluate one level to the digit string format_tower expects (integral results are printed
+// exactly, anything else as the engine formats it). Throws on evaluation errors.
+static std::string eval_tower_level(const std::string &level) {
+    if (is_digit_string(level)) return level; // plain literal: nothing to evaluate
+    EvalConfig cfg;
+    EvalResult r = eval_rpn_value(shunting_yard(tokenize(level)), cfg);
+    if (!r.value) {
+        if (r.approximate) return r.text;
+        const std::string prefix = "Error: ";
+        throw std::runtime_error(r.text.rfind(prefix, 0) == 0 ? r.text.substr(prefix.size()) : r.text);
+    }
+    const BigValue &v = *r.value;
+    if (v.is_list || v.is_cplx) return v.to_human();
+    if (!v.is_int && v.dim == Dimension() && mpfr_zero_p(v.f)) return "0";
+    if (!v.is_int && v.dim == Dimension() && mpfr_integer_p(v.f) && mpfr_get_exp(v.f) <= (mpfr_exp_t)mpfr_get_prec(v.f)) {
+        mpz_t z; mpz_init(z);
+        mpfr_get_z(z, v.f, MPFR_RNDN);
+        char *s = mpz_get_str(NULL, 10, z);
+        std::string out(s); free(s);
+        mpz_clear(z);
+        return out;
+    }
+    return v.to_human();
+}
+
+// Evaluate all levels through the shared engine. Plain literals are taken as they are; the remaining
+// levels are spread over a bounded set of worker threads.
+std::vector<std::string> eval_tower_levels(const std::vector<std::string> &levels) {
+    std::vector<std::string> out(levels.size()), errs(levels.size());
+    std::vector<size_t> todo;
+    for (size_t k = 0; k < levels.size(); ++k) {
+        if (is_digit_string(levels[k])) out[k] = levels[k];
+        else todo.push_back(k);
+    }
+    parallel_range(0, todo.size(), [&](uint64_t j) {
+        size_t k = todo[j];
+        try { out[k] = eval_tower_level(levels[k]); }
+        catch (const std::exception &e) { errs[k] = e.what(); }
+    }, 1);
+    for (size_t k = 0; k < levels.size(); ++k)
+        if (!errs[k].empty()) throw std::runtime_error("level " + std::to_string(k + 1) + " (" + levels[k] + "): " + errs[k]);
+    return out;
+}
+
+// ----------------- Inverse hyperoperators: super-logarithm and super-root -----------------
+// Towers are handled in level-index form x = E^h(r) with E(y) = 10^y, so a tower never has to be
+// materialised: each '^' adds roughly one level. Canonical form: h == 0 for x < 10, otherwise 1 <= r < 10.
+struct LevelNum {
+    long h = 0;
+    long double r = 0;
+};
+
+static LevelNum level_canon(long h, long double r) {
+    if (isnan(r) || isinf(r)) throw std::runtime_error("level-index overflow");
+    while (r >= 10.0L) { r = log10l(r); ++h; }
+    while (h > 0 && r < 1.0L) { r = powl(10.0L, r); --h; }
+    return {h, r};
+}
+
+static bool level_less(const LevelNum &a, const LevelNum &b) {
+    return a.h != b.h ? a.h < b.h : a.r < b.r;
+}
+
+// value as long double, or +inf when it does not fit
+static long double level_to_ld(const LevelNum &x) {
+    long double v = x.r;
+    for (long k = 0; k < x.h; ++k) {
+        if (v > 4900.0L) return INFINITY;
+        v = powl(10.0L, v);
+    }
+    return v;
+}
+
+static LevelNum level_exp10(const LevelNum &x) { return level_canon(x.h + 1, x.r); }
+
+// log10(x) for x > 0
+static LevelNum level_log10(const LevelNum &x) {
+    if (x.h == 0) return level_canon(0, log10l(x.r));
+    return level_canon(x.h - 1, x.r);
+}
+
+// x + y for x, y >= 0; terms below long double resolution of the larger one are dropped
+static LevelNum level_add(LevelNum x, LevelNum y) {
+    if (level_less(x, y)) std::swap(x, y);
+    if (y.h == 0 && y.r == 0) return x;
+    long double xv = level_to_ld(x);
+    if (isfinite(xv) && isfinite(xv + level_to_ld(y))) return level_canon(0, xv + level_to_ld(y));
+    long double lx = level_to_ld(level_log10(x)), ly = level_to_ld(level_log10(y));
+    if (!isfinite(lx) || !isfinite(ly) || lx - ly > 40.0L) return x;
+    return level_exp10(level_canon(0, lx + log10l(1.0L + powl(10.0L, ly - lx))));
+}
+
+// x * y for x, y >= 0
+static LevelNum level_mul(const LevelNum &x, const LevelNum &y) {
+    long double xv = level_to_ld(x), yv = level_to_ld(y);
+    if (isfinite(xv) && isfinite(yv) && isfinite(xv * yv)) return level_canon(0, xv * yv);
+    // huge product: add logarithms; a factor below 1 has a negative log, applied only where it is visible
+    if (xv < 1.0L || yv < 1.0L) {
+        const LevelNum &big = xv < 1.0L ? y : x;
+        long double small_log = log10l(xv < 1.0L ? xv : yv);
+        LevelNum lb = level_log10(big);
+        long double lbv = level_to_ld(lb);
+        return level_exp10(isfinite(lbv) ? level_canon(0, lbv + small_log) : lb);
+    }
+    return level_exp10(level_add(level_log10(x), level_log10(y)));
+}
+
+// base^e for base >= 1
+static LevelNum level_pow(const LevelNum &base, const LevelNum &e) {
+    if (base.h == 0 && base.r == 1.0L) return level_canon(0, 1);
+    return level_exp10(level_mul(e, level_log10(base)));
+}
+
+// b↑↑n < x for b >= 1. The tower is nondecreasing in n, so it stops as soon as the comparison is decided:
+// once the tower reaches x, or once it stops growing (converged for b <= e^(1/e), or saturated).
+static bool tetrate_less(const LevelNum &b, unsigned long n, const LevelNum &x, const EvalConfig &cfg) {
+    if (n == 0) return level_less(level_canon(0, 1), x);
+    LevelNum t = b;
+    for (unsigned long k = 1; k < n && level_less(t, x); ++k) {
+        if ((k & 4095) == 0) check_deadline(cfg);
+        LevelNum next = level_pow(b, t);
+        if (!level_less(t, next)) break;
+        t = next;
+    }
+    return level_less(t, x);
+}
+
+// Continuous, monotone level-index parameter: 0..1 for x < 1, 1 + log10(x) for 1 <= x < 10, h + 1 + log10(r) above
+static long double level_psi(const LevelNum &x) {
+    if (x.h == 0) return x.r < 1.0L ? x.r : 1.0L + log10l(x.r);
+    return (long double)x.h + 1.0L + log10l(x.r);
+}
+
+static LevelNum level_from_psi(long double psi) {
+    if (psi < 1.0L) return level_canon(0, psi);
+    long double ip = floorl(psi);
+    long double r = powl(10.0L, psi - ip);
+    return ip < 2.0L ? level_canon(0, r) : level_canon((long)ip - 1, r);
+}
+
+// Tower level text (digit string, or approximation like "1.23e+00E456") -> level-index value
+static LevelNum level_from_text(const std::string &s) {
+    if (is_digit_string(s)) {
+        size_t start = s.find_first_not_of('0');
+        if (start == std::string::npos) return level_canon(0, 0);
+        std::string d = s.substr(start);
+        if (d.size() <= 18) return level_canon(0, std::stold(d));
+        long double lg = (long double)(d.size() - 1) + log10l(std::stold(d.substr(0, 18))) - 17.0L;
+        return level_exp10(level_canon(0, lg));
+    }
+    size_t epos = s.find_last_of("eE");
+    try {
+        if (epos != std::string::npos && epos > 0) {
+            long double lg = log10l(std::stold(s.substr(0, epos))) + std::stold(s.substr(epos + 1));
+            return level_exp10(level_canon(0, lg));
+        }
+        size_t used = 0;
+        long double v = std::stold(s, &used);
+        if (used == s.size() && v >= 0) return level_canon(0, v);
+    } catch (...) {}
+    throw std::runtime_error("tower level is not a plain number: " + s);
+}
+
+static LevelNum level_from_tower(const std::vector<std::string> &levels) {
+    LevelNum t = level_from_text(levels.back());
+    for (size_t k = levels.size() - 1; k-- > 0;) t = level_pow(level_from_text(levels[k]), t);
+    return t;
+}
+
+static std::string format_level(const LevelNum &x) {
+    char buf[64];
+    long double v = level_to_ld(x);
+    if (isfinite(v)) { snprintf(buf, sizeof buf, "%.12Lg", v); return buf; }
+    LevelNum e = level_log10(x);
+    long double ev = level_to_ld(e);
+    if (!isfinite(ev)) return "10^(" + format_level(e) + ")";
+    long double ip = floorl(ev);
+    snprintf(buf, sizeof buf, "%.9LfE%.0Lf", powl(10.0L, ev - ip), ip);
+    return buf;
+}
+
+// Super-logarithm with the linear approximation on (0, 1]: slog_b(x) = slog_b(log_b x) + 1,
+// slog_b(x) = x - 1 there. Also returns the smallest n with b↑↑n >= x.
+static std::string tower_slog(long double b, const LevelNum &x, const EvalConfig &cfg) {
+    if (!(b > expl(1.0L / expl(1.0L)))) throw std::runtime_error("slog base must exceed e^(1/e) ~ 1.4447");
+    LevelNum lb = level_canon(0, b);
+    LevelNum inv_log10b = level_canon(0, 1.0L / log10l(b));
+    LevelNum y = x;
+    long count = 0;
+    while (!(y.h == 0 && y.r <= 1.0L)) {
+        y = level_mul(level_log10(y), inv_log10b); // log_b
+        if ((++count & 4095) == 0) check_deadline(cfg);
+    }
+    long double slog = (long double)count + (y.r - 1.0L);
+    unsigned long n = 0;
+    for (LevelNum t = level_canon(0, 1); level_less(t, x); t = level_pow(lb, t))
+        if ((++n & 4095) == 0) check_deadline(cfg);
+    char buf[160];
+    snprintf(buf, sizeof buf, "%.9Lg (%.12Lg↑↑%lu >= x)", slog, b, n);
+    return buf;
+}
+
+// n-th super-root: the base b >= 1 with b↑↑n = x, by bisection on the level-index parameter of b
+static std::string tower_ssrt(unsigned long n, const LevelNum &x, const EvalConfig &cfg) {
+    if (n == 0) throw std::runtime_error("super-root height must be at least 1");
+    if (level_less(x, level_canon(0, 1))) throw std::runtime_error("super-root needs x >= 1");
+    long double lo = 1.0L, hi = level_psi(x);
+    for (int it = 0; it < 200 && hi - lo > 4 * LDBL_EPSILON * hi; ++it) {
+        long double mid = (lo + hi) / 2;
+        if (tetrate_less(level_from_psi(mid), n, x, cfg)) lo = mid; else hi = mid;
+    }
+    return format_level(level_from_psi((lo + hi) / 2));
+}
+
+// Wall-clock budget for slog/ssrt: bases close to e^(1/e) need very many tower steps before the comparison
+// with x is decided, and the bot runs this binary without a timeout of its own.
+static const double HYPER_INVERSE_TIMEOUT_S = 10.0;
+
+// "slog_<b>(<tower>)", "ssrt(<tower>)" or "ssrt_<n>(<tower>)"; returns false if expr is neither
+static bool eval_hyper_inverse(const std::string &expr, std::string &out) {
+    std::string e = trim(expr);
+    bool is_slog = e.rfind("slog", 0) == 0, is_ssrt = e.rfind("ssrt", 0) == 0;
+    if (!is_slog && !is_ssrt) return false;
+    size_t lp = e.find('(');
+    if (lp == std::string::npos || e.back() != ')') throw std::runtime_error("expected " + e.substr(0, 4) + "(...)");
+    std::string sub = e.substr(4, lp - 4);
+    std::string arg = e.substr(lp + 1, e.size() - lp - 2);
+    if (!sub.empty() && (sub[0] != '_' || sub.size() == 1)) throw std::runtime_error("expected " + e.substr(0, 4) + "_<number>(...)");
+    LevelNum x = level_from_tower(eval_tower_levels(parse_tower(arg)));
+    EvalConfig cfg;
+    cfg.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds((long long)(HYPER_INVERSE_TIMEOUT_S * 1000));
+    if (is_slog) {
+        if (sub.empty()) throw std::runtime_error("slog needs a base: slog_b(x)");
+        out = "slog_" + sub.substr(1) + "(" + arg + ") ≈ " + tower_slog(std::stold(sub.substr(1)), x, cfg);
+    } else {
+        unsigned long n = sub.empty() ? 2 : std::stoul(sub.substr(1));
+        out = "ssrt_" + std::to_string(n) + "(" + arg + ") ≈ " + tower_ssrt(n, x, cfg);
+    }
+    return true;
+}
+
+// Define SUPERQALC_TOWER_NO_MAIN to include this file in another program (superqalc_perffuzz).
+#ifndef SUPERQALC_TOWER_NO_MAIN
 int main() {
     std::string expr;
     std::getline(std::cin, expr);
 
-    auto exps = parse_tower(expr);
-    std::cout << format_tower(exps) << "\n";
+    try {
+        std::string inv;
+        if (eval_hyper_inverse(expr, inv)) {
+            std::cout << inv << "\n";
+            return 0;
+        }
+        auto exps = eval_tower_levels(parse_tower(expr));
+        std::cout << format_tower(exps) << "\n";
+    } catch (const std::exception &e) {
+        std::cout << "Error: " << e.what() << "\n";
+    }
 
     return 0;
 }
+#endif // SUPERQALC_TOWER_NO_MAIN
@@ -0,0 +1,514 @@
+// superqalc_value.hpp
+// Engine values as a C++ type, for code that does arithmetic on them directly instead of through strings.
+//
+//   #include "superqalc_value.hpp"
+//   using superqalc::Value;
+//   Value a = Value::parse("12.5", "km"), b = Value::unit("h"), x;
+//   x = a * 3 + b * b;            // one expression: mpz/mpfr calls straight into x, no intermediate values
+//   cout << x.str() << "\n";
+//
+// Operators build expression templates; the work happens when an expression is assigned to a Value. That
+// evaluation writes into the destination's own limbs and fuses what GMP and MPFR can do in one call:
+// 'd = a*b + c*d' is mpz_mul + mpz_addmul for integers and mpfr_mul + mpfr_fma (one rounding for the sum)
+// for reals, 'x = x + y*k' is a single addmul/fma, and a scalar factor uses the _si variants. Any
+// intermediate that still needs storage takes a thread-local scratch slot that keeps its limbs between
+// evaluations, so a steady-state loop allocates nothing, unlike eval_rpn which allocates a BigValue per node.
+//
+// Like BigValue, a Value is an exact integer or an MPFR real, stored in SI units with its Dimension; + - and
+// unary minus check dimensions before any arithmetic (runtime_error "Unit mismatch"), * and / combine them.
+// Integers stay exact through + - *, '/' and any real or double operand make the result real, rounded to the
+// destination's precision (DEFAULT_MPFR_PREC unless set_precision was called).
+//
+// Expressions hold references to their operands: assign them to a Value in the same statement rather than
+// keeping them in an 'auto' variable.
+#pragma once
+
+#include "superqalc_policy.hpp" // brings in the engine (once, with SUPERQALC_NO_MAIN)
+
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+
+namespace superqalc {
+
+class Value;
+
+// ----------------- Scratch slots -----------------
+namespace detail {
+
+// LIFO pool of initialised numbers per thread; a slot keeps its limbs after release, so reusing it for a
+// value of similar size costs no allocation
+template <class Num>
+struct ScratchPool {
+    vector<unique_ptr<Num>> slots;
+    size_t top = 0;
+    Num *acquire() {
+        if (top == slots.size()) slots.emplace_back(new Num());
+        return slots[top++].get();
+    }
+    void release() { --top; }
+};
+
+struct IntNum {
+    mpz_t z;
+    IntNum() { mpz_init(z); }
+    ~IntNum() { mpz_clear(z); }
+};
+struct RealNum {
+    mpfr_t f;
+    RealNum() { mpfr_init2(f, DEFAULT_MPFR_PREC); }
+    ~RealNum() { mpfr_clear(f); }
+};
+
+inline ScratchPool<IntNum> &int_pool() { thread_local ScratchPool<IntNum> p; return p; }
+inline ScratchPool<RealNum> &real_pool() { thread_local ScratchPool<RealNum> p; return p; }
+
+// A scratch number taken from the pool on first use and returned when the holder goes out of scope
+class IntScratch {
+public:
+    IntScratch() = default;
+    IntScratch(const IntScratch &) = delete;
+    IntScratch &operator=(const IntScratch &) = delete;
+    ~IntScratch() { if (n_) int_pool().release(); }
+    mpz_ptr get(mpz_srcptr) {
+        if (!n_) n_ = int_pool().acquire();
+        return n_->z;
+    }
+private:
+    IntNum *n_ = nullptr;
+};
+
+class RealScratch {
+public:
+    RealScratch() = default;
+    RealScratch(const RealScratch &) = delete;
+    RealScratch &operator=(const RealScratch &) = delete;
+    ~RealScratch() { if (n_) real_pool().release(); }
+    // slot at the precision of the destination it will be combined into
+    mpfr_ptr get(mpfr_srcptr like) {
+        if (!n_) n_ = real_pool().acquire();
+        if (mpfr_get_prec(n_->f) != mpfr_get_prec(like)) mpfr_set_prec(n_->f, mpfr_get_prec(like));
+        return n_->f;
+    }
+private:
+    RealNum *n_ = nullptr;
+};
+
+template <class Dst> using Scratch = typename conditional<is_same<Dst, mpz_ptr>::value, IntScratch, RealScratch>::type;
+
+// The arithmetic primitives, overloaded on the representation
+inline void add(mpz_ptr d, mpz_srcptr a, mpz_srcptr b) { mpz_add(d, a, b); }
+inline void add(mpfr_ptr d, mpfr_srcptr a, mpfr_srcptr b) { mpfr_add(d, a, b, MPFR_RNDN); }
+inline void sub(mpz_ptr d, mpz_srcptr a, mpz_srcptr b) { mpz_sub(d, a, b); }
+inline void sub(mpfr_ptr d, mpfr_srcptr a, mpfr_srcptr b) { mpfr_sub(d, a, b, MPFR_RNDN); }
+inline void mul(mpz_ptr d, mpz_srcptr a, mpz_srcptr b) { mpz_mul(d, a, b); }
+inline void mul(mpfr_ptr d, mpfr_srcptr a, mpfr_srcptr b) { mpfr_mul(d, a, b, MPFR_RNDN); }
+inline void mul_si(mpz_ptr d, mpz_srcptr a, long n) { mpz_mul_si(d, a, n); }
+inline void mul_si(mpfr_ptr d, mpfr_srcptr a, long n) { mpfr_mul_si(d, a, n, MPFR_RNDN); }
+inline void neg(mpz_ptr d) { mpz_neg(d, d); }
+inline void neg(mpfr_ptr d) { mpfr_neg(d, d, MPFR_RNDN); }
+// d += a*b (or d -= a*b): one call, and for reals one rounding
+inline void addmul(mpz_ptr d, mpz_srcptr a, mpz_srcptr b, bool negate) { negate ? mpz_submul(d, a, b) : mpz_addmul(d, a, b); }
+inline void addmul(mpfr_ptr d, mpfr_srcptr a, mpfr_srcptr b, bool negate) {
+    if (!negate) { mpfr_fma(d, a, b, d, MPFR_RNDN); return; }
+    mpfr_fms(d, a, b, d, MPFR_RNDN); // a*b - d, correctly rounded; negating is exact
+    mpfr_neg(d, d, MPFR_RNDN);
+}
+
+} // namespace detail
+
+// ----------------- Expressions -----------------
+// Every node provides:
+//   leaf            true for Value (its number can be read in place)
+//   dim()           result dimension; throws on a unit mismatch
+//   is_int()        whether the result is an exact integer
+//   refs(p)         whether evaluation reads the number p (aliasing)
+//   eval(dst)       dst = node, for dst an mpz_ptr (only when is_int()) or an mpfr_ptr
+//   accumulate(dst, negate)  dst += node (or -=); only called on nodes with !refs(dst)
+template <class E>
+struct Expr {
+    const E &self() const { return static_cast<const E &>(*this); }
+};
+
+namespace detail {
+// Operand storage: Values by reference, nodes (a few pointers) by value
+template <class E> using stored = typename conditional<is_same<E, Value>::value, const Value &, const E>::type;
+
+template <class E> mpz_srcptr int_arg(const E &e, mpz_ptr like, IntScratch &s);
+template <class E> mpfr_srcptr real_arg(const E &e, mpfr_ptr like, RealScratch &s);
+inline mpz_srcptr arg(const Value &e, mpz_ptr like, IntScratch &s);
+template <class E> mpz_srcptr arg(const E &e, mpz_ptr like, IntScratch &s) { return int_arg(e, like, s); }
+template <class E> mpfr_srcptr arg(const E &e, mpfr_ptr like, RealScratch &s) { return real_arg(e, like, s); }
+
+// dst += e through a scratch value, for nodes without a fused form
+template <class E, class Dst>
+void accumulate_via_scratch(const E &e, Dst dst, bool negate) {
+    Scratch<Dst> s;
+    auto t = arg(e, dst, s);
+    negate ? sub(dst, dst, t) : add(dst, dst, t);
+}
+
+// dst = op(l, r): an operand that is not a Value is evaluated straight into dst when the other one does not
+// read dst, otherwise into scratch
+template <class L, class R, class Dst, class Op>
+void eval_binary(Dst dst, const L &l, const R &r, Op op) {
+    Scratch<Dst> sl, sr;
+    if constexpr (!L::leaf) if (!r.refs(dst)) { l.eval(dst); op(dst, dst, arg(r, dst, sr)); return; }
+    if constexpr (!R::leaf) if (!l.refs(dst)) { r.eval(dst); op(dst, arg(l, dst, sl), dst); return; }
+    op(dst, arg(l, dst, sl), arg(r, dst, sr));
+}
+} // namespace detail
+
+// A C++ number inside an expression: long for integral types, double otherwise
+template <class S>
+class Scalar : public Expr<Scalar<S>> {
+public:
+    static constexpr bool leaf = false;
+    explicit Scalar(S v) : v_(v) {}
+    S value() const { return v_; }
+    Dimension dim() const { return Dimension(); }
+    bool is_int() const { return is_integral<S>::value; }
+    template <class P> bool refs(P) const { return false; }
+    void eval(mpz_ptr dst) const {
+        if constexpr (is_integral<S>::value) mpz_set_si(dst, v_);
+        else throw logic_error("double operand in an integer evaluation");
+    }
+    void eval(mpfr_ptr dst) const {
+        if constexpr (is_integral<S>::value) mpfr_set_si(dst, v_, MPFR_RNDN);
+        else mpfr_set_d(dst, v_, MPFR_RNDN);
+    }
+    void accumulate(mpz_ptr dst, bool negate) const {
+        if constexpr (is_integral<S>::value) {
+            unsigned long m = v_ < 0 ? 0UL - (unsigned long)v_ : (unsigned long)v_;
+            (negate != (v_ < 0)) ? mpz_sub_ui(dst, dst, m) : mpz_add_ui(dst, dst, m);
+        } else {
+            throw logic_error("double operand in an integer evaluation");
+        }
+    }
+    void accumulate(mpfr_ptr dst, bool negate) const {
+        if constexpr (is_integral<S>::value) mpfr_add_si(dst, dst, negate ? -v_ : v_, MPFR_RNDN);
+        else mpfr_add_d(dst, dst, negate ? -v_ : v_, MPFR_RNDN);
+    }
+private:
+    S v_;
+};
+
+template <class T> struct is_scalar_node : false_type {};
+template <class S> struct is_scalar_node<Scalar<S>> : true_type {};
+
+// l + r (Negate false) or l - r
+template <class L, class R, bool Negate>
+class Sum : public Expr<Sum<L, R, Negate>> {
+public:
+    static constexpr bool leaf = false;
+    Sum(const L &l, const R &r) : l_(l), r_(r) {}
+    Dimension dim() const {
+        Dimension a = l_.dim(), b = r_.dim();
+        if (!(a == b)) throw runtime_error(string("Unit mismatch for ") + (Negate ? "-" : "+"));
+        return a;
+    }
+    bool is_int() const { return l_.is_int() && r_.is_int(); }
+    template <class P> bool refs(P p) const { return l_.refs(p) || r_.refs(p); }
+    template <class Dst> void eval(Dst dst) const {
+        if constexpr (!R::leaf) {
+            // dst = l, then add r in place (a product becomes addmul/fma)
+            if (!r_.refs(dst)) { l_.eval(dst); r_.accumulate(dst, Negate); return; }
+            if (!l_.refs(dst)) {
+                r_.eval(dst);
+                if (Negate) detail::neg(dst);
+                l_.accumulate(dst, false);
+                return;
+            }
+        }
+        detail::eval_binary(dst, l_, r_, [](Dst d, auto a, auto b) { Negate ? detail::sub(d, a, b) : detail::add(d, a, b); });
+    }
+    template <class Dst> void accumulate(Dst dst, bool negate) const {
+        l_.accumulate(dst, negate);
+        r_.accumulate(dst, negate != Negate);
+    }
+private:
+    detail::stored<L> l_;
+    detail::stored<R> r_;
+};
+
+template <class L, class R>
+class Product : public Expr<Product<L, R>> {
+public:
+    static constexpr bool leaf = false;
+    Product(const L &l, const R &r) : l_(l), r_(r) {}
+    Dimension dim() const { return l_.dim() + r_.dim(); }
+    bool is_int() const { return l_.is_int() && r_.is_int(); }
+    template <class P> bool refs(P p) const { return l_.refs(p) || r_.refs(p); }
+    template <class Dst> void eval(Dst dst) const {
+        // integer scalar factor: mpz_mul_si / mpfr_mul_si without materialising it
+        if constexpr (is_same<R, Scalar<long>>::value) {
+            detail::Scratch<Dst> s;
+            detail::mul_si(dst, l_.refs(dst) || L::leaf ? detail::arg(l_, dst, s) : (l_.eval(dst), dst), r_.value());
+        } else if constexpr (is_same<L, Scalar<long>>::value) {
+            detail::Scratch<Dst> s;
+            detail::mul_si(dst, r_.refs(dst) || R::leaf ? detail::arg(r_, dst, s) : (r_.eval(dst), dst), l_.value());
+        } else {
+            detail::eval_binary(dst, l_, r_, [](Dst d, auto a, auto b) { detail::mul(d, a, b); });
+        }
+    }
+    template <class Dst> void accumulate(Dst dst, bool negate) const {
+        detail::Scratch<Dst> sl, sr;
+        detail::addmul(dst, detail::arg(l_, dst, sl), detail::arg(r_, dst, sr), negate);
+    }
+private:
+    detail::stored<L> l_;
+    detail::stored<R> r_;
+};
+
+// Always real: '/' on integers rounds like the interpreter's MPFR path
+template <class L, class R>
+class Quotient : public Expr<Quotient<L, R>> {
+public:
+    static constexpr bool leaf = false;
+    Quotient(const L &l, const R &r) : l_(l), r_(r) {}
+    Dimension dim() const { return l_.dim() - r_.dim(); }
+    bool is_int() const { return false; }
+    template <class P> bool refs(P p) const { return l_.refs(p) || r_.refs(p); }
+    void eval(mpz_ptr) const { throw logic_error("quotient in an integer evaluation"); }
+    void eval(mpfr_ptr dst) const {
+        detail::eval_binary(dst, l_, r_, [](mpfr_ptr d, mpfr_srcptr a, mpfr_srcptr b) { mpfr_div(d, a, b, MPFR_RNDN); });
+    }
+    void accumulate(mpz_ptr, bool) const { throw logic_error("quotient in an integer evaluation"); }
+    void accumulate(mpfr_ptr dst, bool negate) const { detail::accumulate_via_scratch(*this, dst, negate); }
+private:
+    detail::stored<L> l_;
+    detail::stored<R> r_;
+};
+
+template <class E>
+class Negation : public Expr<Negation<E>> {
+public:
+    static constexpr bool leaf = false;
+    explicit Negation(const E &e) : e_(e) {}
+    Dimension dim() const { return e_.dim(); }
+    bool is_int() const { return e_.is_int(); }
+    template <class P> bool refs(P p) const { return e_.refs(p); }
+    template <class Dst> void eval(Dst dst) const { e_.eval(dst); detail::neg(dst); }
+    template <class Dst> void accumulate(Dst dst, bool negate) const { e_.accumulate(dst, !negate); }
+private:
+    detail::stored<E> e_;
+};
+
+// ----------------- Value -----------------
+class Value : public Expr<Value> {
+public:
+    static constexpr bool leaf = true;
+
+    Value() : is_int_(true) { mpz_init(z_); mpfr_init2(f_, DEFAULT_MPFR_PREC); }
+    Value(long v) : Value() { mpz_set_si(z_, v); }
+    Value(int v) : Value((long)v) {}
+    Value(double v) : Value() { is_int_ = false; mpfr_set_d(f_, v, MPFR_RNDN); }
+    Value(const Value &o) : is_int_(o.is_int_), dim_(o.dim_) {
+        mpz_init_set(z_, o.z_);
+        mpfr_init2(f_, mpfr_get_prec(o.f_)); mpfr_set(f_, o.f_, MPFR_RNDN);
+    }
+    Value(Value &&o) noexcept : Value() { swap(o); }
+    Value &operator=(const Value &o) {
+        if (this == &o) return *this;
+        is_int_ = o.is_int_; dim_ = o.dim_;
+        if (is_int_) mpz_set(z_, o.z_); else mpfr_set(f_, o.f_, MPFR_RNDN);
+        return *this;
+    }
+    Value &operator=(Value &&o) noexcept { swap(o); return *this; }
+    ~Value() { mpz_clear(z_); mpfr_clear(f_); }
+
+    // Evaluate an expression into this value (no intermediate Values; see the file comment)
+    template <class E> Value(const Expr<E> &e) : Value() { assign(e.self()); }
+    template <class E> Value &operator=(const Expr<E> &e) { assign(e.self()); return *this; }
+    template <class E> Value &operator+=(const Expr<E> &e);
+    template <class E> Value &operator-=(const Expr<E> &e);
+    template <class E> Value &operator*=(const Expr<E> &e);
+    template <class E> Value &operator/=(const Expr<E> &e);
+    template <class S, class = typename enable_if<is_arithmetic<S>::value>::type> Value &operator+=(S s);
+    template <class S, class = typename enable_if<is_arithmetic<S>::value>::type> Value &operator-=(S s);
+    template <class S, class = typename enable_if<is_arithmetic<S>::value>::type> Value &operator*=(S s);
+    template <class S, class = typename enable_if<is_arithmetic<S>::value>::type> Value &operator/=(S s);
+
+    // Literal with an optional unit, as in the onefile language ("12.5", "km"). Exact decimals times exact
+    // unit factors stay exact integers when the product is one (5 km = 5000 m), like the MPFR unit path
+    static Value parse(const string &number, const string &unit = "") {
+        UnitPtr u = nullptr;
+        if (!unit.empty()) {
+            u = UNIT_REG.resolve(unit);
+            if (!u) throw runtime_error("Unknown unit: " + unit);
+        }
+        Value r;
+        mpz_t lit; mpz_init(lit);
+        unsigned long sc = 0;
+        if ((!u || u->exact) && parse_exact_decimal(trim(number), lit, sc)) {
+            mpq_t q; mpq_init(q);
+            decimal_to_q(q, lit, sc);
+            if (u) {
+                mpq_t fq; mpq_init(fq);
+                u->factor_q(fq);
+                mpq_mul(q, q, fq);
+                mpq_clear(fq);
+            }
+            r.set_q(q);
+            mpq_clear(q);
+        } else {
+            BigValue b;
+            b.set_from_string_and_unit(number, unit);
+            r = Value(b);
+        }
+        mpz_clear(lit);
+        if (u) r.dim_ = u->dim;
+        return r;
+    }
+    // One of a unit, in SI (Value::unit("km") is 1000 m), for scaling: x * Value::unit("km")
+    static Value unit(const string &name) { return parse("1", name); }
+
+    explicit Value(const BigValue &v) : Value() {
+        if (v.is_list) throw runtime_error("a list is not a single value");
+        if (v.is_cplx) throw runtime_error("a complex number is not a real value");
+        dim_ = v.dim;
+        if (v.is_int) {
+            mpz_set(z_, v.i);
+            if (v.z10) {
+                mpz_t p; mpz_init(p);
+                mpz_ui_pow_ui(p, 10, v.z10);
+                mpz_mul(z_, z_, p);
+                mpz_clear(p);
+            }
+        } else {
+            is_int_ = false;
+            load_mpfr(f_, v);
+        }
+    }
+    // For the engine's functions and formatting
+    shared_ptr<BigValue> big() const {
+        auto r = make_shared<BigValue>();
+        r->is_int = is_int_;
+        r->dim = dim_;
+        if (is_int_) mpz_set(r->i, z_);
+        else { mpfr_set_prec(r->f, mpfr_get_prec(f_)); mpfr_set(r->f, f_, MPFR_RNDN); }
+        return r;
+    }
+
+    // Precision of real results assigned to this value, in bits (existing value rounded)
+    void set_precision(mpfr_prec_t bits) { mpfr_prec_round(f_, bits, MPFR_RNDN); }
+    mpfr_prec_t precision() const { return mpfr_get_prec(f_); }
+
+    bool is_integer() const { return is_int_; }
+    const Dimension &dimension() const { return dim_; }
+    mpz_srcptr z() const { return z_; }   // valid when is_integer()
+    mpfr_srcptr f() const { return f_; }  // valid otherwise
+
+    // Display text as the interpreter prints results, and the 'to unit' conversion
+    string str(const EvalConfig &cfg = EvalConfig()) const { return format_value(*big(), cfg); }
+    string to(const string &unit, const EvalConfig &cfg = EvalConfig()) const {
+        UnitPtr u = UNIT_REG.resolve(unit);
+        if (!u) throw runtime_error("Unknown unit: " + unit);
+        if (!(u->dim == dim_)) throw runtime_error("Unit mismatch for 'to'");
+        return convert_to_unit(*big(), *u, cfg);
+    }
+
+    void swap(Value &o) noexcept {
+        std::swap(is_int_, o.is_int_);
+        std::swap(dim_, o.dim_);
+        mpz_swap(z_, o.z_);
+        mpfr_swap(f_, o.f_);
+    }
+
+    // Expression node interface
+    Dimension dim() const { return dim_; }
+    bool is_int() const { return is_int_; }
+    bool refs(mpz_srcptr p) const { return is_int_ && p == z_; }
+    bool refs(mpfr_srcptr p) const { return p == f_; }
+    void eval(mpz_ptr dst) const { if (dst != z_) mpz_set(dst, z_); }
+    void eval(mpfr_ptr dst) const {
+        if (is_int_) mpfr_set_z(dst, z_, MPFR_RNDN);
+        else if (dst != f_) mpfr_set(dst, f_, MPFR_RNDN);
+    }
+    template <class Dst> void accumulate(Dst dst, bool negate) const { detail::accumulate_via_scratch(*this, dst, negate); }
+
+private:
+    bool is_int_;
+    mpz_t z_;
+    mpfr_t f_;
+    Dimension dim_;
+
+    template <class E> void assign(const E &e) {
+        Dimension d = e.dim(); // all checks before this value is touched
+        if (e.is_int()) {
+            e.eval(z_);
+            is_int_ = true;
+        } else {
+            e.eval(f_);
+            is_int_ = false;
+        }
+        dim_ = d;
+    }
+
+    void set_q(mpq_srcptr q) {
+        is_int_ = mpz_cmp_ui(mpq_denref(q), 1) == 0;
+        if (is_int_) mpz_set(z_, mpq_numref(q));
+        else mpfr_set_q(f_, q, MPFR_RNDN);
+    }
+};
+
+namespace detail {
+// An integer Value is read in place; a real one cannot occur here (is_int() was false)
+inline mpz_srcptr arg(const Value &e, mpz_ptr, IntScratch &) { return e.z(); }
+template <class E> mpz_srcptr int_arg(const E &e, mpz_ptr like, IntScratch &s) {
+    mpz_ptr t = s.get(like);
+    e.eval(t);
+    return t;
+}
+// A real Value is read in place; an integer one is converted at the destination's precision
+template <class E> mpfr_srcptr real_arg(const E &e, mpfr_ptr like, RealScratch &s) {
+    if constexpr (E::leaf) if (!e.is_int()) return e.f();
+    mpfr_ptr t = s.get(like);
+    e.eval(t);
+    return t;
+}
+} // namespace detail
+
+// ----------------- Operators -----------------
+namespace detail {
+template <class S> using scalar_for = Scalar<typename conditional<is_integral<S>::value, long, double>::type>;
+template <class S> using if_arith = typename enable_if<is_arithmetic<S>::value>::type;
+} // namespace detail
+
+template <class L, class R> Sum<L, R, false> operator+(const Expr<L> &a, const Expr<R> &b) { return {a.self(), b.self()}; }
+template <class L, class R> Sum<L, R, true> operator-(const Expr<L> &a, const Expr<R> &b) { return {a.self(), b.self()}; }
+template <class L, class R> Product<L, R> operator*(const Expr<L> &a, const Expr<R> &b) { return {a.self(), b.self()}; }
+template <class L, class R> Quotient<L, R> operator/(const Expr<L> &a, const Expr<R> &b) { return {a.self(), b.self()}; }
+template <class E> Negation<E> operator-(const Expr<E> &a) { return Negation<E>(a.self()); }
+
+// Mixed with C++ numbers (which are dimensionless)
+template <class L, class S, class = detail::if_arith<S>>
+Sum<L, detail::scalar_for<S>, false> operator+(const Expr<L> &a, S b) { return {a.self(), detail::scalar_for<S>(b)}; }
+template <class R, class S, class = detail::if_arith<S>>
+Sum<detail::scalar_for<S>, R, false> operator+(S a, const Expr<R> &b) { return {detail::scalar_for<S>(a), b.self()}; }
+template <class L, class S, class = detail::if_arith<S>>
+Sum<L, detail::scalar_for<S>, true> operator-(const Expr<L> &a, S b) { return {a.self(), detail::scalar_for<S>(b)}; }
+template <class R, class S, class = detail::if_arith<S>>
+Sum<detail::scalar_for<S>, R, true> operator-(S a, const Expr<R> &b) { return {detail::scalar_for<S>(a), b.self()}; }
+template <class L, class S, class = detail::if_arith<S>>
+Product<L, detail::scalar_for<S>> operator*(const Expr<L> &a, S b) { return {a.self(), detail::scalar_for<S>(b)}; }
+template <class R, class S, class = detail::if_arith<S>>
+Product<detail::scalar_for<S>, R> operator*(S a, const Expr<R> &b) { return {detail::scalar_for<S>(a), b.self()}; }
+template <class L, class S, class = detail::if_arith<S>>
+Quotient<L, detail::scalar_for<S>> operator/(const Expr<L> &a, S b) { return {a.self(), detail::scalar_for<S>(b)}; }
+template <class R, class S, class = detail::if_arith<S>>
+Quotient<detail::scalar_for<S>, R> operator/(S a, const Expr<R> &b) { return {detail::scalar_for<S>(a), b.self()}; }
+
+// Compound assignment is the same fused evaluation with this value as the left operand
+template <class E> Value &Value::operator+=(const Expr<E> &e) { return *this = *this + e; }
+template <class E> Value &Value::operator-=(const Expr<E> &e) { return *this = *this - e; }
+template <class E> Value &Value::operator*=(const Expr<E> &e) { return *this = *this * e; }
+template <class E> Value &Value::operator/=(const Expr<E> &e) { return *this = *this / e; }
+template <class S, class> Value &Value::operator+=(S s) { return *this = *this + s; }
+template <class S, class> Value &Value::operator-=(S s) { return *this = *this - s; }
+template <class S, class> Value &Value::operator*=(S s) { return *this = *this * s; }
+template <class S, class> Value &Value::operator/=(S s) { return *this = *this / s; }
+
+inline ostream &operator<<(ostream &os, const Value &v) { return os << v.str(); }
+
+} // namespace superqalc
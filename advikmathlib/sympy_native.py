@@ -0,0 +1,21 @@
+"""Native fast path for SymPy queries, shared by the Discord bot and the web API."""
+import re
+try:
+    import Advikmathlib  # native engine: numeric SymPy queries skip sympify
+except ImportError:
+    Advikmathlib = None
+
+# float literals (1.5, .5, 1e3) and Float()/N() make SymPy answer with a Float, which the native engine doesn't mimic
+_FLOAT_SYNTAX = re.compile(r"\d\.|\.\d|\d[eE][+-]?\d|\b(?:Float|N)\s*\(")
+
+def native_sympy(expr, client=""):
+    """Evaluate a purely numeric SymPy-syntax query (2**100, Rational(1,3)+Rational(1,6)) in the native engine,
+    charged to client's quota. Only exact integers and rationals are answered, printed as SymPy does ("1/2").
+    Returns None when SymPy is needed: symbols, unsupported functions, floats, irrational results such as
+    sqrt(8) (SymPy keeps 2*sqrt(2)), or no native module."""
+    if Advikmathlib is None or _FLOAT_SYNTAX.search(expr) or not Advikmathlib.is_numeric(expr):
+        return None
+    try:
+        return Advikmathlib.evaluate(expr, syntax="python", client=client).fraction()
+    except (ValueError, RuntimeError):
+        return None
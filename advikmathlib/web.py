@@ -4,6 +4,7 @@ from fastapi.responses import RedirectResponse
 from pydantic import BaseModel
 import subprocess
 import sympy
+from sympy_native import native_sympy
 import requests
 import copy
 import chess
@@ -57,10 +58,17 @@ def calc_qalc(req: CalcRequest):
     except Exception as e:
         raise HTTPException(status_code=500, detail=str(e))
 
+def client_id(request: Request):
+    """Quota key for the native engine: the caller's API key, else its address."""
+    key = request.headers.get("X-API-Key")
+    if key:
+        return "key:" + key
+    return "ip:" + (request.client.host if request.client else "unknown")
+
 @app.post("/calc/sympy")
-def calc_sympy(req: CalcRequest):
+def calc_sympy(req: CalcRequest, request: Request):
     try:
-        return {"result": str(sympy.sympify(req.expression))}
+        return {"result": native_sympy(req.expression, client_id(request)) or str(sympy.sympify(req.expression))}
     except Exception as e:
         raise HTTPException(status_code=400, detail=f"SymPy Error: {e}")
 
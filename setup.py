@@ -4,13 +4,15 @@ import pybind11
 ext_modules = [
     Extension(
         "Advikmathlib",
-        ["wrapper.cpp"],  # Only compile the wrapper here
+        ["wrapper.cpp"],  # Only compile the wrapper here (it includes the onefile engine)
         include_dirs=[
             pybind11.get_include(),
             pybind11.get_include(user=True)
         ],
         language="c++",
-        extra_compile_args=["-std=c++17"]
+        libraries=["mpfr", "gmp"],
+        extra_compile_args=["-std=c++17", "-pthread"],
+        extra_link_args=["-pthread"]
     )
 ]
 
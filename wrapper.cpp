@@ -1,9 +1,15 @@
 #include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
 #include <string>
 #include <stdexcept>
 #include <array>
 #include <cstdio>
 #include <memory>
+#include <vector>
+
+// In-process engine for the stateful APIs (sessions); the one-shot calls still run the binaries.
+#define SUPERQALC_NO_MAIN
+#include "advikmathlib/superqalc_onefile.cpp"
 
 namespace py = pybind11;
 
@@ -38,8 +44,187 @@ std::string run_superqalc_tower(const std::string &input) {
     return run_command_stdin("./advikmathlib/superqalc_tower", input);
 }
 
+// Python handles on engine values and compiled expressions. Both pickle to the engine's binary blobs,
+// so they cross process boundaries (multiprocessing, caches) without a decimal round trip.
+struct PyValue {
+    ValuePtr value;
+};
+
+struct PyExpression {
+    std::vector<Token> rpn;
+};
+
+// syntax "python": SymPy-style numeric input (2**100, Rational(1, 3), sqrt(2)*pi); symbolic input raises ValueError
+static PyExpression compile_expression(const std::string &expr, const std::string &syntax) {
+    if (syntax == "python") {
+        PythonParse p = tokenize_python(expr);
+        if (!p.numeric) throw py::value_error("not numeric: " + p.reason);
+        return { shunting_yard(p.tokens) };
+    }
+    if (syntax != "native") throw py::value_error("syntax must be 'native' or 'python'");
+    return { shunting_yard(tokenize(expr)) };
+}
+
+// client: API key or user ID charged under the engine's quotas (QuotaManager); "" evaluates unmetered
+static EvalResult evaluate_for(const std::vector<Token> &rpn, const std::string &client) {
+    py::gil_scoped_release nogil;
+    if (client.empty()) return eval_rpn_value(rpn, EvalConfig());
+    return QuotaManager::instance().evaluate(client, rpn, EvalConfig());
+}
+
+static PyValue evaluate_rpn(const std::vector<Token> &rpn, const std::string &client) {
+    EvalResult r = evaluate_for(rpn, client);
+    if (!r.value) throw py::value_error(r.text);
+    return { r.value };
+}
+
+// Result text as the CLI prints it: the value, an overflow approximation or the error message
+static std::string calc_text(const std::string &expr, const std::string &client, const std::string &syntax) {
+    std::vector<Token> rpn;
+    try {
+        rpn = compile_expression(expr, syntax).rpn;
+    } catch (const py::value_error &) {
+        throw;
+    } catch (const std::exception &e) {
+        return std::string("Parse error: ") + e.what();
+    }
+    EvalResult r = evaluate_for(rpn, client);
+    std::string out = r.value ? format_value(*r.value, EvalConfig()) : r.text;
+    if (r.degraded) out += "\n(reduced precision: CPU quota exhausted)";
+    return out;
+}
+
+// Result text of a stream's input, as calc() gives it
+static std::string stream_text(StreamEvaluator &s) {
+    EvalResult r;
+    {
+        py::gil_scoped_release nogil;
+        r = s.finish();
+    }
+    std::string out = r.value ? format_value(*r.value, EvalConfig()) : r.text;
+    if (r.degraded) out += "\n(reduced precision: CPU quota exhausted)";
+    return out;
+}
+
+static void set_quota(double requests_per_minute, double request_burst, double cpu_seconds_per_minute, double cpu_burst,
+                      double max_request_cpu, long long max_request_bytes, double degraded_max_digits,
+                      int degraded_precision, double degraded_request_cpu) {
+    QuotaPolicy p;
+    p.requests_per_minute = requests_per_minute;
+    p.request_burst = request_burst;
+    p.cpu_seconds_per_minute = cpu_seconds_per_minute;
+    p.cpu_burst = cpu_burst;
+    p.max_request_cpu = max_request_cpu;
+    p.max_request_bytes = max_request_bytes;
+    p.degraded_max_digits = degraded_max_digits;
+    p.degraded_precision = degraded_precision;
+    p.degraded_request_cpu = degraded_request_cpu;
+    QuotaManager::instance().set_policy(p);
+}
+
+static py::dict client_usage(const std::string &client) {
+    ClientUsage u = QuotaManager::instance().usage(client);
+    py::dict d;
+    d["requests"] = u.requests;
+    d["rejected"] = u.rejected;
+    d["degraded"] = u.degraded;
+    d["cpu_seconds"] = u.cpu_seconds;
+    d["gmp_bytes"] = u.gmp_bytes;
+    d["gmp_peak_bytes"] = u.gmp_peak_bytes;
+    return d;
+}
+
+// "p" or "p/q" for an exact dimensionless integer or rational, as SymPy prints it; None for anything else
+static py::object value_fraction(const PyValue &v) {
+    const BigValue &b = *v.value;
+    if (!(b.dim == Dimension()) || !(b.is_int || b.is_rat)) return py::none();
+    if (b.is_int) return py::str(b.to_human());
+    char *s = mpq_get_str(NULL, 10, b.q);
+    std::string out(s); free(s);
+    return py::str(out);
+}
+
+static py::bytes value_to_bytes(const PyValue &v) { return py::bytes(serialize_value(*v.value)); }
+static PyValue value_from_bytes(const py::bytes &b) {
+    std::string s = b;
+    return { deserialize_value(s.data(), s.size()) };
+}
+static py::bytes expression_to_bytes(const PyExpression &e) { return py::bytes(serialize_rpn(e.rpn)); }
+static PyExpression expression_from_bytes(const py::bytes &b) {
+    std::string s = b;
+    return { deserialize_rpn(s.data(), s.size()) };
+}
+
 PYBIND11_MODULE(Advikmathlib, m) {
     m.doc() = "Advik's math library with superqalc";
     m.def("onefile", &run_superqalc_onefile, "Run superqalc_onefile with stdin input");
     m.def("tower", &run_superqalc_tower, "Run superqalc_tower with stdin input");
+
+    py::class_<PyValue>(m, "Value", "An evaluated onefile result (exact integer, decimal or MPFR, with dimension)")
+        .def("__str__", [](const PyValue &v) { return format_value(*v.value, EvalConfig()); })
+        .def("__eq__", [](const PyValue &a, const PyValue &b) { return same_value(a.value, b.value); })
+        .def("fraction", &value_fraction, "Exact integer or rational as \"p\" or \"p/q\"; None if the value is not one")
+        .def("to_bytes", &value_to_bytes)
+        .def_static("from_bytes", &value_from_bytes, py::arg("data"))
+        .def(py::pickle(&value_to_bytes, &value_from_bytes));
+
+    py::class_<PyExpression>(m, "Expression", "A compiled onefile expression")
+        .def("evaluate", [](const PyExpression &e, const std::string &client) { return evaluate_rpn(e.rpn, client); },
+             py::arg("client") = "")
+        .def("to_bytes", &expression_to_bytes)
+        .def_static("from_bytes", &expression_from_bytes, py::arg("data"))
+        .def(py::pickle(&expression_to_bytes, &expression_from_bytes));
+
+    m.def("compile", &compile_expression, py::arg("expression"), py::arg("syntax") = "native",
+          "Tokenize and parse once; evaluate() many times");
+    m.def("evaluate", [](const std::string &expr, const std::string &syntax, const std::string &client) {
+              return evaluate_rpn(compile_expression(expr, syntax).rpn, client);
+          }, py::arg("expression"), py::arg("syntax") = "native", py::arg("client") = "",
+          "Evaluate in-process and return a Value; a client ID is charged under the quotas");
+    m.def("calc", &calc_text, py::arg("expression"), py::arg("client") = "", py::arg("syntax") = "native",
+          "Evaluate in-process and return the result text (value, approximation or error)");
+
+    QuotaPolicy q;
+    m.def("set_quota", &set_quota, py::arg("requests_per_minute") = q.requests_per_minute,
+          py::arg("request_burst") = q.request_burst, py::arg("cpu_seconds_per_minute") = q.cpu_seconds_per_minute,
+          py::arg("cpu_burst") = q.cpu_burst, py::arg("max_request_cpu") = q.max_request_cpu,
+          py::arg("max_request_bytes") = q.max_request_bytes, py::arg("degraded_max_digits") = (double)q.degraded_max_digits,
+          py::arg("degraded_precision") = q.degraded_precision, py::arg("degraded_request_cpu") = q.degraded_request_cpu,
+          "Per-client token buckets (requests, CPU seconds) and per-request caps; over the CPU quota, answers are degraded");
+    m.def("client_usage", &client_usage, py::arg("client"), "Requests, rejections, degraded answers, CPU seconds and GMP bytes of a client");
+    m.def("reset_client", [](const std::string &client) { QuotaManager::instance().reset(client); }, py::arg("client"));
+    m.def("is_numeric", [](const std::string &expr) { return tokenize_python(expr).numeric; }, py::arg("expression"),
+          "True if a SymPy-syntax expression is a plain number the native engine can evaluate (no symbols)");
+
+    py::class_<StreamEvaluator>(m, "Stream", "Native input fed in pieces; complete subexpressions are evaluated in the background")
+        .def(py::init([](const std::string &client) { return new StreamEvaluator(EvalConfig(), client); }), py::arg("client") = "")
+        .def("append", [](StreamEvaluator &s, const std::string &text) {
+            py::gil_scoped_release nogil; // may wait for an evaluate() running in another thread
+            s.append(text);
+        }, py::arg("text"), "Add text; it continues the previous text directly")
+        .def("evaluate", &stream_text, "Result text of everything appended so far (as calc()); the stream then starts over")
+        .def("close", [](StreamEvaluator &s) {
+            py::gil_scoped_release nogil;
+            s.close();
+        }, "Drop the input and stop the background evaluation (also done when the Stream is garbage collected)");
+
+    py::class_<Session>(m, "Session", "Named onefile values that recompute only what changed")
+        .def(py::init<>())
+        .def("set", &Session::set, py::arg("name"), py::arg("expression"),
+             "Define or redefine a variable; takes effect on the next recompute()")
+        .def("remove", &Session::remove, py::arg("name"))
+        // Session is not thread-safe: recompute() keeps the GIL so no other thread can set() or read meanwhile
+        .def("recompute", &Session::recompute, "Re-evaluate changed variables and their dependents; returns the names recomputed")
+        .def("get", [](const Session &s, const std::string &name) { return s.cell(name).text; }, py::arg("name"))
+        .def("values", [](const Session &s) {
+            std::map<std::string, std::string> out;
+            for (const auto &n : s.names()) out[n] = s.cell(n).text;
+            return out;
+        })
+        .def("value", [](const Session &s, const std::string &name) {
+            const SessionCell &c = s.cell(name);
+            if (!c.value) throw py::value_error(c.text);
+            return PyValue{ c.value };
+        }, py::arg("name"))
+        .def("__contains__", &Session::has);
 }